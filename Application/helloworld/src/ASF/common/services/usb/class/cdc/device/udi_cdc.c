@@ -1220,6 +1220,25 @@ enum UDI_CDC_STATUS udi_cdc_multi_write_buf_no_block(
 }
 
 
+bool udi_cdc_multi_is_tx_empty(uint8_t port)
+{
+	irqflags_t flags;
+	bool is_empty;
+
+	#if UDI_CDC_PORT_NB == 1
+	port = 0;
+	#endif
+
+	// nothing waits in the buffer being filled, so whatever is written
+	// next goes out in a transfer of its own
+	flags = cpu_irq_save();
+	is_empty = (0 == udi_cdc_tx_buf_nb[port][udi_cdc_tx_buf_sel[port]]);
+	cpu_irq_restore(flags);
+
+	return is_empty;
+}
+
+
 iram_size_t udi_cdc_multi_write_buf(uint8_t port, const void* buf, iram_size_t size)
 {
 	irqflags_t flags;
@@ -598,6 +598,13 @@ enum UDI_CDC_STATUS udi_cdc_multi_write_buf_no_block(
 enum UDI_CDC_STATUS udi_cdc_multi_read_no_block(
 		uint8_t port, void * buf, iram_size_t size, iram_size_t * num_read);
 
+/**
+ * \brief True while no data waits for the next transfer
+ *
+ * \param port         Communication port number to manage
+ */
+bool udi_cdc_multi_is_tx_empty(uint8_t port);
+
 //@}
 
 //@}
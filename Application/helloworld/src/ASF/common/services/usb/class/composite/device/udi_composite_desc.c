@@ -53,9 +53,15 @@ UDC_DESC_STORAGE usb_dev_desc_t udc_device_desc = {
 	.bLength                   = sizeof(usb_dev_desc_t),
 	.bDescriptorType           = USB_DT_DEVICE,
 	.bcdUSB                    = LE16(USB_V2_0),
+#ifdef UDI_COMPOSITE_USES_IAD
+	.bDeviceClass              = CLASS_IAD,
+	.bDeviceSubClass           = SUB_CLASS_IAD,
+	.bDeviceProtocol           = PROTOCOL_IAD,
+#else
 	.bDeviceClass              = 0,
 	.bDeviceSubClass           = 0,
 	.bDeviceProtocol           = 0,
+#endif
 	.bMaxPacketSize0           = USB_DEVICE_EP_CTRL_SIZE,
 	.idVendor                  = LE16(USB_DEVICE_VENDOR_ID),
 	.idProduct                 = LE16(USB_DEVICE_PRODUCT_ID),
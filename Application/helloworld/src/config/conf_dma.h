@@ -36,6 +36,7 @@
 #ifndef CONF_DMA_H_INCLUDED
 #define CONF_DMA_H_INCLUDED
 
-#  define CONF_MAX_USED_CHANNEL_NUM     5
+// rx and tx for each UART bridge port, logic, pattern and bitbang
+#  define CONF_MAX_USED_CHANNEL_NUM     7
 
 #endif
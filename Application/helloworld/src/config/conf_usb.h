@@ -127,12 +127,15 @@ extern void user_callback_sof_action(void);
  */
 
 //! Number of communication port used (1 to 3)
-#define  UDI_CDC_PORT_NB 1
+//! Two fit next to the vendor interface, see the endpoints below
+#define  UDI_CDC_PORT_NB 2
 
 //! Interface callback definition
 #define  UDI_CDC_TX_EMPTY_NOTIFY(port)
-#define  UDI_CDC_SET_DTR_EXT(port,set)
-#define  UDI_CDC_SET_RTS_EXT(port,set)
+#define  UDI_CDC_SET_DTR_EXT(port,set) user_callback_cdc_set_dtr(port,set)
+extern void user_callback_cdc_set_dtr(uint8_t port, bool b_enable);
+#define  UDI_CDC_SET_RTS_EXT(port,set) user_callback_cdc_set_rts(port,set)
+extern void user_callback_cdc_set_rts(uint8_t port, bool b_enable);
 
 /*
  * #define UDI_CDC_DISABLE_EXT(port) my_callback_cdc_disable()
@@ -149,7 +152,9 @@ extern void user_callback_sof_action(void);
 
 //! Define it when the transfer CDC Device to Host is a low rate (<512000 bauds)
 //! to reduce CDC buffers size
-#define  UDI_CDC_LOW_RATE
+//! Left undefined, the UART bridge runs up to 6 Mbaud and needs the
+//! 5 packet buffers to keep the bulk endpoints busy
+//#define  UDI_CDC_LOW_RATE
 
 //! Default configuration of communication port
 #define  UDI_CDC_DEFAULT_RATE             115200
@@ -163,28 +168,24 @@ extern void user_callback_sof_action(void);
  * For composite device, these configuration must be defined here
  * @{
  */
+//! The SAM D USB has endpoints 1 to 7, each with an IN and an OUT bank
+//! of its own. The vendor interface takes 1 OUT, 2 IN, 3 IN and 5 IN;
+//! every CDC port needs two IN endpoints, which leaves room for two ports.
 //! Endpoints' numbers used by single or first CDC port
 #define  UDI_CDC_DATA_EP_IN_0          (4 | USB_EP_DIR_IN)  // TX
 #define  UDI_CDC_DATA_EP_OUT_0         (5 | USB_EP_DIR_OUT) // RX
 #define  UDI_CDC_COMM_EP_0             (6 | USB_EP_DIR_IN)  // Notify endpoint
 //! Endpoints' numbers used by second CDC port (Optional)
-#define  UDI_CDC_DATA_EP_IN_2          (7 | USB_EP_DIR_IN)  // TX
-#define  UDI_CDC_DATA_EP_OUT_2         (8 | USB_EP_DIR_OUT) // RX
-#define  UDI_CDC_COMM_EP_2             (9 | USB_EP_DIR_IN)  // Notify endpoint
-//! Endpoints' numbers used by third CDC port (Optional)
-#define  UDI_CDC_DATA_EP_IN_3          (10 | USB_EP_DIR_IN)  // TX
-#define  UDI_CDC_DATA_EP_OUT_3         (11 | USB_EP_DIR_OUT) // RX
-#define  UDI_CDC_COMM_EP_3             (12 | USB_EP_DIR_IN)  // Notify endpoint
+#define  UDI_CDC_DATA_EP_IN_1          (7 | USB_EP_DIR_IN)  // TX
+#define  UDI_CDC_DATA_EP_OUT_1         (7 | USB_EP_DIR_OUT) // RX
+#define  UDI_CDC_COMM_EP_1             (1 | USB_EP_DIR_IN)  // Notify endpoint
 
 //! Interface numbers used by single or first CDC port
 #define  UDI_CDC_COMM_IFACE_NUMBER_0   1
 #define  UDI_CDC_DATA_IFACE_NUMBER_0   2
 //! Interface numbers used by second CDC port (Optional)
-#define  UDI_CDC_COMM_IFACE_NUMBER_2   3
-#define  UDI_CDC_DATA_IFACE_NUMBER_2   4
-//! Interface numbers used by third CDC port (Optional)
-#define  UDI_CDC_COMM_IFACE_NUMBER_3   5
-#define  UDI_CDC_DATA_IFACE_NUMBER_3   6
+#define  UDI_CDC_COMM_IFACE_NUMBER_1   3
+#define  UDI_CDC_DATA_IFACE_NUMBER_1   4
 
 //@}
 //@}
@@ -444,9 +445,10 @@ extern void user_callback_sof_action(void);
 #define UDI_VENDOR_EP_WRITE_ADDR  (1 | USB_EP_DIR_OUT)
 #define UDI_VENDOR_EP_READ_ADDR   (2 | USB_EP_DIR_IN)
 #define UDI_VENDOR_EP_NOTIFY_ADDR (3 | USB_EP_DIR_IN)
+#define UDI_VENDOR_EP_STREAM_ADDR (5 | USB_EP_DIR_IN)
 
 #define UDI_VENDOR_NUM_INTERFACES 1
-#define UDI_VENDOR_NUM_ENDPOINTS	3
+#define UDI_VENDOR_NUM_ENDPOINTS	4
 
 #define UDI_VENDOR_IFACE_NUMBER		0
 //@}
@@ -464,15 +466,19 @@ extern void user_callback_sof_action(void);
  //! Note:
  //! It is possible to define an IN and OUT endpoints with the same number on XMEGA product only
  //! E.g. MSC class can be have IN endpoint 0x81 and OUT endpoint 0x01
- #define  USB_DEVICE_MAX_EP             (1 + UDI_CDC_NUM_ENDPOINTS + UDI_VENDOR_NUM_ENDPOINTS)
+ //! The SAM D can as well, so this is the highest endpoint number
+ #define  USB_DEVICE_MAX_EP             7
+
+ //! Each CDC port is grouped by an IAD, see udi_composite_desc.c
+ #define  UDI_COMPOSITE_USES_IAD
 
 // For some reason including the cdc definition here works, but not at the top of the file...
 #include <udi_cdc.h>
 #include "udi_vendor.h"
 
 
-#define UDI_CDC_ENABLE_EXT(port) user_callback_cdc_enable()
-extern bool user_callback_cdc_enable(void);
+#define UDI_CDC_ENABLE_EXT(port) user_callback_cdc_enable(port)
+extern bool user_callback_cdc_enable(uint8_t port);
 
 #define UDI_CDC_DISABLE_EXT(port) user_callback_cdc_disable(port)
 extern void user_callback_cdc_disable(uint8_t port);
@@ -487,26 +493,40 @@ extern void user_callback_cdc_rx_notify(uint8_t port);
 //! USB Interfaces descriptor structure
 #define UDI_COMPOSITE_DESC_T          \
 	udi_vendor_desc_t     udi_vendor;		\
-	udi_cdc_comm_desc_t   udi_cdc_comm; \
-	udi_cdc_data_desc_t   udi_cdc_data;
+	usb_iad_desc_t        udi_cdc_iad_0; \
+	udi_cdc_comm_desc_t   udi_cdc_comm_0; \
+	udi_cdc_data_desc_t   udi_cdc_data_0; \
+	usb_iad_desc_t        udi_cdc_iad_1; \
+	udi_cdc_comm_desc_t   udi_cdc_comm_1; \
+	udi_cdc_data_desc_t   udi_cdc_data_1;
 
 //! USB Interfaces descriptor value for Full Speed
 #define UDI_COMPOSITE_DESC_FS                         \
 	.udi_vendor                = UDI_VENDOR_DESC,				\
-	.udi_cdc_comm              = UDI_CDC_COMM_DESC_0,   \
-	.udi_cdc_data              = UDI_CDC_DATA_DESC_0_FS
+	.udi_cdc_iad_0             = UDI_CDC_IAD_DESC_0,    \
+	.udi_cdc_comm_0            = UDI_CDC_COMM_DESC_0,   \
+	.udi_cdc_data_0            = UDI_CDC_DATA_DESC_0_FS, \
+	.udi_cdc_iad_1             = UDI_CDC_IAD_DESC_1,    \
+	.udi_cdc_comm_1            = UDI_CDC_COMM_DESC_1,   \
+	.udi_cdc_data_1            = UDI_CDC_DATA_DESC_1_FS
 
 //! USB Interfaces descriptor value for High Speed
 #define UDI_COMPOSITE_DESC_HS                         \
 	.udi_vendor                = UDI_VENDOR_DESC,				\
-	.udi_cdc_comm              = UDI_CDC_COMM_DESC_0,   \
-	.udi_cdc_data              = UDI_CDC_DATA_DESC_0_HS
+	.udi_cdc_iad_0             = UDI_CDC_IAD_DESC_0,    \
+	.udi_cdc_comm_0            = UDI_CDC_COMM_DESC_0,   \
+	.udi_cdc_data_0            = UDI_CDC_DATA_DESC_0_HS, \
+	.udi_cdc_iad_1             = UDI_CDC_IAD_DESC_1,    \
+	.udi_cdc_comm_1            = UDI_CDC_COMM_DESC_1,   \
+	.udi_cdc_data_1            = UDI_CDC_DATA_DESC_1_HS
 
 //! USB Interface APIs
 #define UDI_COMPOSITE_API  \
 	&udi_api_vendor,				 \
 	&udi_api_cdc_comm,       \
 	&udi_api_cdc_data,       \
+	&udi_api_cdc_comm,       \
+	&udi_api_cdc_data,       \
 
 /* Example for device with cdc, msc and hid mouse interface
 #define UDI_COMPOSITE_DESC_T \
@@ -5,6 +5,7 @@
 
 #include "rjt_logger.h"
 #include "rjt_queue.h"
+#include "rjt_msg_queue.h"
 #include "rjt_usb_bridge.h"
 #include "rjt_uart.h"
 #include "utils.h"
@@ -160,6 +161,7 @@ int main (void)
 
 	// Run Tests here
 	//RJTQueue_test();
+	//RJTMsgQueue_test();
 
 	// Trigger unimplemented interrupt (for testing)
 	//NVIC_EnableIRQ(I2S_IRQn);
@@ -181,7 +183,9 @@ int main (void)
 	while (1) {
 		RJTUart_processCDC();
 
-		RJTLogger_process();
+		RJTUSBBridge_process();
+
+		RJTLogger_service();
 	}
 }
 
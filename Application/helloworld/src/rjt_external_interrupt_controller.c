@@ -10,6 +10,7 @@
 #include "rjt_logger.h"
 #include "rjt_external_interrupt_controller.h"
 #include <pinmux.h>
+#include <string.h>
 
 static RJTEIC_t * mSelf = NULL;
 
@@ -30,18 +31,20 @@ do {\
 } while(0)
 
 
-void RJTEIC_configure(RJTEIC_t * self, RJTEICConfig_t * eic_config)
+// TCC1 counts GCLK1 (48 MHz), 24 bits wide
+#define PROBE_TCC				TCC1
+#define PROBE_TICKS_MASK		0x00ffffffUL
+#define PROBE_TICKS2NS(t)		(((t) * 125UL) / 6)
+
+static struct events_resource mProbeEvent;
+static bool mProbeEventAllocated = false;
+
+
+static void configure_line(RJTEIC_t * self, const RJTEICConfig_t * eic_config)
 {
-	ASSERT(NULL != self);
-	ASSERT(NULL != eic_config);
 	ASSERT(NULL != eic_config->callback);
-	ASSERT(true == self->module_init);
 	ASSERT(eic_config->ext_int_sel < EIC_NUMBER_OF_INTERRUPTS);
 
-	system_interrupt_enter_critical_section();
-
-	DISABLE_EIC();
-
 	uint8_t ext_intno = (uint8_t) eic_config->ext_int_sel;
 
 	// Disable interrupt
@@ -49,7 +52,6 @@ void RJTEIC_configure(RJTEIC_t * self, RJTEICConfig_t * eic_config)
 
 	// Clear interrupt
 	EIC->INTFLAG.reg = (1 << ext_intno);
-	RJTLogger_print("config ext int: %d", ext_intno);
 
 	uint8_t config_offset = ext_intno / 8;
 
@@ -68,9 +70,6 @@ void RJTEIC_configure(RJTEIC_t * self, RJTEICConfig_t * eic_config)
 	self->callbacks[ext_intno] = eic_config->callback;
 	self->intno2gpio[ext_intno] = eic_config->gpio;
 
-	NVIC_SetPriority(EIC_IRQn, APP_LOW_PRIORITY);
-	NVIC_EnableIRQ(EIC_IRQn);
-
 	struct system_pinmux_config config;
 
 	system_pinmux_get_config_defaults(&config);
@@ -81,42 +80,113 @@ void RJTEIC_configure(RJTEIC_t * self, RJTEICConfig_t * eic_config)
 	config.mux_position = eic_config->gpio_mux_position;
 
 	system_pinmux_pin_set_config(eic_config->gpio, &config);
+}
+
+
+/**
+ * Configures several lines with a single disable / enable of the
+ * EIC, rather than waiting for synchronization once per line.
+ */
+void RJTEIC_configureMany(RJTEIC_t * self, const RJTEICConfig_t * configs, size_t num_configs)
+{
+	ASSERT(NULL != self);
+	ASSERT(NULL != configs);
+	ASSERT(true == self->module_init);
+
+	system_interrupt_enter_critical_section();
+
+	DISABLE_EIC();
+
+	for(size_t k = 0; k < num_configs; k++) {
+		configure_line(self, &configs[k]);
+	}
+
+	NVIC_SetPriority(EIC_IRQn, APP_LOW_PRIORITY);
+	NVIC_EnableIRQ(EIC_IRQn);
 
 	ENABLE_EIC();
 	
 	system_interrupt_leave_critical_section();
+}
 
-	//RJTLogger_print("configured eic!");
+
+void RJTEIC_configure(RJTEIC_t * self, RJTEICConfig_t * eic_config)
+{
+	ASSERT(NULL != eic_config);
+
+	RJTEIC_configureMany(self, eic_config, 1);
 }
 
 
-void EIC_Handler(void)
+static uint32_t probe_read_count(void)
 {
-	system_interrupt_enter_critical_section();
+	PROBE_TCC->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+	while(PROBE_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_CTRLB);
+	while(PROBE_TCC->CTRLBSET.reg & TCC_CTRLBSET_CMD_Msk);
+
+	return PROBE_TCC->COUNT.reg;
+}
+
+
+static void measure_latency(RJTEIC_t * self)
+{
+	if(0 == (PROBE_TCC->INTFLAG.reg & TCC_INTFLAG_MC0)) {
+		// the edge never reached the capture channel
+		return;
+	}
+
+	uint32_t now = probe_read_count();
 
+	// reading CC0 clears MC0
+	uint32_t ticks = (now - PROBE_TCC->CC[0].reg) & PROBE_TICKS_MASK;
+	uint32_t ns = PROBE_TICKS2NS(ticks);
+
+	RJTEICStats_t * stats = &self->stats;
+
+	if(0 == stats->latency_count || ns < stats->latency_min_ns) {
+		stats->latency_min_ns = ns;
+	}
+	if(ns > stats->latency_max_ns) {
+		stats->latency_max_ns = ns;
+	}
+
+	stats->latency_sum_ns += ns;
+	stats->latency_count++;
+}
+
+
+/**
+ * Takes one snapshot of the pending lines and clears them before any
+ * callback runs, so an edge arriving during a callback pends again.
+ * Callbacks run with interrupts enabled and protect their own state.
+ */
+void EIC_Handler(void)
+{
 	if(NULL == mSelf) {
-		//RJTLogger_print("EIC Callback: EIC is NULL...");
+		RJTLogger_trace("EIC Callback: EIC is NULL...");
 		EIC->INTFLAG.reg = EIC->INTFLAG.reg;
 		return;
 	}
 
-	//RJTLogger_print("EIC Handler: %x", EIC->INTFLAG);
+	uint32_t pending = EIC->INTFLAG.reg & EIC->INTENSET.reg;
+	EIC->INTFLAG.reg = pending;
+
+	mSelf->stats.interrupts++;
 
-	uint8_t k;
-	for(k = 0; k < EIC_NUMBER_OF_INTERRUPTS; k++)
+	while(0 != pending)
 	{
-		if(EIC->INTFLAG.reg & (1 << k))
-		{
-			ASSERT(NULL != mSelf->callbacks[k]);
+		uint8_t k = lowest_bit(pending);
+		pending &= pending - 1;
 
-			mSelf->callbacks[k](mSelf, mSelf->intno2gpio[k], k);
-			EIC->INTFLAG.reg = (1 << k);
-		}
-	}
+		ASSERT(NULL != mSelf->callbacks[k]);
 
-	//EIC->INTFLAG.reg = EIC->INTFLAG.reg;
+		if(k == mSelf->probe_intno) {
+			measure_latency(mSelf);
+		}
 
-	system_interrupt_leave_critical_section();
+		mSelf->callbacks[k](mSelf, mSelf->intno2gpio[k], k);
+		mSelf->stats.events++;
+	}
 }
 
 
@@ -134,6 +204,147 @@ void RJTEIC_disableInterrupt(enum RJT_EIC_EXT_INT ext_intno)
 };
 
 
+bool RJTEIC_isInterruptEnabled(enum RJT_EIC_EXT_INT ext_intno)
+{
+	return 0 != (EIC->INTENSET.reg & (1 << ext_intno));
+}
+
+
+/**
+ * True when the line has its interrupt or its event output on for a
+ * user other than the one passing its callback, which may reconfigure
+ * its own lines.
+ */
+bool RJTEIC_isLineTaken(RJTEIC_t * self, enum RJT_EIC_EXT_INT ext_intno, RJTEICCallback_t callback)
+{
+	ASSERT(NULL != self);
+
+	bool in_use = RJTEIC_isInterruptEnabled(ext_intno) ||
+		0 != (EIC->EVCTRL.reg & (1UL << ext_intno));
+
+	return in_use && callback != self->callbacks[ext_intno];
+}
+
+
+/**
+ * Lets the line generate events for the event system. Event users
+ * may need a level rather than an edge, see RJT_EIC_DETECTION_HIGH.
+ */
+void RJTEIC_enableEvent(enum RJT_EIC_EXT_INT ext_intno)
+{
+	system_interrupt_enter_critical_section();
+
+	DISABLE_EIC();
+	EIC->EVCTRL.reg |= (1UL << ext_intno);
+	ENABLE_EIC();
+
+	system_interrupt_leave_critical_section();
+}
+
+
+void RJTEIC_disableEvent(enum RJT_EIC_EXT_INT ext_intno)
+{
+	system_interrupt_enter_critical_section();
+
+	DISABLE_EIC();
+	EIC->EVCTRL.reg &= ~(1UL << ext_intno);
+	ENABLE_EIC();
+
+	system_interrupt_leave_critical_section();
+}
+
+
+
+static void init_probe_timer(void)
+{
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_TCC1);
+
+	struct system_gclk_chan_config config;
+	system_gclk_chan_get_config_defaults(&config);
+	config.source_generator = GCLK_GENERATOR_1;
+
+	system_gclk_chan_set_config(TCC1_GCLK_ID, &config);
+	system_gclk_chan_enable(TCC1_GCLK_ID);
+
+	PROBE_TCC->CTRLA.reg = TCC_CTRLA_SWRST;
+	while(PROBE_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_SWRST);
+
+	// Free running, CC0 captures on every event from the probe line
+	PROBE_TCC->CTRLA.reg = TCC_CTRLA_PRESCALER_DIV1 | TCC_CTRLA_CPTEN0;
+	PROBE_TCC->EVCTRL.reg = TCC_EVCTRL_MCEI0;
+
+	PROBE_TCC->PER.reg = PROBE_TICKS_MASK;
+	while(PROBE_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_PER);
+
+	PROBE_TCC->CTRLA.reg |= TCC_CTRLA_ENABLE;
+	while(PROBE_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_ENABLE);
+}
+
+
+/**
+ * Routes the edges of one line through the event system into TCC1
+ * so its dispatch latency can be measured. RJT_EIC_PROBE_NONE turns
+ * the probe off.
+ */
+void RJTEIC_setLatencyProbe(RJTEIC_t * self, uint8_t ext_intno)
+{
+	ASSERT(NULL != self);
+	ASSERT(RJT_EIC_PROBE_NONE == ext_intno || ext_intno < EIC_NUMBER_OF_INTERRUPTS);
+
+	system_interrupt_enter_critical_section();
+
+	if(mProbeEventAllocated) {
+		events_detach_user(&mProbeEvent, EVSYS_ID_USER_TCC1_MC_0);
+		events_release(&mProbeEvent);
+		mProbeEventAllocated = false;
+	}
+
+	if(RJT_EIC_PROBE_NONE != self->probe_intno) {
+		RJTEIC_disableEvent(self->probe_intno);
+	}
+
+	if(RJT_EIC_PROBE_NONE != ext_intno)
+	{
+		RJTEIC_enableEvent(ext_intno);
+
+		struct events_config config;
+		events_get_config_defaults(&config);
+
+		config.generator = EVSYS_ID_GEN_EIC_EXTINT_0 + ext_intno;
+		config.path      = EVENTS_PATH_ASYNCHRONOUS;
+
+		enum status_code ret = events_allocate(&mProbeEvent, &config);
+		ASSERT(STATUS_OK == ret);
+
+		events_attach_user(&mProbeEvent, EVSYS_ID_USER_TCC1_MC_0);
+		mProbeEventAllocated = true;
+	}
+
+	// a capture from the previous line is meaningless now
+	PROBE_TCC->INTFLAG.reg = TCC_INTFLAG_MC0;
+
+	self->probe_intno = ext_intno;
+
+	system_interrupt_leave_critical_section();
+}
+
+
+void RJTEIC_getStats(RJTEIC_t * self, RJTEICStats_t * stats, bool reset)
+{
+	ASSERT(NULL != self);
+	ASSERT(NULL != stats);
+
+	system_interrupt_enter_critical_section();
+
+	*stats = self->stats;
+
+	if(reset) {
+		memset(&self->stats, 0, sizeof(self->stats));
+	}
+
+	system_interrupt_leave_critical_section();
+}
+
 
 void RJTEIC_init(RJTEIC_t * self)
 {
@@ -158,7 +369,12 @@ void RJTEIC_init(RJTEIC_t * self)
 
 	while(GCLK->STATUS.bit.SYNCBUSY);
 
+	init_probe_timer();
+
+	self->probe_intno = RJT_EIC_PROBE_NONE;
+	memset(&self->stats, 0, sizeof(self->stats));
+
 	self->module_init = true;
 
 	mSelf = self;
-}
\ No newline at end of file
+}
@@ -11,14 +11,36 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <asf.h>
 
 typedef void (*RJTEICCallback_t)(void * self, uint8_t pinno, uint8_t intno);
 
+#define RJT_EIC_PROBE_NONE		0xff
+
+/**
+ * Dispatch statistics. Latency is measured on the probe line only:
+ * its edge is captured by TCC1 through the event system, and compared
+ * against TCC1 right before the line's callback is called.
+ */
+struct RJTEICStats {
+	uint32_t interrupts;		// EIC_Handler entries
+	uint32_t events;			// callbacks dispatched
+	uint32_t latency_count;
+	uint32_t latency_min_ns;
+	uint32_t latency_max_ns;
+	uint64_t latency_sum_ns;
+};
+
+typedef struct RJTEICStats RJTEICStats_t;
+
 struct RJTEIC {
 	bool module_init;
 	RJTEICCallback_t callbacks[EIC_NUMBER_OF_INTERRUPTS];
 	uint8_t intno2gpio[EIC_NUMBER_OF_INTERRUPTS];
+
+	uint8_t probe_intno;
+	RJTEICStats_t stats;
 };
 
 typedef struct RJTEIC RJTEIC_t;
@@ -69,9 +91,23 @@ typedef struct RJTEICConfig RJTEICConfig_t;
 
 void RJTEIC_configure(RJTEIC_t * self, RJTEICConfig_t * config);
 
+void RJTEIC_configureMany(RJTEIC_t * self, const RJTEICConfig_t * configs, size_t num_configs);
+
+void RJTEIC_setLatencyProbe(RJTEIC_t * self, uint8_t ext_intno);
+
+void RJTEIC_getStats(RJTEIC_t * self, RJTEICStats_t * stats, bool reset);
+
 void RJTEIC_enableInterrupt(enum RJT_EIC_EXT_INT ext_intno);
 
 void RJTEIC_disableInterrupt(enum RJT_EIC_EXT_INT ext_intno);
 
+bool RJTEIC_isInterruptEnabled(enum RJT_EIC_EXT_INT ext_intno);
+
+bool RJTEIC_isLineTaken(RJTEIC_t * self, enum RJT_EIC_EXT_INT ext_intno, RJTEICCallback_t callback);
+
+void RJTEIC_enableEvent(enum RJT_EIC_EXT_INT ext_intno);
+
+void RJTEIC_disableEvent(enum RJT_EIC_EXT_INT ext_intno);
+
 
 #endif /* RJT_EXTERNAL_INTERRUPT_CONTROLLER_H_ */
\ No newline at end of file
@@ -0,0 +1,299 @@
+/*
+ * rjt_timer.c
+ */
+
+#include "rjt_timer.h"
+#include "rjt_logger.h"
+#include "utils.h"
+
+#include <asf.h>
+
+
+static const struct {
+	        Tc * hw;
+	     uint8_t gclk_id;
+	    uint32_t apbc_mask;
+	   IRQn_Type irqn;
+} mTimers[RJT_TIMER_MAX] = {
+	[RJT_TIMER_TC3] = {TC3, TC3_GCLK_ID, PM_APBCMASK_TC3, TC3_IRQn},
+	[RJT_TIMER_TC4] = {TC4, TC4_GCLK_ID, PM_APBCMASK_TC4, TC4_IRQn},
+	[RJT_TIMER_TC5] = {TC5, TC5_GCLK_ID, PM_APBCMASK_TC5, TC5_IRQn},
+	[RJT_TIMER_TC6] = {TC6, TC6_GCLK_ID, PM_APBCMASK_TC6, TC6_IRQn},
+	[RJT_TIMER_TC7] = {TC7, TC7_GCLK_ID, PM_APBCMASK_TC7, TC7_IRQn},
+};
+
+static bool mClaimed[RJT_TIMER_MAX];
+
+static struct {
+	volatile bool armed;
+	RJTTimerAlarmCallback_t callback;
+} mAlarm;
+
+
+static const uint16_t mPrescaler2Div[] = {
+	[TC_CTRLA_PRESCALER_DIV1_Val]    = 1,
+	[TC_CTRLA_PRESCALER_DIV2_Val]    = 2,
+	[TC_CTRLA_PRESCALER_DIV4_Val]    = 4,
+	[TC_CTRLA_PRESCALER_DIV8_Val]    = 8,
+	[TC_CTRLA_PRESCALER_DIV16_Val]   = 16,
+	[TC_CTRLA_PRESCALER_DIV64_Val]   = 64,
+	[TC_CTRLA_PRESCALER_DIV256_Val]  = 256,
+	[TC_CTRLA_PRESCALER_DIV1024_Val] = 1024,
+};
+
+
+Tc * RJTTimer_getHw(enum RJT_TIMER timer)
+{
+	ASSERT(timer < RJT_TIMER_MAX);
+	return mTimers[timer].hw;
+}
+
+
+IRQn_Type RJTTimer_getIRQn(enum RJT_TIMER timer)
+{
+	ASSERT(timer < RJT_TIMER_MAX);
+	return mTimers[timer].irqn;
+}
+
+
+/**
+ * Turns on the bus and generic clocks of the timer and resets it.
+ * The timer is left disabled, ready for configuration.
+ */
+static void enable_clocks(enum RJT_TIMER timer, enum gclk_generator generator)
+{
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBC, mTimers[timer].apbc_mask);
+
+	struct system_gclk_chan_config config;
+	system_gclk_chan_get_config_defaults(&config);
+	config.source_generator = generator;
+
+	system_gclk_chan_set_config(mTimers[timer].gclk_id, &config);
+	system_gclk_chan_enable(mTimers[timer].gclk_id);
+}
+
+
+void RJTTimer_enable(enum RJT_TIMER timer)
+{
+	ASSERT(timer < RJT_TIMER_MAX);
+
+	enable_clocks(timer, RJT_TIMER_GCLK_GENERATOR);
+
+	RJTTimer_disable(timer);
+}
+
+
+void RJTTimer_disable(enum RJT_TIMER timer)
+{
+	ASSERT(timer < RJT_TIMER_MAX);
+
+	Tc * hw = mTimers[timer].hw;
+
+	NVIC_DisableIRQ(mTimers[timer].irqn);
+
+	hw->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	hw->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+	while(hw->COUNT16.CTRLA.reg & TC_CTRLA_SWRST);
+}
+
+
+/**
+ * Marks a timer as in use. Returns false if another feature
+ * already owns it.
+ */
+bool RJTTimer_claim(enum RJT_TIMER timer)
+{
+	ASSERT(timer < RJT_TIMER_MAX);
+
+	bool success = false;
+
+	system_interrupt_enter_critical_section();
+
+	if(false == mClaimed[timer]) {
+		mClaimed[timer] = true;
+		success = true;
+	}
+
+	system_interrupt_leave_critical_section();
+
+	return success;
+}
+
+
+void RJTTimer_release(enum RJT_TIMER timer)
+{
+	ASSERT(timer < RJT_TIMER_MAX);
+
+	mClaimed[timer] = false;
+}
+
+
+/**
+ * Runs the timer in match frequency mode: the counter wraps at CC0,
+ * raising OVF (and its DMA request / event) once per period.
+ */
+void RJTTimer_startPeriodic(enum RJT_TIMER timer, const RJTTimerPeriod_t * period)
+{
+	ASSERT(NULL != period);
+
+	Tc * hw = RJTTimer_getHw(timer);
+
+	RJTTimer_enable(timer);
+
+	hw->COUNT16.CTRLA.reg =
+		TC_CTRLA_MODE_COUNT16 |
+		TC_CTRLA_WAVEGEN_MFRQ |
+		TC_CTRLA_PRESCALER(period->prescaler) |
+		TC_CTRLA_PRESCSYNC_RESYNC;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	hw->COUNT16.CC[0].reg = period->top;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	hw->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+}
+
+
+/**
+ * Picks the smallest prescaler that lets a 16 bit counter overflow
+ * at rate_hz. Returns false if the rate cannot be generated.
+ */
+bool RJTTimer_rate2period(uint32_t rate_hz, RJTTimerPeriod_t * period)
+{
+	ASSERT(NULL != period);
+
+	if(0 == rate_hz || rate_hz > RJT_TIMER_CLOCK_HZ / 2) {
+		return false;
+	}
+
+	uint32_t ticks = (RJT_TIMER_CLOCK_HZ + rate_hz / 2) / rate_hz;
+
+	for(uint8_t k = 0; k < ARRAY_SIZE(mPrescaler2Div); k++)
+	{
+		uint32_t div = mPrescaler2Div[k];
+		uint32_t counts = (ticks + div / 2) / div;
+
+		if(counts <= 0x10000)
+		{
+			if(counts < 2) {
+				counts = 2;
+			}
+			period->prescaler = k;
+			period->top = counts - 1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+uint16_t RJTTimer_prescaler2div(uint8_t prescaler)
+{
+	ASSERT(prescaler < ARRAY_SIZE(mPrescaler2Div));
+
+	return mPrescaler2Div[prescaler];
+}
+
+
+uint32_t RJTTimer_period2rate(const RJTTimerPeriod_t * period)
+{
+	ASSERT(NULL != period);
+	ASSERT(period->prescaler < ARRAY_SIZE(mPrescaler2Div));
+
+	uint32_t ticks = mPrescaler2Div[period->prescaler] * ((uint32_t) period->top + 1);
+
+	return RJT_TIMER_CLOCK_HZ / ticks;
+}
+
+
+/**
+ * Starts TC4 and TC5 as one 32 bit counter at 1 MHz. They share a
+ * generic clock channel, so TC5 only needs its bus clock. Both stay
+ * claimed for good.
+ */
+void RJTTimer_initTimestamp(void)
+{
+	bool success = RJTTimer_claim(RJT_TIMER_TC4) && RJTTimer_claim(RJT_TIMER_TC5);
+	ASSERT(true == success);
+
+	Tc * hw = RJTTimer_getHw(RJT_TIMER_TIMESTAMP_TIMER);
+
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBC, mTimers[RJT_TIMER_TC5].apbc_mask);
+	enable_clocks(RJT_TIMER_TIMESTAMP_TIMER, RJT_TIMER_TIMESTAMP_GCLK_GENERATOR);
+
+	RJTTimer_disable(RJT_TIMER_TIMESTAMP_TIMER);
+
+	hw->COUNT32.CTRLA.reg =
+		TC_CTRLA_MODE_COUNT32 |
+		TC_CTRLA_WAVEGEN_NFRQ |
+		TC_CTRLA_PRESCALER_DIV1;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	// Keep COUNT synchronized so reads do not need a read request each
+	hw->COUNT32.READREQ.reg =
+		TC_READREQ_RCONT |
+		TC_READREQ_ADDR(TC_COUNT32_COUNT_OFFSET);
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	hw->COUNT32.CTRLA.reg |= TC_CTRLA_ENABLE;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	// CC0 is free for RJTTimer_setAlarm()
+	NVIC_SetPriority(RJTTimer_getIRQn(RJT_TIMER_TIMESTAMP_TIMER), APP_LOW_PRIORITY);
+	NVIC_EnableIRQ(RJTTimer_getIRQn(RJT_TIMER_TIMESTAMP_TIMER));
+}
+
+
+/**
+ * Calls back from the timestamp timer interrupt (APP_LOW_PRIORITY, the
+ * same level as the EIC) once the timestamp reaches the given value.
+ * There is one alarm, setting it again replaces it. A time that has
+ * already passed calls back right away.
+ */
+void RJTTimer_setAlarm(uint32_t timestamp, RJTTimerAlarmCallback_t callback)
+{
+	ASSERT(NULL != callback);
+
+	Tc * hw = RJT_TIMER_TIMESTAMP_HW;
+
+	hw->COUNT32.INTENCLR.reg = TC_INTENCLR_MC0;
+
+	mAlarm.callback = callback;
+	mAlarm.armed = true;
+
+	hw->COUNT32.CC[0].reg = timestamp;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	hw->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0;
+	hw->COUNT32.INTENSET.reg = TC_INTENSET_MC0;
+
+	// the match may have gone by before the flag was cleared
+	if((int32_t) (timestamp - RJTTimer_getTimestamp()) <= 0) {
+		NVIC_SetPendingIRQ(RJTTimer_getIRQn(RJT_TIMER_TIMESTAMP_TIMER));
+	}
+}
+
+
+void RJTTimer_cancelAlarm(void)
+{
+	RJT_TIMER_TIMESTAMP_HW->COUNT32.INTENCLR.reg = TC_INTENCLR_MC0;
+	mAlarm.armed = false;
+}
+
+
+void TC4_Handler(void)
+{
+	Tc * hw = RJT_TIMER_TIMESTAMP_HW;
+
+	hw->COUNT32.INTENCLR.reg = TC_INTENCLR_MC0;
+	hw->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0;
+
+	if(mAlarm.armed) {
+		mAlarm.armed = false;
+		mAlarm.callback();
+	}
+}
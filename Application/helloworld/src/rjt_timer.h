@@ -0,0 +1,103 @@
+/*
+ * rjt_timer.h
+ */
+
+
+#ifndef RJT_TIMER_H_
+#define RJT_TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <asf.h>
+
+/**
+ * Timer allocation:
+ *
+ * TC3     - pattern generator / logic analyzer sample clock
+ * TC4+TC5 - 32 bit free running 1 MHz timestamp, CC0 alarm
+ * TC6     - frequency counter period / pulse width capture
+ * TC7     - bit-bang engine step timing
+ * TCC0    - PWM outputs (SK_USB_CONFIG_PWM) / WS2812 bit timing
+ * TCC1    - EIC latency probe (rjt_external_interrupt_controller.c)
+ * TCC2    - frequency counter edge count
+ *
+ * A timer shared by several features is claimed by whichever one is
+ * running, see RJTTimer_claim().
+ */
+
+// Timers are clocked from GCLK1 (DFLL, locked to USB SOF)
+#define RJT_TIMER_GCLK_GENERATOR		GCLK_GENERATOR_1
+#define RJT_TIMER_CLOCK_HZ				48000000UL
+
+// The timestamp counts GCLK4 (DFLL / 48) directly
+#define RJT_TIMER_TIMESTAMP_GCLK_GENERATOR	GCLK_GENERATOR_4
+#define RJT_TIMER_TIMESTAMP_TIMER		RJT_TIMER_TC4
+#define RJT_TIMER_TIMESTAMP_HW			TC4
+
+#define RJT_TIMER_WAIT_FOR_SYNC(hw) \
+do { \
+	while((hw)->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY); \
+} while(0)
+
+
+enum RJT_TIMER
+{
+	RJT_TIMER_TC3 = 0,
+	RJT_TIMER_TC4,
+	RJT_TIMER_TC5,
+	RJT_TIMER_TC6,
+	RJT_TIMER_TC7,
+	RJT_TIMER_MAX,
+};
+
+
+struct RJTTimerPeriod
+{
+	uint8_t  prescaler;	// TC_CTRLA_PRESCALER_DIVx_Val
+	uint16_t top;		// counter counts 0..top
+};
+
+typedef struct RJTTimerPeriod RJTTimerPeriod_t;
+
+typedef void (*RJTTimerAlarmCallback_t)(void);
+
+
+Tc * RJTTimer_getHw(enum RJT_TIMER timer);
+
+IRQn_Type RJTTimer_getIRQn(enum RJT_TIMER timer);
+
+void RJTTimer_enable(enum RJT_TIMER timer);
+
+void RJTTimer_disable(enum RJT_TIMER timer);
+
+bool RJTTimer_claim(enum RJT_TIMER timer);
+
+void RJTTimer_release(enum RJT_TIMER timer);
+
+void RJTTimer_startPeriodic(enum RJT_TIMER timer, const RJTTimerPeriod_t * period);
+
+bool RJTTimer_rate2period(uint32_t rate_hz, RJTTimerPeriod_t * period);
+
+uint32_t RJTTimer_period2rate(const RJTTimerPeriod_t * period);
+
+uint16_t RJTTimer_prescaler2div(uint8_t prescaler);
+
+void RJTTimer_initTimestamp(void);
+
+void RJTTimer_setAlarm(uint32_t timestamp, RJTTimerAlarmCallback_t callback);
+
+void RJTTimer_cancelAlarm(void);
+
+
+/**
+ * Microseconds since boot, wraps every ~71 minutes. The counter is
+ * continuously synchronized (READREQ.RCONT), so this is a plain
+ * register read and safe to call from any context.
+ */
+static inline uint32_t RJTTimer_getTimestamp(void)
+{
+	return RJT_TIMER_TIMESTAMP_HW->COUNT32.COUNT.reg;
+}
+
+
+#endif /* RJT_TIMER_H_ */
@@ -0,0 +1,82 @@
+/*
+ * rjt_timer_wheel.c
+ */
+
+#include "rjt_timer_wheel.h"
+#include "utils.h"
+
+#include <string.h>
+
+#define SLOT_MASK		(RJT_TIMER_WHEEL_SLOTS - 1)
+
+
+void RJTTimerWheel_init(RJTTimerWheel_t * self, RJTTimerWheelCallback_t callback, void * context)
+{
+	ASSERT(NULL != self);
+	ASSERT(0 == (RJT_TIMER_WHEEL_SLOTS & SLOT_MASK));
+
+	memset(self, 0, sizeof(*self));
+
+	self->callback = callback;
+	self->context = context;
+}
+
+
+/**
+ * (Re)starts a timer to expire on the given tick from now, 1 being
+ * the next one.
+ */
+void RJTTimerWheel_start(RJTTimerWheel_t * self, uint8_t timer, uint32_t ticks)
+{
+	ASSERT(timer < RJT_TIMER_WHEEL_MAX_TIMERS);
+	ASSERT(ticks > 0);
+
+	RJTTimerWheel_stop(self, timer);
+
+	uint8_t slot = (self->current + ticks) & SLOT_MASK;
+
+	self->slots[slot] |= (1UL << timer);
+	self->slot_of[timer] = slot;
+	self->turns[timer] = (uint16_t) ((ticks - 1) / RJT_TIMER_WHEEL_SLOTS);
+	self->armed |= (1UL << timer);
+}
+
+
+void RJTTimerWheel_stop(RJTTimerWheel_t * self, uint8_t timer)
+{
+	ASSERT(timer < RJT_TIMER_WHEEL_MAX_TIMERS);
+
+	if(RJTTimerWheel_isArmed(self, timer)) {
+		self->slots[self->slot_of[timer]] &= ~(1UL << timer);
+		self->armed &= ~(1UL << timer);
+	}
+}
+
+
+void RJTTimerWheel_tick(RJTTimerWheel_t * self)
+{
+	self->current = (self->current + 1) & SLOT_MASK;
+
+	uint32_t due = self->slots[self->current];
+
+	for(uint32_t mask = due; 0 != mask; mask &= mask - 1)
+	{
+		uint8_t timer = lowest_bit(mask);
+
+		if(0 == (self->slots[self->current] & (1UL << timer))) {
+			// stopped or moved by an earlier callback of this tick
+			continue;
+		}
+
+		if(self->turns[timer] > 0) {
+			self->turns[timer]--;
+			continue;
+		}
+
+		self->slots[self->current] &= ~(1UL << timer);
+		self->armed &= ~(1UL << timer);
+
+		// may restart this timer, or any other
+		self->callback(self->context, timer);
+	}
+}
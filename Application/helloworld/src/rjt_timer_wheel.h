@@ -0,0 +1,66 @@
+/*
+ * rjt_timer_wheel.h
+ */
+
+
+#ifndef RJT_TIMER_WHEEL_H_
+#define RJT_TIMER_WHEEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Hashed timer wheel for up to 32 timers, identified by number.
+ *
+ * Each slot is a bit mask of the timers that land on it, so starting,
+ * restarting and stopping a timer are O(1) and a tick only looks at
+ * one slot. Timers further out than one turn of the wheel count down
+ * the turns they still have to wait.
+ *
+ * The wheel has no notion of time, whoever owns it calls
+ * RJTTimerWheel_tick() once per tick. Not thread safe, all calls for
+ * one wheel have to come from the same interrupt level.
+ */
+
+#define RJT_TIMER_WHEEL_SLOTS			32		// power of two
+#define RJT_TIMER_WHEEL_MAX_TIMERS		32
+
+typedef void (*RJTTimerWheelCallback_t)(void * context, uint8_t timer);
+
+struct RJTTimerWheel
+{
+	uint32_t slots[RJT_TIMER_WHEEL_SLOTS];
+	uint32_t armed;
+	uint16_t turns[RJT_TIMER_WHEEL_MAX_TIMERS];
+	uint8_t  slot_of[RJT_TIMER_WHEEL_MAX_TIMERS];
+	uint8_t  current;
+
+	RJTTimerWheelCallback_t callback;
+	void * context;
+};
+
+typedef struct RJTTimerWheel RJTTimerWheel_t;
+
+
+void RJTTimerWheel_init(RJTTimerWheel_t * self, RJTTimerWheelCallback_t callback, void * context);
+
+void RJTTimerWheel_start(RJTTimerWheel_t * self, uint8_t timer, uint32_t ticks);
+
+void RJTTimerWheel_stop(RJTTimerWheel_t * self, uint8_t timer);
+
+void RJTTimerWheel_tick(RJTTimerWheel_t * self);
+
+
+static inline bool RJTTimerWheel_isEmpty(const RJTTimerWheel_t * self)
+{
+	return 0 == self->armed;
+}
+
+
+static inline bool RJTTimerWheel_isArmed(const RJTTimerWheel_t * self, uint8_t timer)
+{
+	return 0 != (self->armed & (1UL << timer));
+}
+
+
+#endif /* RJT_TIMER_WHEEL_H_ */
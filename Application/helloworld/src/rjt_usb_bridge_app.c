@@ -6,6 +6,7 @@
  */ 
 
 #include "rjt_usb_bridge_app.h"
+#include "rjt_timer.h"
 #include "rjt_logger.h"
 #include "utils.h"
 
@@ -16,6 +17,9 @@
 
 static bool mSeqNo = false;
 
+// a host reset that found a triggered transaction on the bus
+static volatile bool mResetPending = false;
+
 static uint32_t interrupt_status = 0;
 
 
@@ -63,6 +67,20 @@ static bool in_array(uint8_t value, const uint8_t * arr, size_t len)
 #endif
 
 
+/**
+ * Drops the bus configuration of a host reset once the triggered
+ * transaction that held it up is done. Called with the USB interrupt
+ * unable to preempt it.
+ */
+static void finish_reset(void)
+{
+	if(mResetPending && false == RJTUSBBridgeTrigger_isBusy()) {
+		mResetPending = false;
+		RJTUSBBridgeConfig_reset();
+	}
+}
+
+
 static enum RJT_USB_ERROR process_cmd_echo(const uint8_t * cmd_data, size_t cmd_len, 
 		uint8_t * rsp_data, size_t * rsp_len)
 {
@@ -105,6 +123,9 @@ void RJTUSBBridge_processCmd(const uint8_t * cmd_data, size_t cmd_len,
 	// the command is good!
 	*send_cached_rsp = false;
 
+	// commands after a reset see the bus unconfigured
+	finish_reset();
+
 	// update sequence number
 	mSeqNo = cmd_header->seq_no;
 
@@ -119,7 +140,7 @@ void RJTUSBBridge_processCmd(const uint8_t * cmd_data, size_t cmd_len,
 					rsp_header->data, rsp_len);																				\
 			break										
 
-	//RJTLogger_print("USB Bridge: Processing %x", cmd_header->cmd);
+	RJTLogger_trace("USB Bridge: Processing %x", cmd_header->cmd);
 
 	switch(cmd_header->cmd)
 	{
@@ -150,6 +171,82 @@ void RJTUSBBridge_processCmd(const uint8_t * cmd_data, size_t cmd_len,
 		CASE2FUNC(USB_CMD_I2CM_TRANSACTION, SKUSBBridgeI2CM_transaction);
 		
 		CASE2FUNC(USB_CMD_GPIO_SET_LED, RJTUSBBridgeGPIO_setLed);
+
+		CASE2FUNC(USB_CMD_GPIO_PARALLEL_TOGGLE, RJTUSBBridgeGPIO_parallelToggle);
+
+		CASE2FUNC(USB_CMD_GPIO_PARALLEL_READ, RJTUSBBridgeGPIO_parallelRead);
+
+		CASE2FUNC(USB_CMD_PATTERN_CONFIGURE, RJTUSBBridgePattern_configure);
+
+		CASE2FUNC(USB_CMD_PATTERN_WRITE, RJTUSBBridgePattern_write);
+
+		CASE2FUNC(USB_CMD_PATTERN_CONTROL, RJTUSBBridgePattern_control);
+
+		CASE2FUNC(USB_CMD_PATTERN_GET_STATUS, RJTUSBBridgePattern_getStatus);
+
+		CASE2FUNC(USB_CMD_LOGIC_CONFIGURE, RJTUSBBridgeLogic_configure);
+
+		CASE2FUNC(USB_CMD_LOGIC_CONTROL, RJTUSBBridgeLogic_control);
+
+		CASE2FUNC(USB_CMD_LOGIC_GET_STATUS, RJTUSBBridgeLogic_getStatus);
+
+		CASE2FUNC(USB_CMD_LOGIC_READ, RJTUSBBridgeLogic_read);
+
+		CASE2FUNC(USB_CMD_GPIO_READ_EVENTS, RJTUSBBridgeGPIO_readEvents);
+
+		CASE2FUNC(USB_CMD_GET_TIMESTAMP, RJTUSBBridgeGPIO_getTimestamp);
+
+		CASE2FUNC(USB_CMD_GPIO_ENABLE_PIN_INTERRUPTS, RJTUSBBridgeGPIO_enablePinInterrupts);
+
+		CASE2FUNC(USB_CMD_GPIO_SET_LATENCY_PROBE, RJTUSBBridgeGPIO_setLatencyProbe);
+
+		CASE2FUNC(USB_CMD_GPIO_GET_EIC_STATS, RJTUSBBridgeGPIO_getEICStats);
+
+		CASE2FUNC(USB_CMD_GPIO_SET_DEBOUNCE, RJTUSBBridgeGPIO_setDebounce);
+
+		CASE2FUNC(USB_CMD_GPIO_WAIT, RJTUSBBridgeWait_start);
+
+		CASE2FUNC(USB_CMD_GPIO_WAIT_STATUS, RJTUSBBridgeWait_getStatus);
+
+		CASE2FUNC(USB_CMD_TRIGGER_CONFIGURE, RJTUSBBridgeTrigger_configure);
+
+		CASE2FUNC(USB_CMD_TRIGGER_READ, RJTUSBBridgeTrigger_read);
+
+		CASE2FUNC(USB_CMD_UART_GET_LINE_INFO, RJTUSBBridgeUart_getLineInfo);
+
+		CASE2FUNC(USB_CMD_UART_SET_FLOW_CONTROL, RJTUSBBridgeUart_setFlowControl);
+
+		CASE2FUNC(USB_CMD_UART_SET_CONTROL_LINES, RJTUSBBridgeUart_setControlLines);
+
+		CASE2FUNC(USB_CMD_UART_GET_STATS, RJTUSBBridgeUart_getStats);
+
+		CASE2FUNC(USB_CMD_UART_SET_RX_AGGREGATION, RJTUSBBridgeUart_setRxAggregation);
+
+		CASE2FUNC(USB_CMD_UART_SET_STREAM, RJTUSBBridgeUart_setStream);
+
+		CASE2FUNC(USB_CMD_UART_SET_FRAMING, RJTUSBBridgeUart_setFraming);
+
+		CASE2FUNC(USB_CMD_FREQ_CONFIGURE, RJTUSBBridgeFreq_configure);
+
+		CASE2FUNC(USB_CMD_FREQ_READ, RJTUSBBridgeFreq_read);
+
+		CASE2FUNC(USB_CMD_PWM_SET_FREQUENCY, RJTUSBBridgePWM_setFrequency);
+
+		CASE2FUNC(USB_CMD_PWM_SET_DUTY, RJTUSBBridgePWM_setDuty);
+
+		CASE2FUNC(USB_CMD_BITBANG_SERIAL_CONFIGURE, RJTUSBBridgeBitbang_serialConfigure);
+
+		CASE2FUNC(USB_CMD_BITBANG_SERIAL_WRITE, RJTUSBBridgeBitbang_serialWrite);
+
+		CASE2FUNC(USB_CMD_ONEWIRE_TRANSFER, RJTUSBBridgeBitbang_onewireTransfer);
+
+		CASE2FUNC(USB_CMD_ONEWIRE_SEARCH, RJTUSBBridgeBitbang_onewireSearch);
+
+		CASE2FUNC(USB_CMD_WS2812_WRITE, RJTUSBBridgeBitbang_ws2812Write);
+
+		CASE2FUNC(USB_CMD_WS2812_SHOW, RJTUSBBridgeBitbang_ws2812Show);
+
+		CASE2FUNC(USB_CMD_BITBANG_READ, RJTUSBBridgeBitbang_read);
 		
 		default:
 			ret_code = RJT_USB_ERROR_UNKNOWN_CMD;
@@ -190,7 +287,20 @@ bool RJTUSBBridge_processControlRequestWrite(
 			*dst_buf = NULL;
 			*dst_buflen = 0;
 
-			RJTUSBBridgeConfig_reset();			
+			RJTUSBBridgePattern_stop();
+			RJTUSBBridgeLogic_stop();
+			RJTUSBBridgeFreq_stop();
+			RJTUSBBridgeBitbang_stop();
+			RJTUSBBridgeGPIO_reset();
+			RJTUSBBridgeWait_stop();
+
+			// masks the trigger line, a run already started still has to end
+			RJTUSBBridgeTrigger_stop();
+
+			// USB preempts the EIC, so a transaction halfway through cannot
+			// be waited for here; the bus goes once it is done
+			mResetPending = true;
+			finish_reset();
 		} break;
 
 		default:
@@ -246,6 +356,24 @@ bool RJTUSBBridge_processControlRequestRead(
 
 void RJTUSBBridge_init(void)
 {
+	RJTTimer_initTimestamp();
 	RJTUSBBridgeConfig_init();
 	RJTUSBBridgeGPIO_init();
+	RJTUSBBridgePattern_init();
+	RJTUSBBridgeLogic_init();
+	RJTUSBBridgeBitbang_init();
+}
+
+
+/**
+ * Called from the main loop, for work that must not hold up the USB
+ * interrupt.
+ */
+void RJTUSBBridge_process(void)
+{
+	system_interrupt_enter_critical_section();
+	finish_reset();
+	system_interrupt_leave_critical_section();
+
+	RJTUSBBridgeWait_process();
 }
@@ -24,6 +24,11 @@
 enum RJT_USB_INTERRUPT_BIT {
 	RJT_USB_INTERRUPT_BIT_GPIO = 0x00,
 	RJT_USB_INTERRUPT_BIT_SPI  = 0x01,
+	RJT_USB_INTERRUPT_BIT_PATTERN = 0x02,
+	RJT_USB_INTERRUPT_BIT_LOGIC   = 0x03,
+	RJT_USB_INTERRUPT_BIT_BITBANG = 0x04,
+	RJT_USB_INTERRUPT_BIT_WAIT    = 0x05,
+	RJT_USB_INTERRUPT_BIT_TRIGGER = 0x06,
 };
 
 void RJTUSBBridge_setInterruptBit(enum RJT_USB_INTERRUPT_BIT bit, bool notify);
@@ -46,6 +51,16 @@ void RJTUSBBridgeConfig_index2gpio(uint8_t index, bool * success, uint8_t * gpio
 
 void RJTUSBBridgeConfig_index2extint(uint8_t index, bool * success, uint8_t * extint);
 
+uint8_t RJTUSBBridgeConfig_extint2index(uint8_t extint);
+
+uint32_t RJTUSBBridgeConfig_getAvailableIndexMask(void);
+
+uint32_t RJTUSBBridgeConfig_indexMask2PortMask(uint32_t index_mask);
+
+uint32_t RJTUSBBridgeConfig_portMask2IndexMask(uint32_t port_mask);
+
+void RJTUSBBridgeConfig_enableInputs(uint32_t index_mask);
+
 void RJTUSBBridgeConfig_reset(void);
 
 void RJTUSBBridgeConfig_init(void);
@@ -67,11 +82,32 @@ RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_clearInterruptStatus);
 
 RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_parallelWrite);
 
+RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_parallelToggle);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_parallelRead);
+
 RJT_USB_CMD_DECL(RJTUSBBridgeDFU_reset);
 
 RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_setLed);
 
+RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_readEvents);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_getTimestamp);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_enablePinInterrupts);
 
+RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_setLatencyProbe);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_getEICStats);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeGPIO_setDebounce);
+
+
+struct RJTEIC * RJTUSBBridgeGPIO_getEICModule(void);
+
+void RJTUSBBridgeGPIO_enableButton(bool enable);
+
+void RJTUSBBridgeGPIO_reset(void);
 
 void RJTUSBBridgeGPIO_init(void);
 
@@ -84,6 +120,102 @@ void RJTUSBBridgeSPIM_callback(struct spi_module * const module);
 RJT_USB_CMD_DECL(SKUSBBridgeI2CM_transaction);
 
 
+RJT_USB_CMD_DECL(RJTUSBBridgePattern_configure);
+
+RJT_USB_CMD_DECL(RJTUSBBridgePattern_write);
+
+RJT_USB_CMD_DECL(RJTUSBBridgePattern_control);
+
+RJT_USB_CMD_DECL(RJTUSBBridgePattern_getStatus);
+
+void RJTUSBBridgePattern_stop(void);
+
+void RJTUSBBridgePattern_init(void);
+
+
+RJT_USB_CMD_DECL(RJTUSBBridgeLogic_configure);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeLogic_control);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeLogic_getStatus);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeLogic_read);
+
+void RJTUSBBridgeLogic_stop(void);
+
+void RJTUSBBridgeLogic_init(void);
+
+
+RJT_USB_CMD_DECL(RJTUSBBridgeFreq_configure);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeFreq_read);
+
+void RJTUSBBridgeFreq_stop(void);
+
+
+RJT_USB_CMD_DECL(RJTUSBBridgePWM_setFrequency);
+
+RJT_USB_CMD_DECL(RJTUSBBridgePWM_setDuty);
+
+enum RJT_USB_ERROR RJTUSBBridgePWM_enable(uint32_t frequency_hz);
+
+void RJTUSBBridgePWM_disable(void);
+
+
+RJT_USB_CMD_DECL(RJTUSBBridgeBitbang_serialConfigure);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeBitbang_serialWrite);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeBitbang_onewireTransfer);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeBitbang_onewireSearch);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeBitbang_ws2812Write);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeBitbang_ws2812Show);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeBitbang_read);
+
+bool RJTUSBBridgeBitbang_isBusy(void);
+
+void RJTUSBBridgeBitbang_stop(void);
+
+void RJTUSBBridgeBitbang_init(void);
+
+
+RJT_USB_CMD_DECL(RJTUSBBridgeWait_start);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeWait_getStatus);
+
+void RJTUSBBridgeWait_process(void);
+
+void RJTUSBBridgeWait_stop(void);
+
+
+RJT_USB_CMD_DECL(RJTUSBBridgeTrigger_configure);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeTrigger_read);
+
+bool RJTUSBBridgeTrigger_isBusy(void);
+
+void RJTUSBBridgeTrigger_stop(void);
+
+
+RJT_USB_CMD_DECL(RJTUSBBridgeUart_getLineInfo);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeUart_setFlowControl);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeUart_setControlLines);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeUart_getStats);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeUart_setRxAggregation);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeUart_setStream);
+
+RJT_USB_CMD_DECL(RJTUSBBridgeUart_setFraming);
+
+
 #define RJT_USB_BRIDGE_BEGIN_CMD	\
 __PACKED_STRUCT Annonymous {
 
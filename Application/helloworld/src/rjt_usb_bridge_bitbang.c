@@ -0,0 +1,1109 @@
+/*
+ * rjt_usb_bridge_bitbang.c
+ */
+
+#include "rjt_usb_bridge_app.h"
+#include "rjt_timer.h"
+#include "rjt_logger.h"
+#include "utils.h"
+
+#include <port.h>
+#include <pinmux.h>
+#include <stdbool.h>
+#include <asf.h>
+
+/**
+ * Bit-bang engine:
+ *
+ * A job is a stream of steps, each one an action on a single gpio
+ * index followed by a hold time. TC7 runs free at 3 MHz and its CC0
+ * match interrupt applies the step that is due, then fetches the next
+ * one. Steps due sooner than BITBANG_MIN_SCHEDULE_US are spun on in
+ * the interrupt rather than scheduled, so short pulses do not pay the
+ * interrupt entry twice. The next step is always fetched before
+ * waiting, so an action lands on its deadline no matter how much work
+ * went into choosing it.
+ *
+ * Steps are grouped into symbols. A job supplies the next symbol once
+ * the current one has played, and can look at what the last one
+ * sampled. That is how the 1-Wire search picks its direction in the
+ * middle of a pass.
+ *
+ * Released pins are inputs with the internal pull up, which is weak
+ * for 1-Wire; an external 4.7k is recommended.
+ *
+ * WS2812 needs 1.25 us bits, ten CPU clocks at 8 MHz, which no
+ * interrupt keeps up with. It uses TCC0 in normal PWM at the bit rate
+ * on indices 10 to 13 instead, with the DMA writing the high time of
+ * every bit into the buffered CC register on each wrap.
+ */
+
+#define BITBANG_TIMER				RJT_TIMER_TC7
+#define BITBANG_TIMER_HW			TC7
+#define BITBANG_TICKS_PER_US		(RJT_TIMER_CLOCK_HZ / 16 / 1000000UL)
+#define US2TICKS(_us_)				((uint16_t) ((_us_) * BITBANG_TICKS_PER_US))
+
+// about the cost of leaving and re-entering the interrupt at 8 MHz
+#define BITBANG_MIN_SCHEDULE_US		20
+
+// a step that starts later than this restarts the clock from now
+#define BITBANG_LATE_US				2
+
+// deadlines are compared as signed 16 bit tick differences
+#define BITBANG_MAX_HOLD_US			10000
+
+#define BITBANG_MAX_BYTES			56
+#define BITBANG_MAX_SYMBOL_STEPS	4
+
+#define ONEWIRE_SEARCH_ROM			0xF0
+#define ONEWIRE_ALARM_SEARCH		0xEC
+#define ONEWIRE_ROM_BITS			64
+
+#define WS2812_TCC					TCC0
+#define WS2812_FIRST_INDEX			10
+#define WS2812_NUM_OUTPUTS			4
+#define WS2812_MAX_LEDS				64
+#define WS2812_MAX_BYTES			(WS2812_MAX_LEDS * 3)
+
+// at 48 MHz: 1.25 us bit, 396 ns / 792 ns high
+#define WS2812_PERIOD_TICKS			60
+#define WS2812_T0H_TICKS			19
+#define WS2812_T1H_TICKS			38
+
+// two low bits after the data, see ws2812_done_callback()
+#define WS2812_TAIL_SLOTS			2
+
+
+enum BITBANG_ACTION {
+	BITBANG_ACTION_LOW     = 0,
+	BITBANG_ACTION_HIGH    = 1,
+	BITBANG_ACTION_RELEASE = 2,
+	BITBANG_ACTION_SAMPLE  = 3,
+	BITBANG_ACTION_MAX,
+
+	// internal, ends the job once the last hold has passed
+	BITBANG_ACTION_END     = 0xff,
+};
+
+enum BITBANG_STATE {
+	BITBANG_STATE_IDLE    = 0,
+	BITBANG_STATE_RUNNING = 1,
+	BITBANG_STATE_DONE    = 2,
+};
+
+enum BITBANG_JOB {
+	BITBANG_JOB_NONE     = 0,
+	BITBANG_JOB_SERIAL   = 1,
+	BITBANG_JOB_ONEWIRE  = 2,
+	BITBANG_JOB_SEARCH   = 3,
+	BITBANG_JOB_WS2812   = 4,
+};
+
+// USB_CMD_ONEWIRE_TRANSFER flags
+#define ONEWIRE_TRANSFER_RESET		0x01
+
+// USB_CMD_ONEWIRE_SEARCH flags
+#define ONEWIRE_SEARCH_RESTART		0x01
+#define ONEWIRE_SEARCH_ALARM		0x02
+
+enum ONEWIRE_SEARCH_RESULT {
+	ONEWIRE_SEARCH_FOUND      = 0x01,
+	ONEWIRE_SEARCH_LAST       = 0x02,
+	ONEWIRE_SEARCH_CRC_ERROR  = 0x04,
+};
+
+enum SEARCH_PHASE {
+	SEARCH_PHASE_RESET = 0,
+	SEARCH_PHASE_CMD,
+	SEARCH_PHASE_ID,
+	SEARCH_PHASE_CMP,
+	SEARCH_PHASE_DIR,
+};
+
+
+struct BitbangStep
+{
+	uint8_t  action;
+	uint16_t hold_us;
+};
+
+typedef struct BitbangStep BitbangStep_t;
+
+
+static const BitbangStep_t mOneWireReset[] = {
+	{BITBANG_ACTION_LOW,     480},
+	{BITBANG_ACTION_RELEASE,  70},
+	{BITBANG_ACTION_SAMPLE,  410},	// presence pulse pulls this low
+};
+
+/**
+ * A write 1 slot is also the read slot, sampled well inside the 15 us
+ * the slave holds the line. Write 0 samples its own low pulse, so every
+ * slot yields the bit that was on the bus.
+ */
+static const BitbangStep_t mOneWireBit[2][3] = {
+	[0] = {
+		{BITBANG_ACTION_LOW,      6},
+		{BITBANG_ACTION_SAMPLE,  54},
+		{BITBANG_ACTION_RELEASE, 10},
+	},
+	[1] = {
+		{BITBANG_ACTION_LOW,      3},
+		{BITBANG_ACTION_RELEASE,  7},
+		{BITBANG_ACTION_SAMPLE,  60},
+	},
+};
+
+
+static struct {
+	volatile enum BITBANG_STATE state;
+	enum BITBANG_JOB job;
+
+	uint8_t gpio;
+	uint32_t pin_mask;
+
+	// step sequencing, owned by the interrupt while running
+	uint16_t deadline;
+	BitbangStep_t pending;
+	const BitbangStep_t * symbol;
+	uint8_t symbol_len;
+	uint8_t step_no;
+	bool sample;
+	bool (*next_symbol)(void);
+
+	// bits sent, and what was sampled while sending them
+	const BitbangStep_t * bit_symbols[2];
+	uint8_t bit_symbol_len[2];
+	bool lsb_first;
+	uint16_t bit_no;
+	uint16_t num_bits;
+	uint8_t tx[BITBANG_MAX_BYTES];
+	uint8_t rx[BITBANG_MAX_BYTES];
+
+	bool presence;
+} mBitbang;
+
+
+// symbols for the custom serial job, set by USB_CMD_BITBANG_SERIAL_CONFIGURE
+static struct {
+	bool configured;
+	uint8_t index;
+	bool lsb_first;
+	BitbangStep_t symbols[2][BITBANG_MAX_SYMBOL_STEPS];
+	uint8_t symbol_len[2];
+} mSerial;
+
+
+// 1-Wire search state, kept between passes
+static struct {
+	enum SEARCH_PHASE phase;
+	uint8_t rom[8];
+	uint8_t last_discrepancy;
+	uint8_t last_zero;
+	uint8_t id_bit_number;
+	bool id_bit;
+	bool last_device;
+	uint8_t result;
+} mSearch;
+
+
+static struct {
+	uint8_t slots[WS2812_MAX_BYTES * 8 + WS2812_TAIL_SLOTS];
+} mWs2812;
+
+static struct dma_resource mDMA;
+
+static COMPILER_ALIGNED(16)
+DmacDescriptor mDMADescriptor SECTION_DMAC_DESCRIPTOR;
+
+
+static inline uint16_t now(void)
+{
+	return BITBANG_TIMER_HW->COUNT16.COUNT.reg;
+}
+
+
+static void apply_action(uint8_t action)
+{
+	switch(action)
+	{
+		case BITBANG_ACTION_LOW:
+			PORTB.OUTCLR.reg = mBitbang.pin_mask;
+			PORTB.DIRSET.reg = mBitbang.pin_mask;
+			break;
+
+		case BITBANG_ACTION_HIGH:
+			PORTB.OUTSET.reg = mBitbang.pin_mask;
+			PORTB.DIRSET.reg = mBitbang.pin_mask;
+			break;
+
+		case BITBANG_ACTION_RELEASE:
+			// input, OUT selects the pull up
+			PORTB.DIRCLR.reg = mBitbang.pin_mask;
+			PORTB.OUTSET.reg = mBitbang.pin_mask;
+			break;
+
+		case BITBANG_ACTION_SAMPLE:
+			mBitbang.sample = (0 != (PORTB.IN.reg & mBitbang.pin_mask));
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+static bool next_step(BitbangStep_t * step)
+{
+	while(mBitbang.step_no >= mBitbang.symbol_len)
+	{
+		if(false == mBitbang.next_symbol()) {
+			return false;
+		}
+
+		mBitbang.step_no = 0;
+		mBitbang.sample = false;
+	}
+
+	*step = mBitbang.symbol[mBitbang.step_no++];
+
+	return true;
+}
+
+
+static void set_symbol(const BitbangStep_t * symbol, uint8_t len)
+{
+	mBitbang.symbol = symbol;
+	mBitbang.symbol_len = len;
+}
+
+
+static bool tx_bit(uint16_t bit_no)
+{
+	uint8_t shift = mBitbang.lsb_first ? (bit_no % 8) : (7 - bit_no % 8);
+
+	return (mBitbang.tx[bit_no / 8] >> shift) & 0x01;
+}
+
+
+static void store_rx_bit(uint16_t bit_no, bool bit)
+{
+	uint8_t shift = mBitbang.lsb_first ? (bit_no % 8) : (7 - bit_no % 8);
+
+	if(bit) {
+		mBitbang.rx[bit_no / 8] |= (1 << shift);
+	}
+}
+
+
+/**
+ * Plays mBitbang.tx one symbol per bit. The previous symbol is NULL
+ * before the first bit.
+ */
+static bool bits_next_symbol(void)
+{
+	if(NULL != mBitbang.symbol) {
+		store_rx_bit(mBitbang.bit_no, mBitbang.sample);
+		mBitbang.bit_no++;
+	}
+
+	if(mBitbang.bit_no >= mBitbang.num_bits) {
+		return false;
+	}
+
+	bool bit = tx_bit(mBitbang.bit_no);
+	set_symbol(mBitbang.bit_symbols[bit], mBitbang.bit_symbol_len[bit]);
+
+	return true;
+}
+
+
+static bool onewire_next_symbol(void)
+{
+	if(mOneWireReset == mBitbang.symbol)
+	{
+		mBitbang.presence = (false == mBitbang.sample);
+
+		if(false == mBitbang.presence) {
+			// nobody there, skip the bytes
+			return false;
+		}
+
+		mBitbang.symbol = NULL;
+	}
+
+	return bits_next_symbol();
+}
+
+
+static uint8_t onewire_crc8(const uint8_t * data, size_t len)
+{
+	uint8_t crc = 0;
+
+	for(size_t k = 0; k < len; k++)
+	{
+		uint8_t byte = data[k];
+
+		for(uint8_t bit = 0; bit < 8; bit++)
+		{
+			uint8_t mix = (crc ^ byte) & 0x01;
+			crc >>= 1;
+			if(mix) {
+				crc ^= 0x8C;
+			}
+			byte >>= 1;
+		}
+	}
+
+	return crc;
+}
+
+
+static void search_reset(void)
+{
+	mSearch.last_discrepancy = 0;
+	mSearch.last_device = false;
+	memset(mSearch.rom, 0, sizeof(mSearch.rom));
+}
+
+
+/**
+ * One pass of the ROM search (Maxim application note 187), a bit at a
+ * time: read the id bit and its complement, pick a direction and write
+ * it back so only devices on that branch stay in the search.
+ */
+static bool search_next_symbol(void)
+{
+	const BitbangStep_t * read_slot = mOneWireBit[1];
+
+	switch(mSearch.phase)
+	{
+		case SEARCH_PHASE_RESET:
+			mBitbang.presence = (false == mBitbang.sample);
+
+			if(false == mBitbang.presence) {
+				search_reset();
+				return false;
+			}
+
+			mBitbang.symbol = NULL;
+			mSearch.phase = SEARCH_PHASE_CMD;
+			return bits_next_symbol();
+
+		case SEARCH_PHASE_CMD:
+			if(bits_next_symbol()) {
+				return true;
+			}
+
+			mSearch.phase = SEARCH_PHASE_ID;
+			mSearch.id_bit_number = 1;
+			mSearch.last_zero = 0;
+			set_symbol(read_slot, ARRAY_SIZE(mOneWireBit[1]));
+			return true;
+
+		case SEARCH_PHASE_ID:
+			mSearch.id_bit = mBitbang.sample;
+			mSearch.phase = SEARCH_PHASE_CMP;
+			set_symbol(read_slot, ARRAY_SIZE(mOneWireBit[1]));
+			return true;
+
+		case SEARCH_PHASE_CMP: {
+			bool cmp_id_bit = mBitbang.sample;
+			uint8_t byte_no = (mSearch.id_bit_number - 1) / 8;
+			uint8_t mask = 1 << ((mSearch.id_bit_number - 1) % 8);
+			bool direction;
+
+			if(mSearch.id_bit && cmp_id_bit) {
+				// no device answered
+				search_reset();
+				return false;
+			}
+
+			if(mSearch.id_bit != cmp_id_bit) {
+				// every device left agrees on this bit
+				direction = mSearch.id_bit;
+			}
+			else {
+				// discrepancy: repeat the last pass below the last
+				// discrepancy, take 1 at it, 0 above it
+				if(mSearch.id_bit_number < mSearch.last_discrepancy) {
+					direction = (0 != (mSearch.rom[byte_no] & mask));
+				}
+				else {
+					direction = (mSearch.id_bit_number == mSearch.last_discrepancy);
+				}
+
+				if(false == direction) {
+					mSearch.last_zero = mSearch.id_bit_number;
+				}
+			}
+
+			if(direction) {
+				mSearch.rom[byte_no] |= mask;
+			}
+			else {
+				mSearch.rom[byte_no] &= ~mask;
+			}
+
+			mSearch.phase = SEARCH_PHASE_DIR;
+			set_symbol(mOneWireBit[direction], ARRAY_SIZE(mOneWireBit[direction]));
+			return true;
+		}
+
+		case SEARCH_PHASE_DIR:
+			if(++mSearch.id_bit_number <= ONEWIRE_ROM_BITS) {
+				mSearch.phase = SEARCH_PHASE_ID;
+				set_symbol(read_slot, ARRAY_SIZE(mOneWireBit[1]));
+				return true;
+			}
+
+			mSearch.last_discrepancy = mSearch.last_zero;
+			mSearch.last_device = (0 == mSearch.last_discrepancy);
+
+			mSearch.result = ONEWIRE_SEARCH_FOUND;
+			if(mSearch.last_device) {
+				mSearch.result |= ONEWIRE_SEARCH_LAST;
+			}
+			if(0 != onewire_crc8(mSearch.rom, sizeof(mSearch.rom))) {
+				mSearch.result |= ONEWIRE_SEARCH_CRC_ERROR;
+			}
+			return false;
+
+		default:
+			ASSERT(false);
+			return false;
+	}
+}
+
+
+static void stop_timer(void)
+{
+	RJTTimer_disable(BITBANG_TIMER);
+	RJTTimer_release(BITBANG_TIMER);
+}
+
+
+static void finish_job(void)
+{
+	mBitbang.state = BITBANG_STATE_DONE;
+
+	RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_BITBANG, true);
+}
+
+
+void TC7_Handler(void)
+{
+	Tc * hw = BITBANG_TIMER_HW;
+
+	hw->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+
+	for(;;)
+	{
+		while((int16_t) (mBitbang.deadline - now()) > 0);
+
+		if(BITBANG_ACTION_END == mBitbang.pending.action) {
+			stop_timer();
+			finish_job();
+			return;
+		}
+
+		apply_action(mBitbang.pending.action);
+
+		// A late step (the USB interrupt ran first) still gets its
+		// full hold time
+		uint16_t t = now();
+		if((int16_t) (t - mBitbang.deadline) > (int16_t) US2TICKS(BITBANG_LATE_US)) {
+			mBitbang.deadline = t;
+		}
+
+		mBitbang.deadline += US2TICKS(mBitbang.pending.hold_us);
+
+		if(false == next_step(&mBitbang.pending)) {
+			mBitbang.pending.action = BITBANG_ACTION_END;
+			mBitbang.pending.hold_us = 0;
+		}
+
+		if((int16_t) (mBitbang.deadline - now()) > (int16_t) US2TICKS(BITBANG_MIN_SCHEDULE_US)) {
+			hw->COUNT16.CC[0].reg = mBitbang.deadline;
+			RJT_TIMER_WAIT_FOR_SYNC(hw);
+			return;
+		}
+	}
+}
+
+
+static enum RJT_USB_ERROR claim_pin(uint8_t index)
+{
+	bool success = false;
+	uint8_t gpio = 0xff;
+
+	if(BITBANG_STATE_RUNNING == mBitbang.state) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	RJTUSBBridgeConfig_index2gpio(index, &success, &gpio);
+
+	if(false == success) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	mBitbang.gpio = gpio;
+	mBitbang.pin_mask = RJTUSBBridgeConfig_indexMask2PortMask(1UL << index);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+/**
+ * Starts the timer driven job set up in mBitbang. The pin is released
+ * (pulled up) with its input buffer on, and the first step runs as
+ * soon as the interrupt is taken.
+ */
+static enum RJT_USB_ERROR start_job(enum BITBANG_JOB job, bool (*next_symbol)(void))
+{
+	if(false == RJTTimer_claim(BITBANG_TIMER)) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	struct port_config pin_config;
+	port_get_config_defaults(&pin_config);
+	pin_config.direction = PORT_PIN_DIR_INPUT;
+	pin_config.input_pull = PORT_PIN_PULL_UP;
+
+	port_pin_set_config(mBitbang.gpio, &pin_config);
+
+	mBitbang.job = job;
+	mBitbang.next_symbol = next_symbol;
+	mBitbang.step_no = 0;
+	mBitbang.sample = false;
+	mBitbang.presence = false;
+	memset(mBitbang.rx, 0, sizeof(mBitbang.rx));
+
+	if(false == next_step(&mBitbang.pending)) {
+		RJTTimer_release(BITBANG_TIMER);
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	Tc * hw = RJTTimer_getHw(BITBANG_TIMER);
+	IRQn_Type irqn = RJTTimer_getIRQn(BITBANG_TIMER);
+
+	RJTTimer_enable(BITBANG_TIMER);
+
+	hw->COUNT16.CTRLA.reg =
+		TC_CTRLA_MODE_COUNT16 |
+		TC_CTRLA_WAVEGEN_NFRQ |
+		TC_CTRLA_PRESCALER_DIV16 |
+		TC_CTRLA_PRESCSYNC_PRESC;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	// The interrupt reads COUNT on every step
+	hw->COUNT16.READREQ.reg =
+		TC_READREQ_RCONT |
+		TC_READREQ_ADDR(TC_COUNT16_COUNT_OFFSET);
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	hw->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+
+	hw->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	mBitbang.deadline = now();
+	mBitbang.state = BITBANG_STATE_RUNNING;
+
+	// Same level as USB: a command can delay a step, never split one
+	NVIC_SetPriority(irqn, APP_HIGH_PRIORITY);
+	NVIC_EnableIRQ(irqn);
+	NVIC_SetPendingIRQ(irqn);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+static void ws2812_stop(void)
+{
+	dma_abort_job(&mDMA);
+
+	WS2812_TCC->CTRLA.reg &= ~TCC_CTRLA_ENABLE;
+	while(WS2812_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_ENABLE);
+
+	WS2812_TCC->CTRLA.reg = TCC_CTRLA_SWRST;
+	while(WS2812_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_SWRST);
+
+	system_apb_clock_clear_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_TCC0);
+
+	// hold the line low, which is also the latch
+	struct port_config pin_config;
+	port_get_config_defaults(&pin_config);
+	pin_config.direction = PORT_PIN_DIR_OUTPUT;
+
+	port_pin_set_output_level(mBitbang.gpio, false);
+	port_pin_set_config(mBitbang.gpio, &pin_config);
+}
+
+
+/**
+ * Runs when the DMA has written the last tail slot. The first tail slot
+ * was loaded on the same wrap, so the data has fully gone out and the
+ * output is low already.
+ */
+static void ws2812_done_callback(struct dma_resource * const resource)
+{
+	ws2812_stop();
+	finish_job();
+}
+
+
+static void init_dmac(void)
+{
+	struct dma_resource_config config;
+	dma_get_config_defaults(&config);
+
+	config.peripheral_trigger = TCC0_DMAC_ID_OVF;
+	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
+
+	enum status_code ret = dma_allocate(&mDMA, &config);
+	ASSERT(STATUS_OK == ret);
+
+	dma_register_callback(&mDMA, ws2812_done_callback, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&mDMA, DMA_CALLBACK_TRANSFER_DONE);
+}
+
+
+// function F of PB10..PB13, TCC0/WO[4 + channel]
+static const uint8_t mWs2812MuxPosition[WS2812_NUM_OUTPUTS] = {
+	MUX_PB10F_TCC0_WO4,
+	MUX_PB11F_TCC0_WO5,
+	MUX_PB12F_TCC0_WO6,
+	MUX_PB13F_TCC0_WO7,
+};
+
+
+static enum RJT_USB_ERROR ws2812_start(uint8_t channel, size_t num_bytes)
+{
+	size_t num_slots = num_bytes * 8 + WS2812_TAIL_SLOTS;
+
+	memset(&mWs2812.slots[num_bytes * 8], 0, WS2812_TAIL_SLOTS);
+
+	// Byte beats into the low byte of CCBx, the top is 59 anyway
+	struct dma_descriptor_config desc_config;
+	dma_descriptor_get_config_defaults(&desc_config);
+
+	desc_config.beat_size = DMA_BEAT_SIZE_BYTE;
+	desc_config.block_action = DMA_BLOCK_ACTION_INT;
+	desc_config.src_increment_enable = true;
+	desc_config.source_address = (uint32_t) mWs2812.slots + num_slots;
+	desc_config.dst_increment_enable = false;
+	desc_config.destination_address = (uint32_t) &WS2812_TCC->CCB[channel].reg;
+	desc_config.block_transfer_count = num_slots;
+	desc_config.next_descriptor_address = 0;
+
+	dma_descriptor_create(&mDMADescriptor, &desc_config);
+
+	dma_reset_descriptor(&mDMA);
+	dma_add_descriptor(&mDMA, &mDMADescriptor);
+
+	enum status_code ret = dma_start_transfer_job(&mDMA);
+
+	if(STATUS_OK != ret) {
+		RJTLogger_print("WS2812: dma start failed: %d", ret);
+		return RJT_USB_ERROR_OPERATION_FAILED;
+	}
+
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_TCC0);
+
+	// TCC0 shares its generic clock with TCC1, both run from GCLK1
+	struct system_gclk_chan_config gclk_config;
+	system_gclk_chan_get_config_defaults(&gclk_config);
+	gclk_config.source_generator = RJT_TIMER_GCLK_GENERATOR;
+
+	system_gclk_chan_set_config(TCC0_GCLK_ID, &gclk_config);
+	system_gclk_chan_enable(TCC0_GCLK_ID);
+
+	WS2812_TCC->CTRLA.reg = TCC_CTRLA_SWRST;
+	while(WS2812_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_SWRST);
+
+	WS2812_TCC->CTRLA.reg = TCC_CTRLA_PRESCALER_DIV1;
+
+	WS2812_TCC->WAVE.reg = TCC_WAVE_WAVEGEN_NPWM;
+	while(WS2812_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_WAVE);
+
+	// CC stays 0 (low) until the DMA's first write is loaded on the
+	// second wrap, which doubles as a short idle before the data
+	WS2812_TCC->PER.reg = WS2812_PERIOD_TICKS - 1;
+	while(WS2812_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_PER);
+
+	// pin over to TCC0/WO[4 + channel], function F
+	struct system_pinmux_config pin_config;
+	system_pinmux_get_config_defaults(&pin_config);
+	pin_config.direction = SYSTEM_PINMUX_PIN_DIR_OUTPUT;
+	pin_config.mux_position = mWs2812MuxPosition[channel];
+
+	system_pinmux_pin_set_config(mBitbang.gpio, &pin_config);
+
+	mBitbang.job = BITBANG_JOB_WS2812;
+	mBitbang.state = BITBANG_STATE_RUNNING;
+
+	WS2812_TCC->CTRLA.reg |= TCC_CTRLA_ENABLE;
+	while(WS2812_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_ENABLE);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+static bool parse_step(const uint8_t * data, BitbangStep_t * step)
+{
+	__PACKED_STRUCT {
+		uint8_t  action;
+		uint16_t hold_us;
+	} raw;
+
+	memcpy(&raw, data, sizeof(raw));
+
+	step->action = raw.action;
+	step->hold_us = raw.hold_us;
+
+	return raw.action < BITBANG_ACTION_MAX && raw.hold_us <= BITBANG_MAX_HOLD_US;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeBitbang_serialConfigure(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t index;
+		uint8_t lsb_first;
+		uint8_t num_steps0;
+		uint8_t num_steps1;
+	RJT_USB_BRIDGE_END_CMD
+
+	const size_t step_size = sizeof(uint8_t) + sizeof(uint16_t);
+	uint8_t num_steps[2] = {cmd.num_steps0, cmd.num_steps1};
+
+	*rsp_len = 0;
+
+	if(BITBANG_STATE_RUNNING == mBitbang.state) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	if(cmd.index >= RJT_USB_BRIDGE_NUM_GPIOS ||
+	   0 == cmd.num_steps0 || cmd.num_steps0 > BITBANG_MAX_SYMBOL_STEPS ||
+	   0 == cmd.num_steps1 || cmd.num_steps1 > BITBANG_MAX_SYMBOL_STEPS ||
+	   cmd_len < sizeof(cmd) + (cmd.num_steps0 + cmd.num_steps1) * step_size ||
+	   0 == (RJTUSBBridgeConfig_getAvailableIndexMask() & (1UL << cmd.index)))
+	{
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	mSerial.configured = false;
+
+	const uint8_t * data = &cmd_data[sizeof(cmd)];
+
+	for(uint8_t bit = 0; bit < 2; bit++)
+	{
+		for(uint8_t k = 0; k < num_steps[bit]; k++)
+		{
+			if(false == parse_step(data, &mSerial.symbols[bit][k])) {
+				return RJT_USB_ERROR_PARAMETER;
+			}
+			data += step_size;
+		}
+
+		mSerial.symbol_len[bit] = num_steps[bit];
+	}
+
+	mSerial.index = cmd.index;
+	mSerial.lsb_first = (0 != cmd.lsb_first);
+	mSerial.configured = true;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeBitbang_serialWrite(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	*rsp_len = 0;
+
+	if(false == mSerial.configured) {
+		return RJT_USB_ERROR_STATE;
+	}
+
+	if(0 == cmd_len || cmd_len > BITBANG_MAX_BYTES) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	enum RJT_USB_ERROR ret = claim_pin(mSerial.index);
+
+	if(RJT_USB_ERROR_NONE != ret) {
+		return ret;
+	}
+
+	for(uint8_t bit = 0; bit < 2; bit++) {
+		mBitbang.bit_symbols[bit] = mSerial.symbols[bit];
+		mBitbang.bit_symbol_len[bit] = mSerial.symbol_len[bit];
+	}
+
+	memcpy(mBitbang.tx, cmd_data, cmd_len);
+	mBitbang.num_bits = cmd_len * 8;
+	mBitbang.bit_no = 0;
+	mBitbang.lsb_first = mSerial.lsb_first;
+	set_symbol(NULL, 0);
+
+	return start_job(BITBANG_JOB_SERIAL, bits_next_symbol);
+}
+
+
+static void setup_onewire_bits(void)
+{
+	for(uint8_t bit = 0; bit < 2; bit++) {
+		mBitbang.bit_symbols[bit] = mOneWireBit[bit];
+		mBitbang.bit_symbol_len[bit] = ARRAY_SIZE(mOneWireBit[bit]);
+	}
+
+	mBitbang.lsb_first = true;
+	mBitbang.bit_no = 0;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeBitbang_onewireTransfer(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t index;
+		uint8_t flags;
+	RJT_USB_BRIDGE_END_CMD
+
+	size_t num_bytes = cmd_len - sizeof(cmd);
+
+	*rsp_len = 0;
+
+	if(num_bytes > BITBANG_MAX_BYTES ||
+	   (0 == num_bytes && 0 == (cmd.flags & ONEWIRE_TRANSFER_RESET))) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	enum RJT_USB_ERROR ret = claim_pin(cmd.index);
+
+	if(RJT_USB_ERROR_NONE != ret) {
+		return ret;
+	}
+
+	setup_onewire_bits();
+
+	memcpy(mBitbang.tx, &cmd_data[sizeof(cmd)], num_bytes);
+	mBitbang.num_bits = num_bytes * 8;
+
+	if(cmd.flags & ONEWIRE_TRANSFER_RESET) {
+		set_symbol(mOneWireReset, ARRAY_SIZE(mOneWireReset));
+	}
+	else {
+		set_symbol(NULL, 0);
+	}
+
+	return start_job(BITBANG_JOB_ONEWIRE, onewire_next_symbol);
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeBitbang_onewireSearch(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t index;
+		uint8_t flags;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	enum RJT_USB_ERROR ret = claim_pin(cmd.index);
+
+	if(RJT_USB_ERROR_NONE != ret) {
+		return ret;
+	}
+
+	if(cmd.flags & ONEWIRE_SEARCH_RESTART) {
+		search_reset();
+	}
+
+	mSearch.result = 0;
+
+	if(mSearch.last_device) {
+		// the previous pass found the last device, report it without
+		// touching the bus
+		mBitbang.job = BITBANG_JOB_SEARCH;
+		mBitbang.presence = true;
+		search_reset();
+		finish_job();
+		return RJT_USB_ERROR_NONE;
+	}
+
+	setup_onewire_bits();
+
+	mBitbang.tx[0] = (cmd.flags & ONEWIRE_SEARCH_ALARM) ? ONEWIRE_ALARM_SEARCH : ONEWIRE_SEARCH_ROM;
+	mBitbang.num_bits = 8;
+
+	mSearch.phase = SEARCH_PHASE_RESET;
+	set_symbol(mOneWireReset, ARRAY_SIZE(mOneWireReset));
+
+	return start_job(BITBANG_JOB_SEARCH, search_next_symbol);
+}
+
+
+/**
+ * Expands GRB bytes into one CC value per bit, starting at the given
+ * byte offset of the strip.
+ */
+enum RJT_USB_ERROR RJTUSBBridgeBitbang_ws2812Write(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint16_t offset;
+	RJT_USB_BRIDGE_END_CMD
+
+	size_t num_bytes = cmd_len - sizeof(cmd);
+
+	*rsp_len = 0;
+
+	if(BITBANG_STATE_RUNNING == mBitbang.state && BITBANG_JOB_WS2812 == mBitbang.job) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	if(cmd.offset + num_bytes > WS2812_MAX_BYTES) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	uint8_t * slot = &mWs2812.slots[cmd.offset * 8];
+
+	for(size_t k = 0; k < num_bytes; k++)
+	{
+		uint8_t byte = cmd_data[sizeof(cmd) + k];
+
+		// MSB first on the wire
+		for(uint8_t bit = 0; bit < 8; bit++) {
+			*slot++ = (byte & 0x80) ? WS2812_T1H_TICKS : WS2812_T0H_TICKS;
+			byte <<= 1;
+		}
+	}
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeBitbang_ws2812Show(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t  index;
+		uint16_t num_bytes;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(cmd.index < WS2812_FIRST_INDEX ||
+	   cmd.index >= WS2812_FIRST_INDEX + WS2812_NUM_OUTPUTS ||
+	   0 == cmd.num_bytes || cmd.num_bytes > WS2812_MAX_BYTES) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	// fails for the PWM configuration, which owns TCC0 and these pins
+	enum RJT_USB_ERROR ret = claim_pin(cmd.index);
+
+	if(RJT_USB_ERROR_NONE != ret) {
+		return ret;
+	}
+
+	return ws2812_start(cmd.index - WS2812_FIRST_INDEX, cmd.num_bytes);
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeBitbang_read(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	__PACKED_STRUCT {
+		uint8_t state;
+		uint8_t job;
+		uint8_t presence;
+		uint8_t search;
+		uint8_t len;
+	} rsp = {0};
+
+	ASSERT(*rsp_len >= sizeof(rsp) + BITBANG_MAX_BYTES);
+
+	const uint8_t * data = NULL;
+
+	rsp.state = mBitbang.state;
+	rsp.job = mBitbang.job;
+
+	if(BITBANG_STATE_DONE == mBitbang.state)
+	{
+		rsp.presence = mBitbang.presence;
+
+		switch(mBitbang.job)
+		{
+			case BITBANG_JOB_SERIAL:
+			case BITBANG_JOB_ONEWIRE:
+				rsp.len = (uint8_t) ((mBitbang.bit_no + 7) / 8);
+				data = mBitbang.rx;
+				break;
+
+			case BITBANG_JOB_SEARCH:
+				rsp.search = mSearch.result;
+				if(mSearch.result & ONEWIRE_SEARCH_FOUND) {
+					rsp.len = sizeof(mSearch.rom);
+					data = mSearch.rom;
+				}
+				break;
+
+			default:
+				break;
+		}
+
+		RJTUSBBridge_clearInterruptBit(RJT_USB_INTERRUPT_BIT_BITBANG, true);
+	}
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+
+	if(NULL != data) {
+		memcpy(&rsp_data[sizeof(rsp)], data, rsp.len);
+	}
+
+	*rsp_len = sizeof(rsp) + rsp.len;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+void RJTUSBBridgeBitbang_stop(void)
+{
+	system_interrupt_enter_critical_section();
+
+	if(BITBANG_STATE_RUNNING == mBitbang.state)
+	{
+		if(BITBANG_JOB_WS2812 == mBitbang.job) {
+			ws2812_stop();
+		}
+		else {
+			stop_timer();
+			apply_action(BITBANG_ACTION_RELEASE);
+		}
+
+		mBitbang.state = BITBANG_STATE_IDLE;
+	}
+
+	system_interrupt_leave_critical_section();
+}
+
+
+bool RJTUSBBridgeBitbang_isBusy(void)
+{
+	return BITBANG_STATE_RUNNING == mBitbang.state;
+}
+
+
+void RJTUSBBridgeBitbang_init(void)
+{
+	memset(&mBitbang, 0, sizeof(mBitbang));
+	memset(&mSerial, 0, sizeof(mSerial));
+	search_reset();
+
+	init_dmac();
+}
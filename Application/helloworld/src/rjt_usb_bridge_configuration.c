@@ -56,6 +56,12 @@ static uint8_t mConfig2Override[SK_USB_CONFIG_MAX][RJT_USB_BRIDGE_NUM_GPIOS] = {
 		[2] = 0xff, // SDA
 		[3] = 0xff, // SCL
 	},
+	[SK_USB_CONFIG_PWM] = {
+		[10] = 0xff, // TCC0/WO[4]
+		[11] = 0xff, // TCC0/WO[5]
+		[12] = 0xff, // TCC0/WO[6]
+		[13] = 0xff, // TCC0/WO[7]
+	},
 };
 
 
@@ -79,6 +85,24 @@ static uint8_t pin2extint[] = {
 };
 
 
+/**
+ * Lookup tables for converting between index masks and PORTB masks,
+ * four bits at a time. They are rebuilt every time the configuration
+ * changes, so pins owned by a peripheral never show up in either
+ * direction.
+ */
+#define NIBBLE_BITS			4
+#define NUM_NIBBLES			(RJT_USB_BRIDGE_NUM_GPIOS / NIBBLE_BITS)
+
+static uint32_t mIndexNibble2PortMask[NUM_NIBBLES][1 << NIBBLE_BITS];
+static uint32_t mPortNibble2IndexMask[NUM_NIBBLES][1 << NIBBLE_BITS];
+static uint32_t mAvailableIndexMask = 0;
+
+// Reverse lookups for the interrupt path, 0xff where no index applies
+static uint8_t mExtint2Index[EIC_NUMBER_OF_INTERRUPTS];
+static uint8_t mPortBit2Index[RJT_USB_BRIDGE_NUM_GPIOS];
+
+
 static enum SK_USB_CONFIG read_current_config(void)
 {
 	return __mCurrentConfig;
@@ -101,29 +125,133 @@ static uint8_t config2gpio(enum SK_USB_CONFIG config, uint8_t index)
 }
 
 
-void RJTUSBBridgeConfig_gpio2index(uint8_t gpio, bool * success, uint8_t * index)
+static void update_index_tables(enum SK_USB_CONFIG config)
 {
-	uint8_t k;
+	memset(mIndexNibble2PortMask, 0, sizeof(mIndexNibble2PortMask));
+	memset(mPortNibble2IndexMask, 0, sizeof(mPortNibble2IndexMask));
+	memset(mExtint2Index, 0xff, sizeof(mExtint2Index));
+	memset(mPortBit2Index, 0xff, sizeof(mPortBit2Index));
+	mAvailableIndexMask = 0;
+
+	for(uint8_t k = 0; k < RJT_USB_BRIDGE_NUM_GPIOS; k++)
+	{
+		uint8_t gpio = config2gpio(config, k);
+
+		if(0xff == gpio) {
+			// owned by a peripheral
+			continue;
+		}
+
+		// The reverse tables only cover the lower half of PORTB
+		ASSERT(gpio >= PIN_PB00 && gpio <= PIN_PB15);
+		uint8_t port_bit = gpio - PIN_PB00;
+
+		mAvailableIndexMask |= (1UL << k);
+		mExtint2Index[pin2extint[k]] = k;
+		mPortBit2Index[port_bit] = k;
+
+		// Every nibble value that contains this index (or port bit)
+		// gets the corresponding bit on the other side
+		for(uint8_t nibble = 0; nibble < (1 << NIBBLE_BITS); nibble++)
+		{
+			if(nibble & (1 << (k % NIBBLE_BITS))) {
+				mIndexNibble2PortMask[k / NIBBLE_BITS][nibble] |= (1UL << port_bit);
+			}
+
+			if(nibble & (1 << (port_bit % NIBBLE_BITS))) {
+				mPortNibble2IndexMask[port_bit / NIBBLE_BITS][nibble] |= (1UL << k);
+			}
+		}
+	}
+}
+
+
+static void set_current_config(enum SK_USB_CONFIG config)
+{
+	update_index_tables(config);
+	__mCurrentConfig = config;
+}
 
-	enum SK_USB_CONFIG current_config = read_current_config();
 
-	for(k = 0; k < RJT_USB_BRIDGE_NUM_GPIOS; ++k)
+uint32_t RJTUSBBridgeConfig_getAvailableIndexMask(void)
+{
+	return mAvailableIndexMask;
+}
+
+
+/**
+ * Turns on the input buffer of the given indices, which config_gpio()
+ * leaves off, so PORTB.IN follows them. Direction and pull are kept.
+ */
+void RJTUSBBridgeConfig_enableInputs(uint32_t index_mask)
+{
+	uint32_t port_mask = RJTUSBBridgeConfig_indexMask2PortMask(index_mask);
+
+	for(uint8_t port_bit = 0; port_bit < RJT_USB_BRIDGE_NUM_GPIOS; port_bit++)
 	{
-		if(gpio == config2gpio(current_config, k)) {
-			break;
+		if(port_mask & (1UL << port_bit)) {
+			PORTB.PINCFG[port_bit].reg |= PORT_PINCFG_INEN;
 		}
 	}
+}
+
+
+uint32_t RJTUSBBridgeConfig_indexMask2PortMask(uint32_t index_mask)
+{
+	uint32_t port_mask = 0;
 
-	if(k == RJT_USB_BRIDGE_NUM_GPIOS) 
+	for(uint8_t k = 0; k < NUM_NIBBLES; k++)
 	{
-		*success = false;
-	} else {
-		*success = true;
-		*index = k;
+		port_mask |= mIndexNibble2PortMask[k][index_mask & 0x0f];
+		index_mask >>= NIBBLE_BITS;
+	}
+
+	return port_mask;
+}
+
+
+uint32_t RJTUSBBridgeConfig_portMask2IndexMask(uint32_t port_mask)
+{
+	uint32_t index_mask = 0;
+
+	for(uint8_t k = 0; k < NUM_NIBBLES; k++)
+	{
+		index_mask |= mPortNibble2IndexMask[k][port_mask & 0x0f];
+		port_mask >>= NIBBLE_BITS;
+	}
+
+	return index_mask;
+}
+
+
+void RJTUSBBridgeConfig_gpio2index(uint8_t gpio, bool * success, uint8_t * index)
+{
+	*success = false;
+
+	if(gpio >= PIN_PB00 && gpio < PIN_PB00 + RJT_USB_BRIDGE_NUM_GPIOS)
+	{
+		uint8_t k = mPortBit2Index[gpio - PIN_PB00];
+
+		if(0xff != k) {
+			*success = true;
+			*index = k;
+		}
 	}
 }
 
 
+/**
+ * Index whose pin drives the given external interrupt line, or 0xff.
+ * Table lookup, meant for interrupt context.
+ */
+uint8_t RJTUSBBridgeConfig_extint2index(uint8_t extint)
+{
+	ASSERT(extint < EIC_NUMBER_OF_INTERRUPTS);
+
+	return mExtint2Index[extint];
+}
+
+
 void RJTUSBBridgeConfig_index2extint(uint8_t index, bool * success, uint8_t * extint)
 {
 	ASSERT(sizeof(pin2extint) == RJT_USB_BRIDGE_NUM_GPIOS);
@@ -165,7 +293,7 @@ static enum RJT_USB_ERROR config_gpio(void)
 		RJTEIC_disableInterrupt(extint);
 	}
 	
-	__mCurrentConfig = SK_USB_CONFIG_GPIO;
+	set_current_config(SK_USB_CONFIG_GPIO);
 
 	RJTLogger_print("CONFIG: gpio");
 	
@@ -208,7 +336,7 @@ static enum RJT_USB_ERROR config_i2c_master(const uint8_t * cmd_data, size_t cmd
 	*rsp_len = 0;
 
 	mI2c.enabled = true;
-	__mCurrentConfig = SK_USB_CONFIG_I2C_MASTER;
+	set_current_config(SK_USB_CONFIG_I2C_MASTER);
 
 	RJTLogger_print("CONFIG: I2C");
 	return RJT_USB_ERROR_NONE;
@@ -318,13 +446,54 @@ static enum RJT_USB_ERROR config_spi_master(const uint8_t * cmd_data, size_t cmd
 	*rsp_len = 0;
 
 	mSpi.enabled = true;
-	__mCurrentConfig = SK_USB_CONFIG_SPI_MASTER;
+	set_current_config(SK_USB_CONFIG_SPI_MASTER);
 
 	RJTLogger_print("CONFIG: SPIM");
 	return RJT_USB_ERROR_NONE;
 }
 
 
+static enum RJT_USB_ERROR config_pwm(const uint8_t * cmd_data, size_t cmd_len,
+		uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+	uint32_t frequency_hz;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(RJTUSBBridgeBitbang_isBusy()) {
+		// a WS2812 transfer may be using TCC0
+		RJTLogger_print("CONFIG: bit-bang engine busy");
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	enum RJT_USB_ERROR ret = RJTUSBBridgePWM_enable(cmd.frequency_hz);
+
+	if(RJT_USB_ERROR_NONE != ret) {
+		RJTLogger_print("bad pwm frequency: %d", cmd.frequency_hz);
+		return ret;
+	}
+
+	set_current_config(SK_USB_CONFIG_PWM);
+
+	RJTLogger_print("CONFIG: PWM");
+	return RJT_USB_ERROR_NONE;
+}
+
+
+static void uninit_pwm(void)
+{
+	RJTUSBBridgePWM_disable();
+
+	RJTLogger_print("CONFIG: uninit pwm");
+
+	// Call config gpio to reset all of the pinmux to gpio settings
+	config_gpio();
+	set_current_config(SK_USB_CONFIG_GPIO);
+}
+
+
 static void uninit_i2c_master(void)
 {
 	ASSERT(true == mI2c.enabled);
@@ -335,7 +504,7 @@ static void uninit_i2c_master(void)
 	// Call config gpio to reset all of the pinmux to gpio settings
 	config_gpio();
 	mI2c.enabled = false;
-	__mCurrentConfig = SK_USB_CONFIG_GPIO;
+	set_current_config(SK_USB_CONFIG_GPIO);
 }
 
 
@@ -349,7 +518,7 @@ static void uninit_spi_master(void)
 	// Call config gpio to reset all of the pinmux to gpio settings
 	config_gpio();
 	mSpi.enabled = false;
-	__mCurrentConfig = SK_USB_CONFIG_GPIO;
+	set_current_config(SK_USB_CONFIG_GPIO);
 }
 
 
@@ -374,6 +543,11 @@ static void uninit_current_config(void)
 			uninit_i2c_master();
 			return;
 
+		case SK_USB_CONFIG_PWM:
+			RJTLogger_print("CONFIG: uninit pwm");
+			uninit_pwm();
+			return;
+
 		default:
 			ASSERT(false);
 			break;
@@ -415,6 +589,17 @@ enum RJT_USB_ERROR RJTUSBBridgeConfig_setConfig(const uint8_t * cmd_data, size_t
 
 	RJTLogger_print("CONFIG: cmd.config = %d", cmd.config);
 
+	if(RJTUSBBridgeTrigger_isBusy()) {
+		*rsp_len = 0;
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	// a binding is only good for the bus it was set up on
+	RJTUSBBridgeTrigger_stop();
+
+	// the pattern DMA would keep driving pins that change hands
+	RJTUSBBridgePattern_stop();
+
 	RJTLogger_print("uninit current config..");
 	uninit_current_config();
 
@@ -442,6 +627,13 @@ enum RJT_USB_ERROR RJTUSBBridgeConfig_setConfig(const uint8_t * cmd_data, size_t
 				rsp_data, 
 				rsp_len);
 
+		case SK_USB_CONFIG_PWM:
+			return config_pwm(
+				&cmd_data[sizeof(cmd)],
+				cmd_len - sizeof(cmd),
+				rsp_data,
+				rsp_len);
+
 		default:
 			RJTLogger_print("CONFIG: Unknown cmd.config");
 			return RJT_USB_ERROR_PARAMETER;
@@ -0,0 +1,403 @@
+/*
+ * rjt_usb_bridge_freq.c
+ */
+
+#include "rjt_external_interrupt_controller.h"
+#include "rjt_usb_bridge_app.h"
+#include "rjt_timer.h"
+#include "rjt_logger.h"
+#include "udi_vendor.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <asf.h>
+
+/**
+ * Frequency counter:
+ *
+ * The measured pin is an EIC line with level detection and its event
+ * output on. One event channel carries the pin level to two users:
+ *
+ * - TC6 in period / pulse width capture: on the rising edge the count
+ *   is captured into CC0 (period) and restarted, on the falling edge it
+ *   is captured into CC1 (high time).
+ * - TCC2 counting events, giving the number of periods.
+ *
+ * No CPU runs per edge. Once per USB frame the SOF callback folds the
+ * 16 bit TCC2 count into a 32 bit total, and at the end of every gate
+ * it latches the results and adjusts the TC6 prescaler so the next
+ * period fits in 16 bits.
+ *
+ * The gate is timed with the timestamp timer, not by counting frames:
+ * while USB is suspended there are none, and TCC2 may wrap unseen, so
+ * the first frame after a gap starts the gate over.
+ *
+ * The EIC filter and synchronizer limit the input to roughly 1 MHz.
+ */
+
+#define FREQ_COUNTER_TC			RJT_TIMER_TC6
+#define FREQ_EDGE_TCC			TCC2
+
+#define FREQ_MAX_GATE_MS		10000
+
+// TCC2 wraps after 65 ms at the 1 MHz input limit
+#define FREQ_MAX_SOF_GAP_US		50000
+#define FREQ_OFF				0xff
+
+// step the prescaler down when a period uses less than this many counts
+#define FREQ_MIN_PERIOD_TICKS	0x2000
+
+
+static struct {
+	bool running;
+	uint8_t index;
+	uint8_t extint;
+	uint16_t gate_ms;
+
+	uint8_t prescaler;
+	uint32_t gate_start;		// timestamp, us
+	uint32_t last_sof;
+	uint16_t last_count;
+	uint32_t edges;
+
+	// latched at the end of each gate
+	struct {
+		uint32_t gate_no;
+		uint32_t edges;
+		uint32_t freq_millihz;
+		uint32_t period_ns;
+		uint32_t high_ns;
+		uint16_t duty;
+	} result;
+} mFreq;
+
+static struct events_resource mEvent;
+
+
+static void freq_eic_callback(void * self, uint8_t pinno, uint8_t intno)
+{
+	// never enabled, only the event output of the line is used
+}
+
+
+static uint16_t read_sync16(Tc * hw, uint8_t offset)
+{
+	hw->COUNT16.READREQ.reg = TC_READREQ_RREQ | TC_READREQ_ADDR(offset);
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	return *(volatile uint16_t *) ((uint8_t *) hw + offset);
+}
+
+
+static uint16_t read_edge_count(void)
+{
+	FREQ_EDGE_TCC->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+	while(FREQ_EDGE_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_CTRLB);
+	while(FREQ_EDGE_TCC->CTRLBSET.reg & TCC_CTRLBSET_CMD_Msk);
+
+	return (uint16_t) FREQ_EDGE_TCC->COUNT.reg;
+}
+
+
+static uint32_t ticks2ns(uint32_t ticks, uint8_t prescaler)
+{
+	uint64_t clocks = (uint64_t) ticks * RJTTimer_prescaler2div(prescaler);
+
+	return (uint32_t) ((clocks * 1000000000ULL) / RJT_TIMER_CLOCK_HZ);
+}
+
+
+static void start_capture_timer(void)
+{
+	Tc * hw = RJTTimer_getHw(FREQ_COUNTER_TC);
+
+	RJTTimer_enable(FREQ_COUNTER_TC);
+
+	hw->COUNT16.CTRLA.reg =
+		TC_CTRLA_MODE_COUNT16 |
+		TC_CTRLA_PRESCALER(mFreq.prescaler) |
+		TC_CTRLA_PRESCSYNC_PRESC;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	hw->COUNT16.CTRLC.reg = TC_CTRLC_CPTEN0 | TC_CTRLC_CPTEN1;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+
+	hw->COUNT16.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_PPW;
+
+	hw->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+	RJT_TIMER_WAIT_FOR_SYNC(hw);
+}
+
+
+static void init_edge_counter(void)
+{
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_TCC2);
+
+	// shares its generic clock with TC3, same generator
+	struct system_gclk_chan_config config;
+	system_gclk_chan_get_config_defaults(&config);
+	config.source_generator = RJT_TIMER_GCLK_GENERATOR;
+
+	system_gclk_chan_set_config(TCC2_GCLK_ID, &config);
+	system_gclk_chan_enable(TCC2_GCLK_ID);
+
+	FREQ_EDGE_TCC->CTRLA.reg = TCC_CTRLA_SWRST;
+	while(FREQ_EDGE_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_SWRST);
+
+	FREQ_EDGE_TCC->EVCTRL.reg = TCC_EVCTRL_TCEI0 | TCC_EVCTRL_EVACT0_COUNT;
+
+	FREQ_EDGE_TCC->PER.reg = 0xffff;
+	while(FREQ_EDGE_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_PER);
+
+	FREQ_EDGE_TCC->CTRLA.reg |= TCC_CTRLA_ENABLE;
+	while(FREQ_EDGE_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_ENABLE);
+}
+
+
+static void stop_edge_counter(void)
+{
+	FREQ_EDGE_TCC->CTRLA.reg &= ~TCC_CTRLA_ENABLE;
+	while(FREQ_EDGE_TCC->SYNCBUSY.reg & TCC_SYNCBUSY_ENABLE);
+
+	system_apb_clock_clear_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_TCC2);
+}
+
+
+static void latch_gate(uint32_t gate_us)
+{
+	Tc * hw = RJTTimer_getHw(FREQ_COUNTER_TC);
+	uint8_t flags = hw->COUNT16.INTFLAG.reg;
+
+	uint32_t period_ticks = 0;
+	uint32_t high_ticks = 0;
+
+	if(flags & TC_INTFLAG_MC0) {
+		period_ticks = read_sync16(hw, TC_COUNT16_CC_OFFSET);
+		high_ticks = read_sync16(hw, TC_COUNT16_CC_OFFSET + sizeof(uint16_t));
+	}
+
+	hw->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0 | TC_INTFLAG_MC1 | TC_INTFLAG_OVF;
+
+	mFreq.result.gate_no++;
+	mFreq.result.edges = mFreq.edges;
+	mFreq.result.freq_millihz = (uint32_t) (((uint64_t) mFreq.edges * 1000000000ULL) / gate_us);
+	mFreq.result.period_ns = ticks2ns(period_ticks, mFreq.prescaler);
+	mFreq.result.high_ns = ticks2ns(high_ticks, mFreq.prescaler);
+	mFreq.result.duty = (0 == period_ticks) ? 0 : (uint16_t) ((high_ticks * 10000UL) / period_ticks);
+
+	mFreq.edges = 0;
+
+	// Range the capture for the next gate
+	uint8_t prescaler = mFreq.prescaler;
+
+	if((flags & TC_INTFLAG_OVF) && 0 == period_ticks) {
+		// period longer than the counter, slow it down
+		if(prescaler < TC_CTRLA_PRESCALER_DIV1024_Val) {
+			prescaler++;
+		}
+	}
+	else if(0 != period_ticks && period_ticks < FREQ_MIN_PERIOD_TICKS) {
+		if(prescaler > TC_CTRLA_PRESCALER_DIV1_Val) {
+			prescaler--;
+		}
+	}
+
+	if(prescaler != mFreq.prescaler) {
+		// CTRLA is enable protected
+		mFreq.prescaler = prescaler;
+		start_capture_timer();
+	}
+}
+
+
+static void freq_sof_callback(void)
+{
+	if(false == mFreq.running) {
+		return;
+	}
+
+	uint32_t now = RJTTimer_getTimestamp();
+
+	uint16_t count = read_edge_count();
+	uint16_t new_edges = count - mFreq.last_count;
+	mFreq.last_count = count;
+
+	if(now - mFreq.last_sof > FREQ_MAX_SOF_GAP_US)
+	{
+		// frames stopped, suspended most likely: the count cannot be
+		// trusted, start the gate over
+		mFreq.edges = 0;
+		mFreq.gate_start = now;
+	}
+	else {
+		mFreq.edges += new_edges;
+	}
+
+	mFreq.last_sof = now;
+
+	uint32_t gate_us = now - mFreq.gate_start;
+
+	if(gate_us >= (uint32_t) mFreq.gate_ms * 1000)
+	{
+		latch_gate(gate_us);
+		mFreq.gate_start = now;
+	}
+}
+
+SOF_REGISTER_CALLBACK(freq_sof_callback);
+
+
+static enum RJT_USB_ERROR start_measurement(uint8_t index, uint16_t gate_ms)
+{
+	bool success = false;
+	uint8_t gpio = 0xff;
+	uint8_t extint = 0xff;
+
+	if(index >= RJT_USB_BRIDGE_NUM_GPIOS ||
+	   0 == (RJTUSBBridgeConfig_getAvailableIndexMask() & (1UL << index))) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	RJTUSBBridgeConfig_index2gpio(index, &success, &gpio);
+	ASSERT(true == success);
+
+	RJTUSBBridgeConfig_index2extint(index, &success, &extint);
+	ASSERT(true == success);
+
+	// a pin interrupt, the logic analyzer or a trigger
+	if(RJTEIC_isLineTaken(RJTUSBBridgeGPIO_getEICModule(), extint, freq_eic_callback)) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	if(false == RJTTimer_claim(FREQ_COUNTER_TC)) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	// Level detection: the event carries the pin level, which is what
+	// period / pulse width capture needs
+	RJTEICConfig_t config = {
+		.ext_int_sel = extint,
+		.eic_detection = RJT_EIC_DETECTION_HIGH,
+		.gpio = gpio,
+		.gpio_mux_position = 0,
+		.callback = freq_eic_callback,
+	};
+
+	RJTEIC_configure(RJTUSBBridgeGPIO_getEICModule(), &config);
+
+	struct events_config event_config;
+	events_get_config_defaults(&event_config);
+
+	event_config.generator = EVSYS_ID_GEN_EIC_EXTINT_0 + extint;
+	event_config.path      = EVENTS_PATH_ASYNCHRONOUS;
+
+	enum status_code ret = events_allocate(&mEvent, &event_config);
+
+	if(STATUS_OK != ret) {
+		RJTLogger_print("FREQ: no event channel: %d", ret);
+		RJTTimer_release(FREQ_COUNTER_TC);
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	events_attach_user(&mEvent, EVSYS_ID_USER_TC6_EVU);
+	events_attach_user(&mEvent, EVSYS_ID_USER_TCC2_EV_0);
+
+	// start slow, the first gate ranges it
+	mFreq.prescaler = TC_CTRLA_PRESCALER_DIV1024_Val;
+	start_capture_timer();
+	init_edge_counter();
+
+	RJTEIC_enableEvent(extint);
+
+	mFreq.index = index;
+	mFreq.extint = extint;
+	mFreq.gate_ms = gate_ms;
+	mFreq.gate_start = RJTTimer_getTimestamp();
+	mFreq.last_sof = mFreq.gate_start;
+	mFreq.edges = 0;
+	mFreq.last_count = 0;
+	memset(&mFreq.result, 0, sizeof(mFreq.result));
+
+	mFreq.running = true;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeFreq_configure(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t  index;
+		uint16_t gate_ms;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(FREQ_OFF != cmd.index &&
+	   (0 == cmd.gate_ms || cmd.gate_ms > FREQ_MAX_GATE_MS)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	RJTUSBBridgeFreq_stop();
+
+	if(FREQ_OFF == cmd.index) {
+		return RJT_USB_ERROR_NONE;
+	}
+
+	return start_measurement(cmd.index, cmd.gate_ms);
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeFreq_read(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	__PACKED_STRUCT {
+		uint32_t gate_no;
+		uint32_t edges;
+		uint32_t freq_millihz;
+		uint32_t period_ns;
+		uint32_t high_ns;
+		uint16_t duty;
+	} rsp = {0};
+
+	ASSERT(*rsp_len >= sizeof(rsp));
+
+	if(false == mFreq.running) {
+		*rsp_len = 0;
+		return RJT_USB_ERROR_STATE;
+	}
+
+	// the SOF callback runs in the same interrupt as commands
+	rsp.gate_no = mFreq.result.gate_no;
+	rsp.edges = mFreq.result.edges;
+	rsp.freq_millihz = mFreq.result.freq_millihz;
+	rsp.period_ns = mFreq.result.period_ns;
+	rsp.high_ns = mFreq.result.high_ns;
+	rsp.duty = mFreq.result.duty;
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = sizeof(rsp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+void RJTUSBBridgeFreq_stop(void)
+{
+	if(false == mFreq.running) {
+		return;
+	}
+
+	mFreq.running = false;
+
+	RJTEIC_disableEvent(mFreq.extint);
+
+	events_detach_user(&mEvent, EVSYS_ID_USER_TC6_EVU);
+	events_detach_user(&mEvent, EVSYS_ID_USER_TCC2_EV_0);
+	events_release(&mEvent);
+
+	RJTTimer_disable(FREQ_COUNTER_TC);
+	RJTTimer_release(FREQ_COUNTER_TC);
+	stop_edge_counter();
+}
@@ -7,6 +7,8 @@
 
 #include "rjt_external_interrupt_controller.h"
 #include "rjt_usb_bridge_app.h"
+#include "rjt_timer_wheel.h"
+#include "rjt_timer.h"
 #include "rjt_logger.h"
 #include "utils.h"
 
@@ -18,42 +20,246 @@ static uint32_t mPinInterruptStatus = 0;
 static RJTEIC_t mEICModule;
 
 
+/**
+ * Every pin interrupt also records a timestamped event. Events are
+ * pushed from the EIC interrupt and, for debounced indices, from the
+ * timestamp alarm (TC4). Both run at APP_LOW_PRIORITY, so they cannot
+ * preempt each other and together are the single writer of head. The
+ * read command is the only writer of tail, so the ring needs no
+ * critical section.
+ */
+#define GPIO_EVENT_QUEUE_LEN		128		// power of two
+#define GPIO_EVENTS_PER_READ		10
+
+struct GPIOEvent {
+	uint32_t timestamp;
+	uint8_t  index;
+	uint8_t  level;
+};
+
+static struct {
+	struct GPIOEvent events[GPIO_EVENT_QUEUE_LEN];
+	volatile uint16_t head;
+	volatile uint16_t tail;
+
+	// dropped is counted by the writer, reported by the reader
+	volatile uint16_t dropped;
+	uint16_t dropped_reported;
+} mEvents;
+
+
+static void push_event(uint32_t timestamp, uint8_t index, uint8_t gpio)
+{
+	uint16_t head = mEvents.head;
+
+	if((uint16_t) (head - mEvents.tail) >= GPIO_EVENT_QUEUE_LEN) {
+		mEvents.dropped++;
+		return;
+	}
+
+	struct GPIOEvent * event = &mEvents.events[head % GPIO_EVENT_QUEUE_LEN];
+	event->timestamp = timestamp;
+	event->index = index;
+	event->level = port_pin_get_input_level(gpio);
+
+	// the record has to be complete before the reader can see it
+	__DMB();
+	mEvents.head = head + 1;
+}
+
+
 static void set_pin_interrupt_flag(uint8_t logical_gpio_no)
 {
 	ASSERT(logical_gpio_no < 32);
 
 	system_interrupt_enter_critical_section();
 	mPinInterruptStatus |= (1 << logical_gpio_no);
-	//RJTLogger_print("logical gpio: %d", logical_gpio_no);
+	RJTLogger_trace("logical gpio: %d", logical_gpio_no);
+	system_interrupt_leave_critical_section();
+}
+
+
+static void report_event(uint32_t timestamp, uint8_t index, uint8_t gpio)
+{
+	push_event(timestamp, index, gpio);
+	set_pin_interrupt_flag(index);
+	RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_GPIO, true);
+}
+
+
+/**
+ * Debounce:
+ *
+ * A debounced index has its EIC line set to both edges, whatever the
+ * host asked for. Every edge (re)starts the index's timer on a wheel
+ * ticking every DEBOUNCE_TICK_US, so the timer only expires once the
+ * pin has been quiet for the debounce time. The level is then compared
+ * with the last settled one, and a change that matches the requested
+ * detection becomes one event, stamped with the first edge of the
+ * burst.
+ *
+ * The wheel is driven by the timestamp alarm, which only runs while a
+ * timer is armed. The alarm and the EIC interrupt have the same
+ * priority, so they share the wheel without a critical section.
+ */
+#define DEBOUNCE_TICK_US			250
+#define DEBOUNCE_MAX_US				1000000UL
+
+static struct {
+	RJTTimerWheel_t wheel;
+	uint32_t next_tick;
+	bool clock_running;
+
+	uint16_t ticks[RJT_USB_BRIDGE_NUM_GPIOS];	// 0 when not debounced
+	enum RJT_EIC_DETECTION detection[RJT_USB_BRIDGE_NUM_GPIOS];
+	bool settled_level[RJT_USB_BRIDGE_NUM_GPIOS];
+	uint32_t first_edge[RJT_USB_BRIDGE_NUM_GPIOS];
+} mDebounce;
+
+
+static void debounce_alarm(void)
+{
+	// catch up on ticks missed while other interrupts ran
+	while((int32_t) (RJTTimer_getTimestamp() - mDebounce.next_tick) >= 0)
+	{
+		RJTTimerWheel_tick(&mDebounce.wheel);
+		mDebounce.next_tick += DEBOUNCE_TICK_US;
+
+		if(RJTTimerWheel_isEmpty(&mDebounce.wheel)) {
+			mDebounce.clock_running = false;
+			return;
+		}
+	}
+
+	RJTTimer_setAlarm(mDebounce.next_tick, debounce_alarm);
+}
+
+
+static void debounce_edge(uint32_t timestamp, uint8_t index)
+{
+	if(false == RJTTimerWheel_isArmed(&mDebounce.wheel, index)) {
+		mDebounce.first_edge[index] = timestamp;
+	}
+
+	RJTTimerWheel_start(&mDebounce.wheel, index, mDebounce.ticks[index]);
+
+	if(false == mDebounce.clock_running) {
+		mDebounce.clock_running = true;
+		mDebounce.next_tick = RJTTimer_getTimestamp() + DEBOUNCE_TICK_US;
+		RJTTimer_setAlarm(mDebounce.next_tick, debounce_alarm);
+	}
+}
+
+
+static void debounce_expired(void * context, uint8_t index)
+{
+	bool success = false;
+	uint8_t gpio = 0xff;
+	uint8_t extint = 0xff;
+
+	RJTUSBBridgeConfig_index2gpio(index, &success, &gpio);
+
+	if(false == success) {
+		// taken over by a peripheral in the meantime
+		return;
+	}
+
+	RJTUSBBridgeConfig_index2extint(index, &success, &extint);
+	ASSERT(true == success);
+
+	if(0 == (EIC->INTENSET.reg & (1UL << extint))) {
+		return;
+	}
+
+	bool level = port_pin_get_input_level(gpio);
+
+	if(level == mDebounce.settled_level[index]) {
+		// a glitch, back where it was
+		return;
+	}
+
+	mDebounce.settled_level[index] = level;
+
+	if((RJT_EIC_DETECTION_RISE == mDebounce.detection[index] && false == level) ||
+	   (RJT_EIC_DETECTION_FALL == mDebounce.detection[index] && true == level)) {
+		return;
+	}
+
+	report_event(mDebounce.first_edge[index], index, gpio);
+}
+
+
+static enum RJT_EIC_DETECTION debounce_detection(uint8_t index)
+{
+	return (0 != mDebounce.ticks[index]) ? RJT_EIC_DETECTION_BOTH : mDebounce.detection[index];
+}
+
+
+/**
+ * Records the detection the host asked for and restarts debouncing
+ * from the current level. Call after configuring the EIC line, before
+ * enabling its interrupt.
+ */
+static void debounce_set_detection(uint8_t index, uint8_t gpio, enum RJT_EIC_DETECTION detection)
+{
+	system_interrupt_enter_critical_section();
+
+	RJTTimerWheel_stop(&mDebounce.wheel, index);
+	mDebounce.detection[index] = detection;
+	mDebounce.settled_level[index] = port_pin_get_input_level(gpio);
+
 	system_interrupt_leave_critical_section();
 }
 
 
 static void ext_interrupt_callback(void * self, uint8_t pinno, uint8_t intno)
 {
-	//RJTLogger_print("EIC pinno: %d extintno: %d triggered", pinno, intno);
+	uint32_t timestamp = RJTTimer_getTimestamp();
+
+	RJTLogger_trace("EIC pinno: %d extintno: %d triggered", pinno, intno);
 
 	if(pinno == PIN_PA15) 
 	{
 		// switch pin on xplained board
+		push_event(timestamp, 31, pinno);
 		set_pin_interrupt_flag(31);
 		RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_GPIO, true);
 	} 
 	else {
-		bool success = false;
-		uint8_t index = 0xff;
-		RJTUSBBridgeConfig_gpio2index(pinno, &success, &index);
+		uint8_t index = RJTUSBBridgeConfig_extint2index(intno);
 
-		if(true == success) 
-		{
-			ASSERT(0xff != index);
-			set_pin_interrupt_flag(index);
-			RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_GPIO, true);
+		if(0xff == index) {
+			RJTLogger_print("pin interrupt triggered on unknown pin: %d", pinno);
+		}
+		else if(0 != mDebounce.ticks[index]) {
+			debounce_edge(timestamp, index);
 		}
 		else {
-			RJTLogger_print("pin interrupt triggered on unknown pin: %d", pinno);
+			report_event(timestamp, index, pinno);
+		}
+	}
+}
+
+
+/**
+ * True when one of the indices' EIC lines belongs to the logic
+ * analyzer, a trigger or the frequency counter.
+ */
+static bool any_line_taken(uint32_t index_mask)
+{
+	for(uint32_t mask = index_mask; 0 != mask; mask &= mask - 1)
+	{
+		bool success = false;
+		uint8_t extint = 0xff;
+
+		RJTUSBBridgeConfig_index2extint(lowest_bit(mask), &success, &extint);
+
+		if(success && RJTEIC_isLineTaken(&mEICModule, extint, ext_interrupt_callback)) {
+			return true;
 		}
 	}
+
+	return false;
 }
 
 
@@ -88,7 +294,7 @@ return RJT_USB_ERROR_NONE;
 enum RJT_USB_ERROR RJTUSBBridgeGPIO_pinRead(const uint8_t * cmd_data, size_t cmd_len,
 		uint8_t * rsp_data, size_t * rsp_len)
 {
-	//RJTLogger_print("GPIO: pinRead()");
+	RJTLogger_trace("GPIO: pinRead()");
 	
 	// This function returns a byte in the response, make sure we have the space to do so
 	ASSERT(*rsp_len >= 1);
@@ -122,19 +328,26 @@ enum RJT_USB_ERROR RJTUSBBridgeGPIO_pinSet(const uint8_t * cmd_data, size_t cmd_
 	
 	GPIO_VERIFY_CMD_INDEX_BEGIN
 	{
-		//RJTLogger_print("GPIO: setting pin...");
+		RJTLogger_trace("GPIO: setting pin...");
 		port_pin_set_output_level(gpio, !!cmd.val);
 		*rsp_len = 0;
-		//RJTLogger_print("GPIO: Set index %d gpio %x: %?", cmd.index, gpio, cmd.val);
+		RJTLogger_trace("GPIO: Set index %d gpio %x: %?", cmd.index, gpio, cmd.val);
 	}
 	GPIO_VERIFY_CMD_INDEX_END	
 };
 
 
+static const enum RJT_EIC_DETECTION cmd2detection[] = {
+	[0] = RJT_EIC_DETECTION_FALL,
+	[1] = RJT_EIC_DETECTION_RISE,
+	[2] = RJT_EIC_DETECTION_BOTH,
+};
+
+
 enum RJT_USB_ERROR RJTUSBBridgeGPIO_enablePinInterrupt(
 		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
 {
-	//RJTLogger_print("GPIO: enablePinInterrupt()");
+	RJTLogger_trace("GPIO: enablePinInterrupt()");
 
 	RJT_USB_BRIDGE_BEGIN_CMD
 	uint8_t index;
@@ -143,17 +356,18 @@ enum RJT_USB_ERROR RJTUSBBridgeGPIO_enablePinInterrupt(
 
 	GPIO_VERIFY_CMD_INDEX_BEGIN
 	{
-		enum RJT_EIC_DETECTION cmd2detection[] = {
-			[0] = RJT_EIC_DETECTION_FALL,
-			[1] = RJT_EIC_DETECTION_RISE,
-			[2] = RJT_EIC_DETECTION_BOTH,
-		};
-		
+		if(any_line_taken(1UL << cmd.index)) {
+			*rsp_len = 0;
+			return RJT_USB_ERROR_RESOURCE_BUSY;
+		}
+
 		if(cmd.detection < ARRAY_SIZE(cmd2detection))
 		{
+			mDebounce.detection[cmd.index] = cmd2detection[cmd.detection];
+
 			RJTEICConfig_t config = {
 				.ext_int_sel = extint,
-				.eic_detection = cmd2detection[cmd.detection],
+				.eic_detection = debounce_detection(cmd.index),
 				.gpio = gpio,
 				.gpio_mux_position = 0,
 				.callback = ext_interrupt_callback,
@@ -161,6 +375,8 @@ enum RJT_USB_ERROR RJTUSBBridgeGPIO_enablePinInterrupt(
 
 			RJTEIC_configure(&mEICModule, &config);
 
+			debounce_set_detection(cmd.index, gpio, cmd2detection[cmd.detection]);
+
 			RJTEIC_enableInterrupt(extint);
 				
 			*rsp_len = 0;
@@ -177,7 +393,7 @@ enum RJT_USB_ERROR RJTUSBBridgeGPIO_enablePinInterrupt(
 enum RJT_USB_ERROR RJTUSBBridgeGPIO_disablePinInterrupt(
 		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
 {
-	//RJTLogger_print("GPIO: disablePinInterrupt()");
+	RJTLogger_trace("GPIO: disablePinInterrupt()");
 
 	RJT_USB_BRIDGE_BEGIN_CMD
 	uint8_t index;
@@ -187,6 +403,10 @@ enum RJT_USB_ERROR RJTUSBBridgeGPIO_disablePinInterrupt(
 	GPIO_VERIFY_CMD_INDEX_BEGIN
 	{
 		RJTEIC_disableInterrupt(extint);
+
+		system_interrupt_enter_critical_section();
+		RJTTimerWheel_stop(&mDebounce.wheel, cmd.index);
+		system_interrupt_leave_critical_section();
 		
 		*rsp_len = 0;
 	}
@@ -197,7 +417,7 @@ enum RJT_USB_ERROR RJTUSBBridgeGPIO_disablePinInterrupt(
 enum RJT_USB_ERROR RJTUSBBridgeGPIO_getInterruptStatus(
 		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
 {
-	//RJTLogger_print("GPIO: getInterruptStatus()");
+	RJTLogger_trace("GPIO: getInterruptStatus()");
 
 	ASSERT(*rsp_len >= sizeof(mPinInterruptStatus));
 
@@ -234,25 +454,62 @@ enum RJT_USB_ERROR RJTUSBBridgeGPIO_parallelWrite(
 	const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
 {
 	RJT_USB_BRIDGE_BEGIN_CMD
-		uint32_t index_mask;
+		uint32_t value;
+		uint32_t mask;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(0 != (cmd.mask & ~RJTUSBBridgeConfig_getAvailableIndexMask())) {
+		// mask touches an index owned by a peripheral (or out of range)
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	uint32_t set_mask = RJTUSBBridgeConfig_indexMask2PortMask(cmd.value & cmd.mask);
+	uint32_t clr_mask = RJTUSBBridgeConfig_indexMask2PortMask(~cmd.value & cmd.mask);
+
+	// OUTSET/OUTCLR only touch the bits given, so no read-modify-write of
+	// OUT is needed and pins outside the mask (or changed by an interrupt)
+	// are left alone.
+	PORTB.OUTCLR.reg = clr_mask;
+	PORTB.OUTSET.reg = set_mask;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeGPIO_parallelToggle(
+	const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint32_t mask;
 	RJT_USB_BRIDGE_END_CMD
 
-	RJTLogger_print("GPIO: parallelWrite(): %b", cmd.index_mask);
+	*rsp_len = 0;
+
+	if(0 != (cmd.mask & ~RJTUSBBridgeConfig_getAvailableIndexMask())) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	PORTB.OUTTGL.reg = RJTUSBBridgeConfig_indexMask2PortMask(cmd.mask);
+
+	return RJT_USB_ERROR_NONE;
+}
 
-	const uint32_t port_mask = ((1 << RJT_USB_BRIDGE_NUM_GPIOS) - 1);
 
-	cmd.index_mask &= port_mask;
+enum RJT_USB_ERROR RJTUSBBridgeGPIO_parallelRead(
+	const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	// pins left in powersave would read 0
+	RJTUSBBridgeConfig_enableInputs(RJTUSBBridgeConfig_getAvailableIndexMask());
 
-	uint32_t portb = PORTB.OUT.reg;
+	uint32_t levels = RJTUSBBridgeConfig_portMask2IndexMask(PORTB.IN.reg);
 
-	// Clear the port mask
-	portb &= ~port_mask;
+	ASSERT(*rsp_len >= sizeof(levels));
 
-	// Mask in the desired bits
-	portb |= port_mask;
+	memcpy(rsp_data, &levels, sizeof(levels));
 
-	// Write back to register
-	PORTB.OUT.reg = portb;
+	*rsp_len = sizeof(levels);
 
 	return RJT_USB_ERROR_NONE;
 }
@@ -332,7 +589,7 @@ enum RJT_USB_ERROR RJTUSBBridgeGPIO_configureIndex(
 enum RJT_USB_ERROR RJTUSBBridgeGPIO_setLed(
 		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
 {
-	//RJTLogger_print("GPIO: setLed()");
+	RJTLogger_trace("GPIO: setLed()");
 
 	RJT_USB_BRIDGE_BEGIN_CMD
 	uint8_t on;
@@ -345,9 +602,313 @@ enum RJT_USB_ERROR RJTUSBBridgeGPIO_setLed(
 }
 
 
-void RJTUSBBridgeGPIO_init(void)
+enum RJT_USB_ERROR RJTUSBBridgeGPIO_readEvents(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
 {
-	RJTEIC_init(&mEICModule);
+	__PACKED_STRUCT {
+		uint32_t timestamp;
+		uint8_t  index;
+		uint8_t  level;
+	} record;
+
+	uint16_t dropped = mEvents.dropped;
+	uint16_t num_dropped = dropped - mEvents.dropped_reported;
+	mEvents.dropped_reported = dropped;
+
+	ASSERT(*rsp_len >= sizeof(num_dropped) + GPIO_EVENTS_PER_READ * sizeof(record));
+
+	memcpy(rsp_data, &num_dropped, sizeof(num_dropped));
+	size_t len = sizeof(num_dropped);
+
+	uint16_t tail = mEvents.tail;
+	uint16_t num_events = MIN((uint16_t) (mEvents.head - tail), GPIO_EVENTS_PER_READ);
+
+	// see the head before reading the records behind it
+	__DMB();
+
+	for(uint16_t k = 0; k < num_events; k++)
+	{
+		const struct GPIOEvent * event = &mEvents.events[(uint16_t) (tail + k) % GPIO_EVENT_QUEUE_LEN];
+
+		record.timestamp = event->timestamp;
+		record.index = event->index;
+		record.level = event->level;
+
+		memcpy(&rsp_data[len], &record, sizeof(record));
+		len += sizeof(record);
+	}
+
+	// done with the records before handing the slots back
+	__DMB();
+	mEvents.tail = tail + num_events;
+
+	*rsp_len = len;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeGPIO_getTimestamp(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	uint32_t timestamp = RJTTimer_getTimestamp();
+
+	ASSERT(*rsp_len >= sizeof(timestamp));
+
+	memcpy(rsp_data, &timestamp, sizeof(timestamp));
+	*rsp_len = sizeof(timestamp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeGPIO_enablePinInterrupts(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint32_t index_mask;
+		uint8_t  detection;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(0 != (cmd.index_mask & ~RJTUSBBridgeConfig_getAvailableIndexMask()) ||
+	   cmd.detection >= ARRAY_SIZE(cmd2detection)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	if(any_line_taken(cmd.index_mask)) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	RJTEICConfig_t configs[RJT_USB_BRIDGE_NUM_GPIOS];
+	uint32_t extint_mask = 0;
+	size_t num_configs = 0;
+
+	for(uint32_t mask = cmd.index_mask; 0 != mask; mask &= mask - 1)
+	{
+		uint8_t index = lowest_bit(mask);
+		bool success = false;
+		uint8_t gpio = 0xff;
+		uint8_t extint = 0xff;
+
+		RJTUSBBridgeConfig_index2gpio(index, &success, &gpio);
+		ASSERT(true == success);
+
+		RJTUSBBridgeConfig_index2extint(index, &success, &extint);
+		ASSERT(true == success);
+
+		mDebounce.detection[index] = cmd2detection[cmd.detection];
+
+		configs[num_configs++] = (RJTEICConfig_t) {
+			.ext_int_sel = extint,
+			.eic_detection = debounce_detection(index),
+			.gpio = gpio,
+			.gpio_mux_position = 0,
+			.callback = ext_interrupt_callback,
+		};
+
+		extint_mask |= (1UL << extint);
+	}
+
+	if(0 == num_configs) {
+		return RJT_USB_ERROR_NONE;
+	}
+
+	RJTEIC_configureMany(&mEICModule, configs, num_configs);
+
+	for(size_t k = 0; k < num_configs; k++)
+	{
+		uint8_t index = RJTUSBBridgeConfig_extint2index(configs[k].ext_int_sel);
+		debounce_set_detection(index, configs[k].gpio, mDebounce.detection[index]);
+	}
+
+	// one write enables them all
+	EIC->INTENSET.reg = extint_mask;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeGPIO_setDebounce(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint32_t index_mask;
+		uint32_t stable_us;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(0 != (cmd.index_mask & ~RJTUSBBridgeConfig_getAvailableIndexMask()) ||
+	   cmd.stable_us > DEBOUNCE_MAX_US) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	// would change the detection under another user of the line
+	if(any_line_taken(cmd.index_mask)) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	// one extra tick, the first one may come right after the edge
+	uint16_t ticks = (0 == cmd.stable_us) ? 0 : (cmd.stable_us / DEBOUNCE_TICK_US) + 1;
+
+	RJTEICConfig_t configs[RJT_USB_BRIDGE_NUM_GPIOS];
+	uint32_t extint_mask = 0;
+	size_t num_configs = 0;
+
+	for(uint32_t mask = cmd.index_mask; 0 != mask; mask &= mask - 1)
+	{
+		uint8_t index = lowest_bit(mask);
+		bool success = false;
+		uint8_t gpio = 0xff;
+		uint8_t extint = 0xff;
+
+		RJTUSBBridgeConfig_index2gpio(index, &success, &gpio);
+		ASSERT(true == success);
+
+		RJTUSBBridgeConfig_index2extint(index, &success, &extint);
+		ASSERT(true == success);
+
+		system_interrupt_enter_critical_section();
+		RJTTimerWheel_stop(&mDebounce.wheel, index);
+		mDebounce.ticks[index] = ticks;
+		system_interrupt_leave_critical_section();
+
+		// lines already in use switch their detection now
+		if(EIC->INTENSET.reg & (1UL << extint))
+		{
+			configs[num_configs++] = (RJTEICConfig_t) {
+				.ext_int_sel = extint,
+				.eic_detection = debounce_detection(index),
+				.gpio = gpio,
+				.gpio_mux_position = 0,
+				.callback = ext_interrupt_callback,
+			};
+
+			extint_mask |= (1UL << extint);
+		}
+	}
+
+	if(0 == num_configs) {
+		return RJT_USB_ERROR_NONE;
+	}
+
+	// configuring a line disables its interrupt
+	RJTEIC_configureMany(&mEICModule, configs, num_configs);
+
+	for(size_t k = 0; k < num_configs; k++)
+	{
+		uint8_t index = RJTUSBBridgeConfig_extint2index(configs[k].ext_int_sel);
+		debounce_set_detection(index, configs[k].gpio, mDebounce.detection[index]);
+	}
+
+	EIC->INTENSET.reg = extint_mask;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeGPIO_setLatencyProbe(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t index;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	uint8_t extint = RJT_EIC_PROBE_NONE;
+
+	if(0xff != cmd.index)
+	{
+		bool success = false;
+
+		if(cmd.index >= RJT_USB_BRIDGE_NUM_GPIOS ||
+		   0 == (RJTUSBBridgeConfig_getAvailableIndexMask() & (1UL << cmd.index))) {
+			return RJT_USB_ERROR_PARAMETER;
+		}
+
+		RJTUSBBridgeConfig_index2extint(cmd.index, &success, &extint);
+		ASSERT(true == success);
+	}
+
+	RJTEIC_setLatencyProbe(&mEICModule, extint);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeGPIO_getEICStats(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t reset;
+	RJT_USB_BRIDGE_END_CMD
+
+	__PACKED_STRUCT {
+		uint32_t interrupts;
+		uint32_t events;
+		uint32_t latency_count;
+		uint32_t latency_min_ns;
+		uint32_t latency_max_ns;
+		uint32_t latency_avg_ns;
+	} rsp = {0};
+
+	ASSERT(*rsp_len >= sizeof(rsp));
+
+	RJTEICStats_t stats;
+	RJTEIC_getStats(&mEICModule, &stats, !!cmd.reset);
+
+	rsp.interrupts = stats.interrupts;
+	rsp.events = stats.events;
+	rsp.latency_count = stats.latency_count;
+	rsp.latency_min_ns = stats.latency_min_ns;
+	rsp.latency_max_ns = stats.latency_max_ns;
+
+	if(stats.latency_count > 0) {
+		rsp.latency_avg_ns = (uint32_t) (stats.latency_sum_ns / stats.latency_count);
+	}
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = sizeof(rsp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+RJTEIC_t * RJTUSBBridgeGPIO_getEICModule(void)
+{
+	return &mEICModule;
+}
+
+
+/**
+ * Called on a host reset, drops all debounce settings.
+ */
+void RJTUSBBridgeGPIO_reset(void)
+{
+	system_interrupt_enter_critical_section();
+
+	RJTTimer_cancelAlarm();
+	RJTTimerWheel_init(&mDebounce.wheel, debounce_expired, NULL);
+	mDebounce.clock_running = false;
+	memset(mDebounce.ticks, 0, sizeof(mDebounce.ticks));
+
+	system_interrupt_leave_critical_section();
+}
+
+
+/**
+ * The button pin (PA15) doubles as the UART bridge CTS, which takes
+ * it over while flow control is on.
+ */
+void RJTUSBBridgeGPIO_enableButton(bool enable)
+{
+	if(false == enable) {
+		RJTEIC_disableInterrupt(RJT_EIC_EXT_INT15);
+		return;
+	}
 
 	RJTEICConfig_t config = {
 		.ext_int_sel = RJT_EIC_EXT_INT15,
@@ -360,4 +921,14 @@ void RJTUSBBridgeGPIO_init(void)
 	RJTEIC_configure(&mEICModule, &config);
 
 	RJTEIC_enableInterrupt(RJT_EIC_EXT_INT15);
+}
+
+
+void RJTUSBBridgeGPIO_init(void)
+{
+	RJTEIC_init(&mEICModule);
+
+	RJTTimerWheel_init(&mDebounce.wheel, debounce_expired, NULL);
+
+	RJTUSBBridgeGPIO_enableButton(true);
 }
\ No newline at end of file
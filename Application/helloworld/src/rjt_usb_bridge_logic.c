@@ -0,0 +1,753 @@
+/*
+ * rjt_usb_bridge_logic.c
+ */
+
+#include "rjt_external_interrupt_controller.h"
+#include "rjt_usb_bridge_app.h"
+#include "rjt_timer.h"
+#include "rjt_logger.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <asf.h>
+
+/**
+ * Logic analyzer:
+ *
+ * TC3 overflows at the sample rate and triggers a DMA beat that copies
+ * the lower half of PORTB.IN into a ring of LOGIC_NUM_BLOCKS blocks.
+ * Every completed block raises an interrupt, which is where the capture
+ * is stopped once enough samples have been taken after the trigger.
+ *
+ * The trigger is an EIC edge on one of the gpio indices (or the host
+ * forcing it). The trigger position is the DMA write position read in
+ * the EIC interrupt, so it lags the edge by the interrupt latency.
+ *
+ * Raw mode keeps every sample in the ring. RLE mode shrinks the DMA
+ * ring to a small staging area and compresses each completed block
+ * into (sample, count) runs, which stretches a slowly changing capture
+ * over far more samples than the RAM could hold raw.
+ *
+ * Samples are kept in port space and converted to gpio index space
+ * when they are read out.
+ */
+
+#define LOGIC_BUF_BYTES				8192
+#define LOGIC_BUF_LEN				(LOGIC_BUF_BYTES / sizeof(uint16_t))
+#define LOGIC_NUM_BLOCKS			8
+#define LOGIC_MAX_RATE_HZ			2000000UL
+
+// Raw: the DMA ring is the whole buffer. Two blocks are kept free so
+// the DMA never reaches the oldest wanted sample before it is stopped.
+#define LOGIC_RAW_BLOCK_LEN			(LOGIC_BUF_LEN / LOGIC_NUM_BLOCKS)
+#define LOGIC_RAW_MAX_WINDOW		(LOGIC_BUF_LEN - 2 * LOGIC_RAW_BLOCK_LEN)
+
+// RLE: small staging ring for the DMA, the rest of the buffer holds runs
+#define LOGIC_RLE_BLOCK_LEN			64
+#define LOGIC_RLE_STAGING_LEN		(LOGIC_RLE_BLOCK_LEN * LOGIC_NUM_BLOCKS)
+#define LOGIC_RLE_MAX_RUNS			((LOGIC_BUF_BYTES - LOGIC_RLE_STAGING_LEN * sizeof(uint16_t)) / sizeof(LogicRun_t))
+#define LOGIC_RLE_MAX_RATE_HZ		250000UL
+
+#define LOGIC_NO_TRIGGER			0xff
+#define LOGIC_FLAG_RLE				0x01
+
+// Samples / runs that fit in one response
+#define LOGIC_READ_MAX_BYTES		60
+
+
+enum LOGIC_STATE {
+	LOGIC_STATE_IDLE      = 0,
+	LOGIC_STATE_ARMED     = 1,
+	LOGIC_STATE_TRIGGERED = 2,
+	LOGIC_STATE_DONE      = 3,
+	LOGIC_STATE_OVERRUN   = 4,
+};
+
+enum LOGIC_CONTROL {
+	LOGIC_CONTROL_STOP    = 0,
+	LOGIC_CONTROL_ARM     = 1,
+	LOGIC_CONTROL_TRIGGER = 2,
+};
+
+
+struct LogicRun {
+	uint16_t sample;
+	uint16_t count;
+};
+
+typedef struct LogicRun LogicRun_t;
+
+
+static union {
+	uint16_t samples[LOGIC_BUF_LEN];
+
+	struct {
+		uint16_t staging[LOGIC_RLE_STAGING_LEN];
+		LogicRun_t runs[LOGIC_RLE_MAX_RUNS];
+	} rle;
+} mBuf;
+
+
+static struct {
+	RJTTimerPeriod_t period;
+	volatile enum LOGIC_STATE state;
+	bool configured;
+	bool rle;
+
+	uint32_t port_mask;
+	size_t block_len;
+
+	uint32_t pre_samples;
+	uint32_t post_samples;
+
+	// trigger source, extint is only valid with a trigger index
+	uint8_t trigger_index;
+	uint8_t trigger_edge;
+	uint8_t trigger_gpio;
+	uint8_t trigger_extint;
+
+	// sample numbers count from 0 at arm time
+	volatile uint32_t blocks_done;
+	uint32_t trigger_sample;
+
+	// rle: ring of runs, runs[head - num_runs] is the oldest one
+	size_t run_head;
+	size_t num_runs;
+	uint32_t first_run_sample;
+	uint32_t compressed_samples;
+
+	// result window, valid in LOGIC_STATE_DONE
+	uint32_t window_start;
+	uint32_t window_len;
+	uint32_t num_items;
+	size_t first_run;
+	uint16_t first_run_skip;
+	uint16_t last_run_trim;
+} mLogic;
+
+
+static struct dma_resource mDMA;
+
+static COMPILER_ALIGNED(16)
+DmacDescriptor mDMADescriptors[LOGIC_NUM_BLOCKS] SECTION_DMAC_DESCRIPTOR;
+
+extern DmacDescriptor _write_back_section[CONF_MAX_USED_CHANNEL_NUM];
+
+
+static uint16_t port2sample(uint16_t port)
+{
+	return (uint16_t) RJTUSBBridgeConfig_portMask2IndexMask(port & mLogic.port_mask);
+}
+
+
+/**
+ * Beats left in the block the channel is working on. ACTIVE only
+ * holds the count for the channel currently on the bus, every other
+ * channel has it in the write back descriptor.
+ */
+static uint16_t dma_remaining(uint8_t channel)
+{
+	if(DMAC->ACTIVE.bit.ABUSY && channel == DMAC->ACTIVE.bit.ID) {
+		return DMAC->ACTIVE.bit.BTCNT;
+	}
+
+	return _write_back_section[channel].BTCNT.reg;
+}
+
+
+/**
+ * Number of samples the DMA has written since arming. A block that
+ * completed but whose interrupt has not been serviced yet is counted
+ * from the pending flag. Must be called with interrupts disabled.
+ */
+static uint32_t samples_written(void)
+{
+	uint32_t channel_bit = (1UL << mDMA.channel_id);
+	uint32_t pending;
+	uint16_t remaining;
+
+	do {
+		pending = DMAC->INTSTATUS.reg & channel_bit;
+		remaining = dma_remaining(mDMA.channel_id);
+	} while(pending != (DMAC->INTSTATUS.reg & channel_bit));
+
+	uint32_t blocks = mLogic.blocks_done + (pending ? 1 : 0);
+	uint32_t in_block = (0 == remaining) ? 0 : mLogic.block_len - remaining;
+
+	return blocks * mLogic.block_len + in_block;
+}
+
+
+static void create_descriptor(DmacDescriptor * desc, uint16_t * dst,
+		size_t len, DmacDescriptor * next)
+{
+	struct dma_descriptor_config desc_config;
+	dma_descriptor_get_config_defaults(&desc_config);
+
+	desc_config.beat_size = DMA_BEAT_SIZE_HWORD;
+	desc_config.block_action = DMA_BLOCK_ACTION_INT;
+
+	// lower half word of PORTB.IN holds PB00..PB15
+	desc_config.src_increment_enable = false;
+	desc_config.source_address = (uint32_t) &PORTB.IN.reg;
+
+	// the DMAC wants the end address of an incrementing buffer
+	desc_config.dst_increment_enable = true;
+	desc_config.destination_address = (uint32_t) dst + len * sizeof(uint16_t);
+
+	desc_config.block_transfer_count = len;
+	desc_config.next_descriptor_address = (uint32_t) next;
+
+	dma_descriptor_create(desc, &desc_config);
+}
+
+
+static LogicRun_t * oldest_run(void)
+{
+	return &mBuf.rle.runs[(mLogic.run_head + LOGIC_RLE_MAX_RUNS - mLogic.num_runs) % LOGIC_RLE_MAX_RUNS];
+}
+
+
+static void push_run(uint16_t sample)
+{
+	if(LOGIC_RLE_MAX_RUNS == mLogic.num_runs)
+	{
+		// drop the oldest run
+		mLogic.first_run_sample += oldest_run()->count;
+		mLogic.num_runs--;
+	}
+
+	mBuf.rle.runs[mLogic.run_head].sample = sample;
+	mBuf.rle.runs[mLogic.run_head].count = 1;
+
+	mLogic.run_head = (mLogic.run_head + 1) % LOGIC_RLE_MAX_RUNS;
+	mLogic.num_runs++;
+}
+
+
+/**
+ * First sample of the pre trigger part of the window.
+ */
+static uint32_t pre_trigger_start(void)
+{
+	return mLogic.trigger_sample - MIN(mLogic.pre_samples, mLogic.trigger_sample);
+}
+
+
+/**
+ * Appends a staging block to the runs, which are a ring until the
+ * trigger. Returns false when the runs are full and making room would
+ * throw away samples inside the window.
+ */
+static bool compress_block(const uint16_t * src, size_t len)
+{
+	for(size_t k = 0; k < len; k++)
+	{
+		uint16_t sample = src[k] & mLogic.port_mask;
+
+		if(mLogic.num_runs > 0)
+		{
+			LogicRun_t * last = &mBuf.rle.runs[(mLogic.run_head + LOGIC_RLE_MAX_RUNS - 1) % LOGIC_RLE_MAX_RUNS];
+
+			if(last->sample == sample && last->count < UINT16_MAX) {
+				last->count++;
+				mLogic.compressed_samples++;
+				continue;
+			}
+		}
+
+		if(LOGIC_RLE_MAX_RUNS == mLogic.num_runs &&
+		   LOGIC_STATE_TRIGGERED == mLogic.state &&
+		   mLogic.first_run_sample + oldest_run()->count > pre_trigger_start()) {
+			return false;
+		}
+
+		push_run(sample);
+		mLogic.compressed_samples++;
+	}
+
+	return true;
+}
+
+
+/**
+ * Works out which runs cover the result window, trimming the first
+ * and last one to the window edges.
+ */
+static void locate_runs(void)
+{
+	uint32_t window_end = mLogic.window_start + mLogic.window_len;
+	uint32_t pos = mLogic.first_run_sample;
+	size_t tail = oldest_run() - mBuf.rle.runs;
+
+	mLogic.num_items = 0;
+	mLogic.first_run_skip = 0;
+	mLogic.last_run_trim = 0;
+
+	for(size_t k = 0; k < mLogic.num_runs && pos < window_end; k++)
+	{
+		size_t idx = (tail + k) % LOGIC_RLE_MAX_RUNS;
+		uint32_t count = mBuf.rle.runs[idx].count;
+
+		if(pos + count > mLogic.window_start)
+		{
+			if(0 == mLogic.num_items) {
+				mLogic.first_run = idx;
+				mLogic.first_run_skip = (pos < mLogic.window_start) ? mLogic.window_start - pos : 0;
+			}
+
+			mLogic.num_items++;
+
+			if(pos + count > window_end) {
+				mLogic.last_run_trim = pos + count - window_end;
+			}
+		}
+
+		pos += count;
+	}
+}
+
+
+static void finish_capture(uint32_t end_sample)
+{
+	uint32_t pre = MIN(mLogic.pre_samples, mLogic.trigger_sample);
+	uint32_t post = MIN(mLogic.post_samples, end_sample - mLogic.trigger_sample);
+
+	if(mLogic.rle) {
+		// only what survived in the runs is available
+		pre = MIN(pre, mLogic.trigger_sample - mLogic.first_run_sample);
+	}
+
+	mLogic.window_start = mLogic.trigger_sample - pre;
+	mLogic.window_len = pre + post;
+
+	if(mLogic.rle) {
+		locate_runs();
+	}
+	else {
+		mLogic.num_items = mLogic.window_len;
+	}
+}
+
+
+static void stop_capture(enum LOGIC_STATE new_state)
+{
+	system_interrupt_enter_critical_section();
+
+	RJTTimer_disable(RJT_TIMER_TC3);
+	RJTTimer_release(RJT_TIMER_TC3);
+	dma_abort_job(&mDMA);
+
+	if(LOGIC_NO_TRIGGER != mLogic.trigger_index) {
+		RJTEIC_disableInterrupt(mLogic.trigger_extint);
+	}
+
+	mLogic.state = new_state;
+
+	system_interrupt_leave_critical_section();
+}
+
+
+static void set_trigger(uint32_t sample)
+{
+	mLogic.trigger_sample = sample;
+	mLogic.state = LOGIC_STATE_TRIGGERED;
+}
+
+
+static void trigger_callback(void * self, uint8_t pinno, uint8_t intno)
+{
+	// Single shot
+	RJTEIC_disableInterrupt(intno);
+
+	system_interrupt_enter_critical_section();
+
+	if(LOGIC_STATE_ARMED == mLogic.state) {
+		set_trigger(samples_written());
+	}
+
+	system_interrupt_leave_critical_section();
+}
+
+
+static void transfer_done_callback(struct dma_resource * const resource)
+{
+	uint32_t block = mLogic.blocks_done++;
+	uint32_t end = mLogic.blocks_done * mLogic.block_len;
+
+	if(mLogic.rle)
+	{
+		const uint16_t * src = &mBuf.rle.staging[(block % LOGIC_NUM_BLOCKS) * mLogic.block_len];
+
+		bool fits = compress_block(src, mLogic.block_len);
+
+		if(samples_written() - end >= LOGIC_RLE_STAGING_LEN - mLogic.block_len) {
+			// the DMA came around before the block was compressed
+			stop_capture(LOGIC_STATE_OVERRUN);
+			RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_LOGIC, true);
+			return;
+		}
+
+		if(false == fits) {
+			// out of room for runs, keep the post trigger samples that fit
+			stop_capture(LOGIC_STATE_DONE);
+			finish_capture(mLogic.compressed_samples);
+			RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_LOGIC, true);
+			return;
+		}
+	}
+
+	if(LOGIC_STATE_TRIGGERED == mLogic.state &&
+	   end - mLogic.trigger_sample >= mLogic.post_samples)
+	{
+		stop_capture(LOGIC_STATE_DONE);
+		finish_capture(end);
+		RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_LOGIC, true);
+	}
+}
+
+
+static void init_dmac(void)
+{
+	struct dma_resource_config config;
+	dma_get_config_defaults(&config);
+
+	config.peripheral_trigger = TC3_DMAC_ID_OVF;
+	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
+
+	enum status_code ret = dma_allocate(&mDMA, &config);
+	ASSERT(STATUS_OK == ret);
+
+	dma_register_callback(&mDMA, transfer_done_callback, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&mDMA, DMA_CALLBACK_TRANSFER_DONE);
+}
+
+
+static enum RJT_USB_ERROR arm_capture(void)
+{
+	if(LOGIC_NO_TRIGGER != mLogic.trigger_index &&
+	   RJTEIC_isLineTaken(RJTUSBBridgeGPIO_getEICModule(), mLogic.trigger_extint, trigger_callback)) {
+		// a pin interrupt, a trigger or the frequency counter owns the line
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	if(false == RJTTimer_claim(RJT_TIMER_TC3)) {
+		// the pattern generator is running
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	uint16_t * ring = mLogic.rle ? mBuf.rle.staging : mBuf.samples;
+
+	for(uint8_t k = 0; k < LOGIC_NUM_BLOCKS; k++) {
+		create_descriptor(&mDMADescriptors[k], &ring[k * mLogic.block_len], mLogic.block_len,
+			&mDMADescriptors[(k + 1) % LOGIC_NUM_BLOCKS]);
+	}
+
+	// gpio pins default to powersave, which reads 0; done here rather
+	// than at configure time as a setConfig in between resets them
+	RJTUSBBridgeConfig_enableInputs(RJTUSBBridgeConfig_portMask2IndexMask(mLogic.port_mask));
+
+	mLogic.blocks_done = 0;
+	mLogic.trigger_sample = 0;
+	mLogic.run_head = 0;
+	mLogic.num_runs = 0;
+	mLogic.first_run_sample = 0;
+	mLogic.compressed_samples = 0;
+	mLogic.num_items = 0;
+
+	dma_reset_descriptor(&mDMA);
+	dma_add_descriptor(&mDMA, &mDMADescriptors[0]);
+
+	enum status_code ret = dma_start_transfer_job(&mDMA);
+
+	if(STATUS_OK != ret) {
+		RJTLogger_print("LOGIC: dma start failed: %d", ret);
+		RJTTimer_release(RJT_TIMER_TC3);
+		return RJT_USB_ERROR_OPERATION_FAILED;
+	}
+
+	if(LOGIC_NO_TRIGGER == mLogic.trigger_index)
+	{
+		// capture starts right away
+		set_trigger(0);
+	}
+	else
+	{
+		mLogic.state = LOGIC_STATE_ARMED;
+
+		RJTEICConfig_t config = {
+			.ext_int_sel = mLogic.trigger_extint,
+			.eic_detection = mLogic.trigger_edge,
+			.gpio = mLogic.trigger_gpio,
+			.gpio_mux_position = 0,
+			.callback = trigger_callback,
+		};
+
+		RJTEIC_configure(RJTUSBBridgeGPIO_getEICModule(), &config);
+		RJTEIC_enableInterrupt(mLogic.trigger_extint);
+	}
+
+	RJTTimer_startPeriodic(RJT_TIMER_TC3, &mLogic.period);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+static bool is_capturing(void)
+{
+	return LOGIC_STATE_ARMED == mLogic.state || LOGIC_STATE_TRIGGERED == mLogic.state;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeLogic_configure(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint32_t rate_hz;
+		uint32_t index_mask;
+		uint32_t pre_samples;
+		uint32_t post_samples;
+		uint8_t  trigger_index;
+		uint8_t  trigger_edge;
+		uint8_t  flags;
+	RJT_USB_BRIDGE_END_CMD
+
+	uint32_t actual_rate = 0;
+
+	ASSERT(*rsp_len >= sizeof(actual_rate));
+	*rsp_len = 0;
+
+	if(is_capturing()) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	bool rle = (0 != (cmd.flags & LOGIC_FLAG_RLE));
+
+	if(0 == cmd.index_mask ||
+	   0 == cmd.post_samples ||
+	   0 != (cmd.index_mask & ~RJTUSBBridgeConfig_getAvailableIndexMask()) ||
+	   cmd.rate_hz > (rle ? LOGIC_RLE_MAX_RATE_HZ : LOGIC_MAX_RATE_HZ))
+	{
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	if(false == rle && cmd.pre_samples + (uint64_t) cmd.post_samples > LOGIC_RAW_MAX_WINDOW) {
+		return RJT_USB_ERROR_NO_MEMORY;
+	}
+
+	// Same encoding as USB_CMD_GPIO_ENABLE_PIN_INTERRUPT
+	enum RJT_EIC_DETECTION cmd2detection[] = {
+		[0] = RJT_EIC_DETECTION_FALL,
+		[1] = RJT_EIC_DETECTION_RISE,
+		[2] = RJT_EIC_DETECTION_BOTH,
+	};
+
+	if(LOGIC_NO_TRIGGER == cmd.trigger_index)
+	{
+		if(0 != cmd.pre_samples) {
+			// nothing to be before
+			return RJT_USB_ERROR_PARAMETER;
+		}
+	}
+	else
+	{
+		bool success = false;
+
+		if(cmd.trigger_edge >= ARRAY_SIZE(cmd2detection)) {
+			return RJT_USB_ERROR_PARAMETER;
+		}
+
+		RJTUSBBridgeConfig_index2gpio(cmd.trigger_index, &success, &mLogic.trigger_gpio);
+		if(false == success) {
+			return RJT_USB_ERROR_PARAMETER;
+		}
+
+		success = false;
+		RJTUSBBridgeConfig_index2extint(cmd.trigger_index, &success, &mLogic.trigger_extint);
+		if(false == success) {
+			return RJT_USB_ERROR_PARAMETER;
+		}
+
+		if(RJTEIC_isLineTaken(RJTUSBBridgeGPIO_getEICModule(), mLogic.trigger_extint, trigger_callback)) {
+			// in use by another feature
+			return RJT_USB_ERROR_RESOURCE_BUSY;
+		}
+
+		mLogic.trigger_edge = cmd2detection[cmd.trigger_edge];
+	}
+
+	if(false == RJTTimer_rate2period(cmd.rate_hz, &mLogic.period)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	mLogic.rle = rle;
+	mLogic.block_len = rle ? LOGIC_RLE_BLOCK_LEN : LOGIC_RAW_BLOCK_LEN;
+	mLogic.port_mask = RJTUSBBridgeConfig_indexMask2PortMask(cmd.index_mask);
+	mLogic.pre_samples = cmd.pre_samples;
+	mLogic.post_samples = cmd.post_samples;
+	mLogic.trigger_index = cmd.trigger_index;
+	mLogic.num_items = 0;
+	mLogic.state = LOGIC_STATE_IDLE;
+	mLogic.configured = true;
+
+	actual_rate = RJTTimer_period2rate(&mLogic.period);
+
+	memcpy(rsp_data, &actual_rate, sizeof(actual_rate));
+	*rsp_len = sizeof(actual_rate);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeLogic_control(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t action;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	switch(cmd.action)
+	{
+		case LOGIC_CONTROL_STOP:
+			RJTUSBBridgeLogic_stop();
+			return RJT_USB_ERROR_NONE;
+
+		case LOGIC_CONTROL_ARM:
+			if(false == mLogic.configured) {
+				return RJT_USB_ERROR_STATE;
+			}
+			if(is_capturing()) {
+				return RJT_USB_ERROR_RESOURCE_BUSY;
+			}
+			return arm_capture();
+
+		case LOGIC_CONTROL_TRIGGER: {
+			enum RJT_USB_ERROR ret = RJT_USB_ERROR_STATE;
+
+			system_interrupt_enter_critical_section();
+
+			if(LOGIC_STATE_ARMED == mLogic.state) {
+				RJTEIC_disableInterrupt(mLogic.trigger_extint);
+				set_trigger(samples_written());
+				ret = RJT_USB_ERROR_NONE;
+			}
+
+			system_interrupt_leave_critical_section();
+
+			return ret;
+		}
+
+		default:
+			return RJT_USB_ERROR_PARAMETER;
+	}
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeLogic_getStatus(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	__PACKED_STRUCT {
+		uint8_t  state;
+		uint8_t  flags;
+		uint32_t num_items;
+		uint32_t num_samples;
+		uint32_t trigger_offset;
+	} rsp = {0};
+
+	ASSERT(*rsp_len >= sizeof(rsp));
+
+	system_interrupt_enter_critical_section();
+
+	rsp.state = mLogic.state;
+	rsp.flags = mLogic.rle ? LOGIC_FLAG_RLE : 0;
+
+	if(LOGIC_STATE_DONE == mLogic.state) {
+		rsp.num_items = mLogic.num_items;
+		rsp.num_samples = mLogic.window_len;
+		rsp.trigger_offset = mLogic.trigger_sample - mLogic.window_start;
+	}
+
+	RJTUSBBridge_clearInterruptBit(RJT_USB_INTERRUPT_BIT_LOGIC, true);
+
+	system_interrupt_leave_critical_section();
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = sizeof(rsp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeLogic_read(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint32_t offset;
+	RJT_USB_BRIDGE_END_CMD
+
+	ASSERT(*rsp_len >= LOGIC_READ_MAX_BYTES);
+	*rsp_len = 0;
+
+	if(LOGIC_STATE_DONE != mLogic.state) {
+		return RJT_USB_ERROR_STATE;
+	}
+
+	size_t len = 0;
+
+	for(uint32_t k = cmd.offset; k < mLogic.num_items; k++)
+	{
+		if(mLogic.rle)
+		{
+			if(len + sizeof(LogicRun_t) > LOGIC_READ_MAX_BYTES) {
+				break;
+			}
+
+			LogicRun_t run = mBuf.rle.runs[(mLogic.first_run + k) % LOGIC_RLE_MAX_RUNS];
+
+			if(0 == k) {
+				run.count -= mLogic.first_run_skip;
+			}
+			if(mLogic.num_items - 1 == k) {
+				run.count -= mLogic.last_run_trim;
+			}
+
+			run.sample = port2sample(run.sample);
+
+			memcpy(&rsp_data[len], &run, sizeof(run));
+			len += sizeof(run);
+		}
+		else
+		{
+			if(len + sizeof(uint16_t) > LOGIC_READ_MAX_BYTES) {
+				break;
+			}
+
+			uint16_t sample = port2sample(mBuf.samples[(mLogic.window_start + k) % LOGIC_BUF_LEN]);
+
+			memcpy(&rsp_data[len], &sample, sizeof(sample));
+			len += sizeof(sample);
+		}
+	}
+
+	*rsp_len = len;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+void RJTUSBBridgeLogic_stop(void)
+{
+	if(is_capturing()) {
+		stop_capture(LOGIC_STATE_IDLE);
+	}
+}
+
+
+void RJTUSBBridgeLogic_init(void)
+{
+	memset(&mLogic, 0, sizeof(mLogic));
+
+	init_dmac();
+}
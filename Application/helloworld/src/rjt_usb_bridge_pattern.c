@@ -0,0 +1,495 @@
+/*
+ * rjt_usb_bridge_pattern.c
+ */
+
+#include "rjt_usb_bridge_app.h"
+#include "rjt_timer.h"
+#include "rjt_logger.h"
+#include "utils.h"
+
+#include <port.h>
+#include <stdbool.h>
+#include <asf.h>
+
+/**
+ * Pattern generator:
+ *
+ * TC3 overflows at the sample rate and triggers a DMA beat that copies
+ * the next 16 bit word of mPattern.buf into the lower half of
+ * PORTB.OUTTGL. Samples are converted from gpio index space into the
+ * port bits that change from the sample before when they are written,
+ * so the DMA copies them without any CPU involvement and pins outside
+ * the pattern are never written.
+ *
+ * Toggles only work from a known level, so starting drives the pattern
+ * pins to the level the first sample is relative to: one shot starts
+ * from the current level, loop from the last sample and stream from the
+ * level before the first sample of the first half.
+ *
+ * Streaming uses the buffer as two halves linked in a ring. Each time
+ * a half has been played the host is notified and must refill it before
+ * the other half runs out. A played half's descriptor is invalidated
+ * until it is refilled, so on an underrun the DMA halts on the fetch
+ * instead of playing the stale toggles again, and the generator stops.
+ */
+
+#define PATTERN_BUF_LEN			512
+#define PATTERN_HALF_LEN		(PATTERN_BUF_LEN / 2)
+#define PATTERN_MAX_RATE_HZ		2000000UL
+
+
+enum PATTERN_MODE {
+	PATTERN_MODE_ONE_SHOT = 0,
+	PATTERN_MODE_LOOP     = 1,
+	PATTERN_MODE_STREAM   = 2,
+	PATTERN_MODE_MAX,
+};
+
+enum PATTERN_STATE {
+	PATTERN_STATE_IDLE     = 0,
+	PATTERN_STATE_RUNNING  = 1,
+	PATTERN_STATE_DONE     = 2,
+	PATTERN_STATE_UNDERRUN = 3,
+};
+
+enum PATTERN_CONTROL {
+	PATTERN_CONTROL_STOP  = 0,
+	PATTERN_CONTROL_START = 1,
+};
+
+
+static struct {
+	uint16_t buf[PATTERN_BUF_LEN];
+
+	RJTTimerPeriod_t period;
+	enum PATTERN_MODE mode;
+	volatile enum PATTERN_STATE state;
+	bool configured;
+
+	// indices driven by the generator, as port bits too
+	uint32_t index_mask;
+	uint16_t port_mask;
+
+	// port level of the first and the last sample written, and of the
+	// sample before each stream half
+	uint16_t first_port;
+	uint16_t last_port;
+	uint16_t half_ref[2];
+
+	// one shot / loop: number of samples written so far
+	size_t num_samples;
+
+	// stream: which half is being refilled and how far along it is
+	volatile bool half_ready[2];
+	uint8_t fill_half;
+	size_t fill_pos;
+
+	volatile uint32_t blocks_played;
+	volatile uint32_t underruns;
+} mPattern;
+
+
+static struct dma_resource mDMA;
+
+static COMPILER_ALIGNED(16)
+DmacDescriptor mDMADescriptors[2] SECTION_DMAC_DESCRIPTOR;
+
+
+static uint16_t sample2port(uint16_t sample)
+{
+	return (uint16_t) RJTUSBBridgeConfig_indexMask2PortMask(sample & mPattern.index_mask);
+}
+
+
+/**
+ * Drives the pattern pins to level, leaving every other pin alone.
+ */
+static void set_pattern_level(uint16_t level)
+{
+	PORTB.OUTCLR.reg = mPattern.port_mask & ~level;
+	PORTB.OUTSET.reg = mPattern.port_mask & level;
+}
+
+
+static void create_descriptor(DmacDescriptor * desc, const uint16_t * src,
+		size_t len, DmacDescriptor * next, bool interrupt)
+{
+	struct dma_descriptor_config desc_config;
+	dma_descriptor_get_config_defaults(&desc_config);
+
+	desc_config.beat_size = DMA_BEAT_SIZE_HWORD;
+	desc_config.block_action = interrupt ? DMA_BLOCK_ACTION_INT : DMA_BLOCK_ACTION_NOACT;
+
+	// the DMAC wants the end address of an incrementing buffer
+	desc_config.src_increment_enable = true;
+	desc_config.source_address = (uint32_t) src + len * sizeof(uint16_t);
+
+	// lower half word of PORTB.OUTTGL toggles PB00..PB15
+	desc_config.dst_increment_enable = false;
+	desc_config.destination_address = (uint32_t) &PORTB.OUTTGL.reg;
+
+	desc_config.block_transfer_count = len;
+	desc_config.next_descriptor_address = (uint32_t) next;
+
+	dma_descriptor_create(desc, &desc_config);
+}
+
+
+static void stop_generator(enum PATTERN_STATE new_state)
+{
+	system_interrupt_enter_critical_section();
+
+	RJTTimer_disable(RJT_TIMER_TC3);
+	RJTTimer_release(RJT_TIMER_TC3);
+	dma_abort_job(&mDMA);
+
+	mPattern.state = new_state;
+
+	system_interrupt_leave_critical_section();
+}
+
+
+static void transfer_done_callback(struct dma_resource * const resource)
+{
+	switch(mPattern.mode)
+	{
+		case PATTERN_MODE_ONE_SHOT:
+			mPattern.blocks_played++;
+			stop_generator(PATTERN_STATE_DONE);
+			break;
+
+		case PATTERN_MODE_STREAM: {
+			// the half that just finished can be refilled by the host
+			uint8_t played_half = mPattern.blocks_played % 2;
+			mPattern.blocks_played++;
+			mPattern.half_ready[played_half] = false;
+			mDMADescriptors[played_half].BTCTRL.bit.VALID = 0;
+
+			// The refill may have landed after the DMA already fetched the
+			// invalid descriptor, so check the fetch error too
+			DMAC->CHID.reg = DMAC_CHID_ID(resource->channel_id);
+			bool fetch_error = DMAC->CHSTATUS.bit.FERR;
+
+			if(false == mPattern.half_ready[played_half ^ 1] || fetch_error) {
+				// The DMA halted on a half that was never refilled
+				mPattern.underruns++;
+				stop_generator(PATTERN_STATE_UNDERRUN);
+			}
+		} break;
+
+		default:
+			// loop mode does not interrupt
+			return;
+	}
+
+	RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_PATTERN, true);
+}
+
+
+static void init_dmac(void)
+{
+	struct dma_resource_config config;
+	dma_get_config_defaults(&config);
+
+	config.peripheral_trigger = TC3_DMAC_ID_OVF;
+	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
+
+	enum status_code ret = dma_allocate(&mDMA, &config);
+	ASSERT(STATUS_OK == ret);
+
+	dma_register_callback(&mDMA, transfer_done_callback, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&mDMA, DMA_CALLBACK_TRANSFER_DONE);
+}
+
+
+static enum RJT_USB_ERROR start_generator(void)
+{
+	switch(mPattern.mode)
+	{
+		case PATTERN_MODE_ONE_SHOT:
+		case PATTERN_MODE_LOOP: {
+			if(0 == mPattern.num_samples) {
+				return RJT_USB_ERROR_STATE;
+			}
+
+			bool loop = (PATTERN_MODE_LOOP == mPattern.mode);
+
+			// the first sample follows the last one when looping
+			uint16_t start_level = loop ? mPattern.last_port : (PORTB.OUT.reg & mPattern.port_mask);
+
+			set_pattern_level(start_level);
+			mPattern.buf[0] = mPattern.first_port ^ start_level;
+
+			create_descriptor(&mDMADescriptors[0], mPattern.buf, mPattern.num_samples,
+				loop ? &mDMADescriptors[0] : NULL, !loop);
+		} break;
+
+		case PATTERN_MODE_STREAM: {
+			if(false == mPattern.half_ready[0] || false == mPattern.half_ready[1]) {
+				// both halves have to be primed before starting
+				return RJT_USB_ERROR_STATE;
+			}
+
+			set_pattern_level(mPattern.half_ref[0]);
+
+			create_descriptor(&mDMADescriptors[0], &mPattern.buf[0], PATTERN_HALF_LEN,
+				&mDMADescriptors[1], true);
+			create_descriptor(&mDMADescriptors[1], &mPattern.buf[PATTERN_HALF_LEN], PATTERN_HALF_LEN,
+				&mDMADescriptors[0], true);
+		} break;
+
+		default:
+			return RJT_USB_ERROR_STATE;
+	}
+
+	if(false == RJTTimer_claim(RJT_TIMER_TC3)) {
+		// the logic analyzer is sampling
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	mPattern.blocks_played = 0;
+
+	dma_reset_descriptor(&mDMA);
+	dma_add_descriptor(&mDMA, &mDMADescriptors[0]);
+
+	enum status_code ret = dma_start_transfer_job(&mDMA);
+
+	if(STATUS_OK != ret) {
+		RJTLogger_print("PATTERN: dma start failed: %d", ret);
+		RJTTimer_release(RJT_TIMER_TC3);
+		return RJT_USB_ERROR_OPERATION_FAILED;
+	}
+
+	mPattern.state = PATTERN_STATE_RUNNING;
+
+	RJTTimer_startPeriodic(RJT_TIMER_TC3, &mPattern.period);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgePattern_configure(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint32_t rate_hz;
+		uint32_t index_mask;
+		uint8_t  mode;
+	RJT_USB_BRIDGE_END_CMD
+
+	uint32_t actual_rate = 0;
+
+	ASSERT(*rsp_len >= sizeof(actual_rate));
+	*rsp_len = 0;
+
+	if(PATTERN_STATE_RUNNING == mPattern.state) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	if(cmd.mode >= PATTERN_MODE_MAX ||
+	   cmd.rate_hz > PATTERN_MAX_RATE_HZ ||
+	   0 == cmd.index_mask ||
+	   0 != (cmd.index_mask & ~RJTUSBBridgeConfig_getAvailableIndexMask()))
+	{
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	if(false == RJTTimer_rate2period(cmd.rate_hz, &mPattern.period)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	uint32_t port_mask = RJTUSBBridgeConfig_indexMask2PortMask(cmd.index_mask);
+
+	// Pattern pins become outputs, all other pins keep their current level
+	struct port_config config;
+	port_get_config_defaults(&config);
+	config.direction = PORT_PIN_DIR_OUTPUT;
+
+	port_group_set_config(&PORTB, port_mask, &config);
+
+	mPattern.mode = cmd.mode;
+	mPattern.index_mask = cmd.index_mask;
+	mPattern.port_mask = (uint16_t) port_mask;
+
+	// a stream starts from the level the pins have now
+	mPattern.last_port = (uint16_t) (PORTB.OUT.reg & port_mask);
+
+	mPattern.num_samples = 0;
+	mPattern.half_ready[0] = false;
+	mPattern.half_ready[1] = false;
+	mPattern.fill_half = 0;
+	mPattern.fill_pos = 0;
+	mPattern.underruns = 0;
+	mPattern.state = PATTERN_STATE_IDLE;
+	mPattern.configured = true;
+
+	actual_rate = RJTTimer_period2rate(&mPattern.period);
+
+	memcpy(rsp_data, &actual_rate, sizeof(actual_rate));
+	*rsp_len = sizeof(actual_rate);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgePattern_write(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	ASSERT(*rsp_len >= sizeof(uint16_t));
+
+	if(false == mPattern.configured) {
+		*rsp_len = 0;
+		return RJT_USB_ERROR_STATE;
+	}
+
+	size_t num_given = cmd_len / sizeof(uint16_t);
+	size_t num_accepted = 0;
+
+	if(PATTERN_MODE_STREAM == mPattern.mode)
+	{
+		// Append into the half being refilled, if the player released it
+		while(num_accepted < num_given && false == mPattern.half_ready[mPattern.fill_half])
+		{
+			uint16_t sample;
+			memcpy(&sample, &cmd_data[num_accepted * sizeof(sample)], sizeof(sample));
+
+			uint16_t port = sample2port(sample);
+
+			if(0 == mPattern.fill_pos) {
+				mPattern.half_ref[mPattern.fill_half] = mPattern.last_port;
+			}
+
+			mPattern.buf[mPattern.fill_half * PATTERN_HALF_LEN + mPattern.fill_pos] = port ^ mPattern.last_port;
+			mPattern.last_port = port;
+			mPattern.fill_pos++;
+			num_accepted++;
+
+			if(PATTERN_HALF_LEN == mPattern.fill_pos) {
+				mDMADescriptors[mPattern.fill_half].BTCTRL.bit.VALID = 1;
+				mPattern.half_ready[mPattern.fill_half] = true;
+				mPattern.fill_half ^= 1;
+				mPattern.fill_pos = 0;
+			}
+		}
+	}
+	else
+	{
+		if(PATTERN_STATE_RUNNING == mPattern.state) {
+			*rsp_len = 0;
+			return RJT_USB_ERROR_RESOURCE_BUSY;
+		}
+
+		while(num_accepted < num_given && mPattern.num_samples < PATTERN_BUF_LEN)
+		{
+			uint16_t sample;
+			memcpy(&sample, &cmd_data[num_accepted * sizeof(sample)], sizeof(sample));
+
+			uint16_t port = sample2port(sample);
+
+			// the first toggle is filled in at start, see start_generator()
+			if(0 == mPattern.num_samples) {
+				mPattern.first_port = port;
+			}
+
+			mPattern.buf[mPattern.num_samples++] = port ^ mPattern.last_port;
+			mPattern.last_port = port;
+			num_accepted++;
+		}
+	}
+
+	uint16_t rsp = (uint16_t) num_accepted;
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = sizeof(rsp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgePattern_control(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t action;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	switch(cmd.action)
+	{
+		case PATTERN_CONTROL_STOP:
+			RJTUSBBridgePattern_stop();
+			return RJT_USB_ERROR_NONE;
+
+		case PATTERN_CONTROL_START:
+			if(false == mPattern.configured) {
+				return RJT_USB_ERROR_STATE;
+			}
+			if(PATTERN_STATE_RUNNING == mPattern.state) {
+				return RJT_USB_ERROR_RESOURCE_BUSY;
+			}
+			return start_generator();
+
+		default:
+			return RJT_USB_ERROR_PARAMETER;
+	}
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgePattern_getStatus(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	__PACKED_STRUCT {
+		uint8_t  state;
+		uint8_t  mode;
+		uint16_t free_samples;
+		uint32_t blocks_played;
+		uint32_t underruns;
+	} rsp = {0};
+
+	ASSERT(*rsp_len >= sizeof(rsp));
+
+	system_interrupt_enter_critical_section();
+
+	rsp.state = mPattern.state;
+	rsp.mode = mPattern.mode;
+	rsp.blocks_played = mPattern.blocks_played;
+	rsp.underruns = mPattern.underruns;
+
+	if(PATTERN_MODE_STREAM == mPattern.mode) {
+		rsp.free_samples =
+			(false == mPattern.half_ready[0] ? PATTERN_HALF_LEN : 0) +
+			(false == mPattern.half_ready[1] ? PATTERN_HALF_LEN : 0);
+
+		if(false == mPattern.half_ready[mPattern.fill_half]) {
+			rsp.free_samples -= mPattern.fill_pos;
+		}
+	}
+	else {
+		rsp.free_samples = PATTERN_BUF_LEN - mPattern.num_samples;
+	}
+
+	RJTUSBBridge_clearInterruptBit(RJT_USB_INTERRUPT_BIT_PATTERN, true);
+
+	system_interrupt_leave_critical_section();
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = sizeof(rsp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+void RJTUSBBridgePattern_stop(void)
+{
+	if(PATTERN_STATE_RUNNING == mPattern.state) {
+		stop_generator(PATTERN_STATE_IDLE);
+	}
+}
+
+
+void RJTUSBBridgePattern_init(void)
+{
+	memset(&mPattern, 0, sizeof(mPattern));
+
+	init_dmac();
+}
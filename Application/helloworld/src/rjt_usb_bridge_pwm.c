@@ -0,0 +1,324 @@
+/*
+ * rjt_usb_bridge_pwm.c
+ */
+
+#include "rjt_usb_bridge_app.h"
+#include "rjt_timer.h"
+#include "rjt_logger.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <asf.h>
+#include <pinmux.h>
+
+/**
+ * PWM outputs:
+ *
+ * Index  Pin   Output
+ * 10     PB10  TCC0/WO[4] - CC0
+ * 11     PB11  TCC0/WO[5] - CC1
+ * 12     PB12  TCC0/WO[6] - CC2
+ * 13     PB13  TCC0/WO[7] - CC3
+ *
+ * TCC0 runs in normal (single slope) PWM, so all four channels share
+ * one frequency and each has its own duty cycle. Updates only go to
+ * the buffer registers (PERB / CCBx) and are loaded by the hardware
+ * at the next wrap, so a period is never cut short or stretched. A
+ * frequency change rewrites every channel with the lock update bit
+ * held, so the new period and duty cycles take effect together.
+ */
+
+#define PWM_TCC					TCC0
+#define PWM_NUM_CHANNELS		4
+#define PWM_FIRST_INDEX			10
+
+// duty cycle is given in 0.01 %
+#define PWM_DUTY_FULL			10000
+
+// PER + 1 has to fit in a CC register for 100 % duty
+#define PWM_MAX_TOP				(TCC_PER_PER_Msk - 1)
+
+
+static const uint32_t mChannel2Pinmux[PWM_NUM_CHANNELS] = {
+	PINMUX_PB10F_TCC0_WO4,
+	PINMUX_PB11F_TCC0_WO5,
+	PINMUX_PB12F_TCC0_WO6,
+	PINMUX_PB13F_TCC0_WO7,
+};
+
+
+static struct {
+	bool enabled;
+	uint8_t prescaler;
+	uint32_t top;
+	uint16_t duty[PWM_NUM_CHANNELS];
+} mPwm;
+
+
+static void wait_for_sync(uint32_t mask)
+{
+	while(PWM_TCC->SYNCBUSY.reg & mask);
+}
+
+
+/**
+ * Same as RJTTimer_rate2period(), for the 24 bit TCC counter.
+ */
+static bool frequency2period(uint32_t frequency_hz, uint8_t * prescaler, uint32_t * top)
+{
+	if(0 == frequency_hz || frequency_hz > RJT_TIMER_CLOCK_HZ / 2) {
+		return false;
+	}
+
+	uint32_t ticks = (RJT_TIMER_CLOCK_HZ + frequency_hz / 2) / frequency_hz;
+
+	for(uint8_t k = TC_CTRLA_PRESCALER_DIV1_Val; k <= TC_CTRLA_PRESCALER_DIV1024_Val; k++)
+	{
+		uint32_t div = RJTTimer_prescaler2div(k);
+		uint32_t counts = (ticks + div / 2) / div;
+
+		if(counts <= PWM_MAX_TOP + 1)
+		{
+			if(counts < 2) {
+				counts = 2;
+			}
+			*prescaler = k;
+			*top = counts - 1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static uint32_t duty2cc(uint16_t duty)
+{
+	return (uint32_t) (((uint64_t) (mPwm.top + 1) * duty) / PWM_DUTY_FULL);
+}
+
+
+static uint32_t current_frequency(void)
+{
+	uint32_t ticks = RJTTimer_prescaler2div(mPwm.prescaler) * (mPwm.top + 1);
+
+	return RJT_TIMER_CLOCK_HZ / ticks;
+}
+
+
+/**
+ * Loads PERB and every CCBx as one update. LUPD keeps the buffers
+ * from being copied at a wrap that happens halfway through.
+ */
+static void write_buffers(void)
+{
+	PWM_TCC->CTRLBSET.reg = TCC_CTRLBSET_LUPD;
+	wait_for_sync(TCC_SYNCBUSY_CTRLB);
+
+	PWM_TCC->PERB.reg = mPwm.top;
+
+	for(uint8_t k = 0; k < PWM_NUM_CHANNELS; k++) {
+		PWM_TCC->CCB[k].reg = duty2cc(mPwm.duty[k]);
+	}
+
+	wait_for_sync(TCC_SYNCBUSY_PERB | TCC_SYNCBUSY_CCB_Msk);
+
+	PWM_TCC->CTRLBCLR.reg = TCC_CTRLBCLR_LUPD;
+	wait_for_sync(TCC_SYNCBUSY_CTRLB);
+}
+
+
+/**
+ * Only while the counter is stopped: writes the active registers and
+ * restarts the period.
+ */
+static void write_active(void)
+{
+	PWM_TCC->COUNT.reg = 0;
+	PWM_TCC->PER.reg = mPwm.top;
+
+	for(uint8_t k = 0; k < PWM_NUM_CHANNELS; k++) {
+		PWM_TCC->CC[k].reg = duty2cc(mPwm.duty[k]);
+	}
+
+	wait_for_sync(TCC_SYNCBUSY_COUNT | TCC_SYNCBUSY_PER | TCC_SYNCBUSY_CC_Msk);
+}
+
+
+static void init_pins(void)
+{
+	struct system_pinmux_config config;
+
+	system_pinmux_get_config_defaults(&config);
+	config.direction = SYSTEM_PINMUX_PIN_DIR_OUTPUT;
+
+	for(uint8_t k = 0; k < PWM_NUM_CHANNELS; k++)
+	{
+		config.mux_position = mChannel2Pinmux[k] & 0xffff;
+		system_pinmux_pin_set_config(mChannel2Pinmux[k] >> 16, &config);
+	}
+}
+
+
+/**
+ * Called by the configuration when switching to SK_USB_CONFIG_PWM.
+ * All channels start at 0 % duty.
+ */
+enum RJT_USB_ERROR RJTUSBBridgePWM_enable(uint32_t frequency_hz)
+{
+	ASSERT(false == mPwm.enabled);
+
+	if(false == frequency2period(frequency_hz, &mPwm.prescaler, &mPwm.top)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	memset(mPwm.duty, 0, sizeof(mPwm.duty));
+
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_TCC0);
+
+	// TCC0 shares its generic clock with TCC1, both run from GCLK1
+	struct system_gclk_chan_config config;
+	system_gclk_chan_get_config_defaults(&config);
+	config.source_generator = RJT_TIMER_GCLK_GENERATOR;
+
+	system_gclk_chan_set_config(TCC0_GCLK_ID, &config);
+	system_gclk_chan_enable(TCC0_GCLK_ID);
+
+	PWM_TCC->CTRLA.reg = TCC_CTRLA_SWRST;
+	wait_for_sync(TCC_SYNCBUSY_SWRST);
+
+	PWM_TCC->CTRLA.reg =
+		TCC_CTRLA_PRESCALER(mPwm.prescaler) |
+		TCC_CTRLA_PRESCSYNC_PRESC;
+
+	PWM_TCC->WAVE.reg = TCC_WAVE_WAVEGEN_NPWM;
+	wait_for_sync(TCC_SYNCBUSY_WAVE);
+
+	// Nothing to buffer yet, write the active registers directly
+	write_active();
+
+	PWM_TCC->CTRLA.reg |= TCC_CTRLA_ENABLE;
+	wait_for_sync(TCC_SYNCBUSY_ENABLE);
+
+	init_pins();
+
+	mPwm.enabled = true;
+
+	RJTLogger_print("PWM: %d Hz", current_frequency());
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+/**
+ * Called by the configuration when leaving SK_USB_CONFIG_PWM, the
+ * pins are handed back to gpio afterwards.
+ */
+void RJTUSBBridgePWM_disable(void)
+{
+	ASSERT(true == mPwm.enabled);
+
+	PWM_TCC->CTRLA.reg &= ~TCC_CTRLA_ENABLE;
+	wait_for_sync(TCC_SYNCBUSY_ENABLE);
+
+	PWM_TCC->CTRLA.reg = TCC_CTRLA_SWRST;
+	wait_for_sync(TCC_SYNCBUSY_SWRST);
+
+	// The generic clock stays on, TCC1 may be using it
+	system_apb_clock_clear_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_TCC0);
+
+	mPwm.enabled = false;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgePWM_setFrequency(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint32_t frequency_hz;
+	RJT_USB_BRIDGE_END_CMD
+
+	__PACKED_STRUCT {
+		uint32_t frequency_hz;
+	} rsp = {0};
+
+	ASSERT(*rsp_len >= sizeof(rsp));
+
+	if(false == mPwm.enabled) {
+		*rsp_len = 0;
+		return RJT_USB_ERROR_STATE;
+	}
+
+	uint8_t prescaler;
+	uint32_t top;
+
+	if(false == frequency2period(cmd.frequency_hz, &prescaler, &top)) {
+		*rsp_len = 0;
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	if(prescaler != mPwm.prescaler)
+	{
+		// The prescaler is enable protected, so this costs one
+		// restarted period
+		PWM_TCC->CTRLA.reg &= ~TCC_CTRLA_ENABLE;
+		wait_for_sync(TCC_SYNCBUSY_ENABLE);
+
+		PWM_TCC->CTRLA.reg =
+			TCC_CTRLA_PRESCALER(prescaler) |
+			TCC_CTRLA_PRESCSYNC_PRESC;
+
+		mPwm.prescaler = prescaler;
+		mPwm.top = top;
+		write_active();
+
+		// a pending CCBx would otherwise be loaded at the first wrap
+		write_buffers();
+
+		PWM_TCC->CTRLA.reg |= TCC_CTRLA_ENABLE;
+		wait_for_sync(TCC_SYNCBUSY_ENABLE);
+	}
+	else
+	{
+		mPwm.top = top;
+		write_buffers();
+	}
+
+	rsp.frequency_hz = current_frequency();
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = sizeof(rsp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgePWM_setDuty(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t  index;
+		uint16_t duty;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(false == mPwm.enabled) {
+		return RJT_USB_ERROR_STATE;
+	}
+
+	if(cmd.index < PWM_FIRST_INDEX ||
+	   cmd.index >= PWM_FIRST_INDEX + PWM_NUM_CHANNELS ||
+	   cmd.duty > PWM_DUTY_FULL) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	uint8_t channel = cmd.index - PWM_FIRST_INDEX;
+
+	mPwm.duty[channel] = cmd.duty;
+
+	PWM_TCC->CCB[channel].reg = duty2cc(cmd.duty);
+	wait_for_sync(TCC_SYNCBUSY_CCB0 << channel);
+
+	return RJT_USB_ERROR_NONE;
+}
@@ -68,6 +68,12 @@ enum RJT_USB_ERROR RJTUSBBridgeSPIM_transferData(const uint8_t * cmd_data, size_
 		return RJT_USB_ERROR_STATE;
 	}
 
+	// a triggered transaction was interrupted by this command
+	if(RJTUSBBridgeTrigger_isBusy()) {
+		*rsp_len = 0;
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
 	// Get the pointer to the tx data
 	// offset by cmd header...
 	const uint8_t * tx_data = &cmd_data[sizeof(cmd)];
@@ -0,0 +1,421 @@
+/*
+ * rjt_usb_bridge_trigger.c
+ */
+
+#include "rjt_external_interrupt_controller.h"
+#include "rjt_usb_bridge_app.h"
+#include "rjt_timer.h"
+#include "rjt_logger.h"
+#include "utils.h"
+
+#include <port.h>
+#include <stdbool.h>
+#include <asf.h>
+#include <spi.h>
+#include <i2c_master.h>
+
+/**
+ * Triggered transactions:
+ *
+ * A stored SPI or I2C transaction is bound to the EIC line of one gpio
+ * index and runs straight from the EIC interrupt, so a data ready
+ * line is answered within microseconds instead of a USB round trip.
+ * Each run queues a timestamped record for USB_CMD_TRIGGER_READ.
+ *
+ * The transaction uses the bus of the current configuration, with the
+ * same blocking ASF calls as the host commands. USB interrupts run
+ * above the EIC, so while a transaction is running the SPI / I2C host
+ * commands and configuration changes return RJT_USB_ERROR_RESOURCE_BUSY
+ * instead of touching the bus halfway through.
+ *
+ * A line another feature already uses is refused rather than taken
+ * over.
+ *
+ * The EIC interrupt is the only writer of head and the read command
+ * the only writer of tail.
+ */
+
+enum TRIGGER_BUS {
+	TRIGGER_BUS_SPI = 0,
+	TRIGGER_BUS_I2C = 1,
+	TRIGGER_BUS_MAX,
+};
+
+enum TRIGGER_STATUS {
+	TRIGGER_STATUS_OK        = 0,
+	TRIGGER_STATUS_NOT_READY = 1,		// bus not configured
+	TRIGGER_STATUS_FAILED    = 2,		// bus error or no ack
+};
+
+#define TRIGGER_MAX_TX			16
+#define TRIGGER_MAX_RX			24
+
+#define TRIGGER_QUEUE_LEN		16		// power of two
+
+struct TriggerRecord {
+	uint32_t timestamp;
+	uint8_t  status;
+	uint8_t  len;
+	uint8_t  data[TRIGGER_MAX_RX];
+};
+
+static struct {
+	volatile bool armed;
+	volatile bool running;
+
+	uint8_t index;
+	uint8_t extint;
+	uint8_t bus;
+	uint8_t ss_gpio;		// SPI chip select, 0xff for none
+	uint8_t address;		// I2C 7 bit address
+	uint8_t tx_len;
+	uint8_t rx_len;
+	uint8_t tx[TRIGGER_MAX_TX];
+
+	// SPI clocks out the whole tx buffer, the rest reads as dummy bytes
+	uint8_t spi_tx[TRIGGER_MAX_RX];
+} mTrigger;
+
+static struct {
+	struct TriggerRecord records[TRIGGER_QUEUE_LEN];
+	volatile uint16_t head;
+	volatile uint16_t tail;
+
+	// dropped is counted by the writer, reported by the reader
+	volatile uint16_t dropped;
+	uint16_t dropped_reported;
+} mResults;
+
+
+static enum TRIGGER_STATUS run_spi(uint8_t * rx)
+{
+	struct spi_module * spi_handle = SKUSBBridgeConfig_getSpiModule();
+
+	if(NULL == spi_handle) {
+		return TRIGGER_STATUS_NOT_READY;
+	}
+
+	if(0xff != mTrigger.ss_gpio) {
+		port_pin_set_output_level(mTrigger.ss_gpio, false);
+	}
+
+	enum status_code status =
+		spi_transceive_buffer_wait(spi_handle, mTrigger.spi_tx, rx, mTrigger.rx_len);
+
+	if(0xff != mTrigger.ss_gpio) {
+		port_pin_set_output_level(mTrigger.ss_gpio, true);
+	}
+
+	return (STATUS_OK == status) ? TRIGGER_STATUS_OK : TRIGGER_STATUS_FAILED;
+}
+
+
+static enum TRIGGER_STATUS run_i2c(uint8_t * rx)
+{
+	struct i2c_master_module * i2c_handle = SKUSBBridgeConfig_getI2CModule();
+
+	if(NULL == i2c_handle) {
+		return TRIGGER_STATUS_NOT_READY;
+	}
+
+	struct i2c_master_packet packet = {
+		.address     = mTrigger.address,
+		.data_length = mTrigger.tx_len,
+		.data        = mTrigger.tx,
+		.ten_bit_address = false,
+		.high_speed      = false,
+		.hs_master_code  = 0x00,
+	};
+
+	enum status_code status = STATUS_OK;
+
+	if(mTrigger.tx_len > 0)
+	{
+		// a register address usually, followed by a repeated start
+		if(mTrigger.rx_len > 0) {
+			status = i2c_master_write_packet_wait_no_stop(i2c_handle, &packet);
+		}
+		else {
+			status = i2c_master_write_packet_wait(i2c_handle, &packet);
+		}
+	}
+
+	if(STATUS_OK == status && mTrigger.rx_len > 0)
+	{
+		packet.data_length = mTrigger.rx_len;
+		packet.data = rx;
+
+		status = i2c_master_read_packet_wait(i2c_handle, &packet);
+	}
+	else if(STATUS_OK != status) {
+		i2c_master_send_stop(i2c_handle);
+	}
+
+	return (STATUS_OK == status) ? TRIGGER_STATUS_OK : TRIGGER_STATUS_FAILED;
+}
+
+
+static void trigger_callback(void * self, uint8_t pinno, uint8_t intno)
+{
+	uint32_t timestamp = RJTTimer_getTimestamp();
+
+	if(false == mTrigger.armed) {
+		return;
+	}
+
+	uint16_t head = mResults.head;
+
+	if((uint16_t) (head - mResults.tail) >= TRIGGER_QUEUE_LEN) {
+		// no room for the result, leave the device alone
+		mResults.dropped++;
+		return;
+	}
+
+	struct TriggerRecord * record = &mResults.records[head % TRIGGER_QUEUE_LEN];
+
+	mTrigger.running = true;
+
+	record->status = (TRIGGER_BUS_SPI == mTrigger.bus) ?
+		run_spi(record->data) : run_i2c(record->data);
+
+	mTrigger.running = false;
+
+	record->timestamp = timestamp;
+	record->len = (TRIGGER_STATUS_OK == record->status) ? mTrigger.rx_len : 0;
+
+	// the record has to be complete before the reader can see it
+	__DMB();
+	mResults.head = head + 1;
+
+	RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_TRIGGER, true);
+}
+
+
+/**
+ * Unbinds the line. Safe with the transaction running, which then ends
+ * as usual; the bus is not touched.
+ */
+static void disarm(void)
+{
+	if(mTrigger.armed) {
+		mTrigger.armed = false;
+		RJTEIC_disableInterrupt(mTrigger.extint);
+	}
+}
+
+
+bool RJTUSBBridgeTrigger_isBusy(void)
+{
+	return mTrigger.running;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeTrigger_configure(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t index;
+		uint8_t detection;
+		uint8_t bus;
+		uint8_t ss_index;		// SPI: chip select, I2C: 7 bit address
+		uint8_t tx_len;
+		uint8_t rx_len;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(mTrigger.running) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	disarm();
+
+	if(0xff == cmd.index) {
+		return RJT_USB_ERROR_NONE;
+	}
+
+	const enum RJT_EIC_DETECTION cmd2detection[] = {
+		[0] = RJT_EIC_DETECTION_FALL,
+		[1] = RJT_EIC_DETECTION_RISE,
+		[2] = RJT_EIC_DETECTION_BOTH,
+	};
+
+	if(cmd.index >= RJT_USB_BRIDGE_NUM_GPIOS ||
+	   0 == (RJTUSBBridgeConfig_getAvailableIndexMask() & (1UL << cmd.index)) ||
+	   cmd.detection >= ARRAY_SIZE(cmd2detection) ||
+	   cmd.bus >= TRIGGER_BUS_MAX ||
+	   cmd.tx_len > TRIGGER_MAX_TX ||
+	   cmd.rx_len > TRIGGER_MAX_RX ||
+	   cmd_len < sizeof(cmd) + cmd.tx_len) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	bool success = false;
+	uint8_t gpio = 0xff;
+	uint8_t extint = 0xff;
+	uint8_t ss_gpio = 0xff;
+
+	if(TRIGGER_BUS_SPI == cmd.bus)
+	{
+		// SPI reads as many bytes as it writes
+		if(0 == cmd.rx_len || cmd.tx_len > cmd.rx_len) {
+			return RJT_USB_ERROR_PARAMETER;
+		}
+
+		if(0xff != cmd.ss_index)
+		{
+			if(cmd.ss_index >= RJT_USB_BRIDGE_NUM_GPIOS ||
+			   0 == (RJTUSBBridgeConfig_getAvailableIndexMask() & (1UL << cmd.ss_index)) ||
+			   cmd.ss_index == cmd.index) {
+				return RJT_USB_ERROR_PARAMETER;
+			}
+
+			RJTUSBBridgeConfig_index2gpio(cmd.ss_index, &success, &ss_gpio);
+			ASSERT(true == success);
+		}
+	}
+	else
+	{
+		if(cmd.ss_index > 0x7f || 0 == cmd.tx_len + cmd.rx_len) {
+			return RJT_USB_ERROR_PARAMETER;
+		}
+	}
+
+	RJTUSBBridgeConfig_index2gpio(cmd.index, &success, &gpio);
+	ASSERT(true == success);
+
+	RJTUSBBridgeConfig_index2extint(cmd.index, &success, &extint);
+	ASSERT(true == success);
+
+	// a pin interrupt, the logic analyzer or the frequency counter
+	if(RJTEIC_isLineTaken(RJTUSBBridgeGPIO_getEICModule(), extint, trigger_callback)) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	mTrigger.index = cmd.index;
+	mTrigger.extint = extint;
+	mTrigger.bus = cmd.bus;
+	mTrigger.ss_gpio = ss_gpio;
+	mTrigger.address = cmd.ss_index;
+	mTrigger.tx_len = cmd.tx_len;
+	mTrigger.rx_len = cmd.rx_len;
+
+	memcpy(mTrigger.tx, &cmd_data[sizeof(cmd)], cmd.tx_len);
+
+	memset(mTrigger.spi_tx, 0, sizeof(mTrigger.spi_tx));
+	memcpy(mTrigger.spi_tx, mTrigger.tx, cmd.tx_len);
+
+	if(0xff != ss_gpio)
+	{
+		// deselected until the first run
+		struct port_config pin_config;
+
+		port_get_config_defaults(&pin_config);
+		pin_config.direction = PORT_PIN_DIR_OUTPUT;
+
+		port_pin_set_output_level(ss_gpio, true);
+		port_pin_set_config(ss_gpio, &pin_config);
+	}
+
+	RJTEICConfig_t config = {
+		.ext_int_sel = extint,
+		.eic_detection = cmd2detection[cmd.detection],
+		.gpio = gpio,
+		.gpio_mux_position = 0,
+		.callback = trigger_callback,
+	};
+
+	RJTEIC_configure(RJTUSBBridgeGPIO_getEICModule(), &config);
+
+	mTrigger.armed = true;
+
+	RJTEIC_enableInterrupt(extint);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeTrigger_read(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	__PACKED_STRUCT {
+		uint8_t  count;
+		uint16_t dropped;
+	} rsp = {0};
+
+	__PACKED_STRUCT {
+		uint32_t timestamp;
+		uint8_t  status;
+		uint8_t  len;
+	} header;
+
+	size_t max_len = *rsp_len;
+
+	ASSERT(max_len >= sizeof(rsp) + sizeof(header) + TRIGGER_MAX_RX);
+
+	uint16_t dropped = mResults.dropped;
+	rsp.dropped = dropped - mResults.dropped_reported;
+	mResults.dropped_reported = dropped;
+
+	size_t len = sizeof(rsp);
+
+	uint16_t tail = mResults.tail;
+	uint16_t head = mResults.head;
+
+	// see the head before reading the records behind it
+	__DMB();
+
+	while(tail != head)
+	{
+		const struct TriggerRecord * record = &mResults.records[tail % TRIGGER_QUEUE_LEN];
+
+		if(len + sizeof(header) + record->len > max_len) {
+			break;
+		}
+
+		header.timestamp = record->timestamp;
+		header.status = record->status;
+		header.len = record->len;
+
+		memcpy(&rsp_data[len], &header, sizeof(header));
+		len += sizeof(header);
+
+		memcpy(&rsp_data[len], record->data, record->len);
+		len += record->len;
+
+		rsp.count++;
+		tail++;
+	}
+
+	// done with the records before handing the slots back
+	__DMB();
+	mResults.tail = tail;
+
+	if(tail == head)
+	{
+		RJTUSBBridge_clearInterruptBit(RJT_USB_INTERRUPT_BIT_TRIGGER, true);
+
+		// a record queued while clearing must not go unnoticed
+		if(tail != mResults.head) {
+			RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_TRIGGER, true);
+		}
+	}
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = len;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+/**
+ * Called on a host reset and before the configuration changes.
+ */
+void RJTUSBBridgeTrigger_stop(void)
+{
+	disarm();
+
+	mResults.tail = mResults.head;
+
+	RJTUSBBridge_clearInterruptBit(RJT_USB_INTERRUPT_BIT_TRIGGER, false);
+}
@@ -0,0 +1,233 @@
+/*
+ * rjt_usb_bridge_uart.c
+ */
+
+#include "rjt_usb_bridge_app.h"
+#include "rjt_uart.h"
+#include "rjt_logger.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <asf.h>
+
+
+enum RJT_USB_ERROR RJTUSBBridgeUart_getLineInfo(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t port;
+	RJT_USB_BRIDGE_END_CMD
+
+	__PACKED_STRUCT {
+		uint32_t baudrate;
+		uint32_t actual_baudrate;
+		 int32_t error_ppm;
+		uint8_t  data_bits;
+		uint8_t  parity;
+		uint8_t  stop_bits;
+		uint8_t  oversampling;
+	} rsp = {0};
+
+	ASSERT(*rsp_len >= sizeof(rsp));
+
+	struct RJTUartLineInfo info;
+
+	if(false == RJTUart_getLineInfo(cmd.port, &info)) {
+		*rsp_len = 0;
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	rsp.baudrate = info.baudrate;
+	rsp.actual_baudrate = info.actual_baudrate;
+	rsp.error_ppm = info.error_ppm;
+	rsp.data_bits = info.data_bits;
+	rsp.parity = info.parity;
+	rsp.stop_bits = info.stop_bits;
+	rsp.oversampling = info.oversampling;
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = sizeof(rsp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeUart_setFlowControl(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t  port;
+		uint8_t  enable;
+		uint16_t high_watermark;
+		uint16_t low_watermark;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(RJT_UART_FLOW_CONTROL_PORT != cmd.port) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	bool enable = !!cmd.enable;
+
+	if(enable) {
+		// CTS is on the button pin
+		RJTUSBBridgeGPIO_enableButton(false);
+	}
+
+	if(false == RJTUart_setFlowControl(cmd.port, enable, cmd.high_watermark, cmd.low_watermark)) {
+		RJTUSBBridgeGPIO_enableButton(true);
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	if(false == enable) {
+		RJTUSBBridgeGPIO_enableButton(true);
+	}
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeUart_setControlLines(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t port;
+		uint8_t dtr_index;
+		uint8_t rts_index;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	uint8_t dtr_gpio = 0xff;
+	uint8_t rts_gpio = 0xff;
+	bool success = true;
+
+	if(0xff != cmd.dtr_index) {
+		RJTUSBBridgeConfig_index2gpio(cmd.dtr_index, &success, &dtr_gpio);
+	}
+
+	if(true == success && 0xff != cmd.rts_index) {
+		RJTUSBBridgeConfig_index2gpio(cmd.rts_index, &success, &rts_gpio);
+	}
+
+	if(false == success || (0xff != cmd.dtr_index && cmd.dtr_index == cmd.rts_index)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	if(false == RJTUart_setControlLinePins(cmd.port, dtr_gpio, rts_gpio)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeUart_getStats(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t port;
+		uint8_t clear;
+	RJT_USB_BRIDGE_END_CMD
+
+	__PACKED_STRUCT {
+		uint32_t rx_bytes;
+		uint32_t rx_dropped;
+		uint32_t rx_overruns;
+		uint32_t tx_bytes;
+		uint32_t frame_errors;
+		uint32_t parity_errors;
+		uint32_t buffer_overflows;
+		uint16_t rx_ring_high_water;
+		uint16_t tx_queue_high_water;
+		uint32_t rx_frames;
+		uint32_t tx_frames;
+		uint32_t crc_errors;
+		uint32_t decode_errors;
+	} rsp = {0};
+
+	ASSERT(*rsp_len >= sizeof(rsp));
+
+	struct RJTUartStats stats;
+
+	if(false == RJTUart_getStats(cmd.port, &stats, !!cmd.clear)) {
+		*rsp_len = 0;
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	rsp.rx_bytes = stats.rx_bytes;
+	rsp.rx_dropped = stats.rx_dropped;
+	rsp.rx_overruns = stats.rx_overruns;
+	rsp.tx_bytes = stats.tx_bytes;
+	rsp.frame_errors = stats.frame_errors;
+	rsp.parity_errors = stats.parity_errors;
+	rsp.buffer_overflows = stats.buffer_overflows;
+	rsp.rx_ring_high_water = stats.rx_ring_high_water;
+	rsp.tx_queue_high_water = stats.tx_queue_high_water;
+	rsp.rx_frames = stats.rx_frames;
+	rsp.tx_frames = stats.tx_frames;
+	rsp.crc_errors = stats.crc_errors;
+	rsp.decode_errors = stats.decode_errors;
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = sizeof(rsp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeUart_setRxAggregation(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t  port;
+		uint16_t threshold;
+		uint32_t timeout_us;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(false == RJTUart_setRxAggregation(cmd.port, cmd.threshold, cmd.timeout_us)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeUart_setStream(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t  port_mask;
+		uint16_t gap_us;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(false == RJTUart_setStream(cmd.port_mask, cmd.gap_us)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeUart_setFraming(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint8_t port;
+		uint8_t mode;
+		uint8_t crc;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(false == RJTUart_setFraming(cmd.port, (enum RJT_FRAME_MODE) cmd.mode, !!cmd.crc)) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	return RJT_USB_ERROR_NONE;
+}
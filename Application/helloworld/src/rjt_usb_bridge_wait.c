@@ -0,0 +1,264 @@
+/*
+ * rjt_usb_bridge_wait.c
+ */
+
+#include "rjt_usb_bridge_app.h"
+#include "rjt_timer.h"
+#include "rjt_logger.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <asf.h>
+
+/**
+ * Wait for a pin condition:
+ *
+ * USB_CMD_GPIO_WAIT only arms the wait and returns. The pins are then
+ * polled from the main loop, between the UART and logger work, so the
+ * USB interrupt is never held up and the loop keeps serving the UART.
+ * A poll comes once per pass of the loop, and a pass is as long as
+ * RJTUart_processCDC() and RJTUSBBridge_process() take plus whatever
+ * interrupts run in between; with the UART bridges busy that is tens
+ * to hundreds of microseconds. A level or pulse shorter than a pass
+ * can be missed, edges included, so this is for slow signals; the
+ * pin interrupts are for fast ones.
+ *
+ * The pins are read from PORTB.IN, so their input buffers are turned
+ * on when the wait is armed.
+ *
+ * The main loop is the only writer once the wait is armed, the command
+ * handlers only arm it (state IDLE or finished) or cancel it, with the
+ * main loop's check-and-finish done in a critical section.
+ */
+
+enum WAIT_STATE {
+	WAIT_STATE_IDLE     = 0,
+	WAIT_STATE_WAITING  = 1,
+	WAIT_STATE_MET      = 2,
+	WAIT_STATE_TIMEOUT  = 3,
+	WAIT_STATE_CANCELED = 4,
+};
+
+enum WAIT_CONDITION {
+	WAIT_CONDITION_ALL  = 0,		// every pin at its level
+	WAIT_CONDITION_ANY  = 1,		// at least one pin at its level
+	WAIT_CONDITION_RISE = 2,		// a rising edge on any pin
+	WAIT_CONDITION_FALL = 3,		// a falling edge on any pin
+	WAIT_CONDITION_EDGE = 4,		// either edge on any pin
+	WAIT_CONDITION_MAX,
+};
+
+// leaves room for the signed compare against the wrapping timestamp
+#define WAIT_MAX_TIMEOUT_US		0x7fffffffUL
+
+
+static struct {
+	volatile uint8_t state;
+	uint8_t condition;
+
+	// port bits, not indices, so a poll is one read of PORTB.IN
+	uint32_t port_mask;
+	uint32_t port_levels;
+	uint32_t last_sample;
+
+	uint32_t start;
+	uint32_t timeout_us;		// 0 waits forever
+
+	// result
+	uint32_t elapsed_us;
+	uint32_t levels;			// index mask, at the end of the wait
+	uint32_t trigger;			// index mask, the pins that met it
+} mWait;
+
+
+/**
+ * Returns the port bits that meet the condition, 0 when it is not met.
+ */
+static uint32_t evaluate(uint32_t sample)
+{
+	uint32_t at_level = ~(sample ^ mWait.port_levels) & mWait.port_mask;
+	uint32_t rose = ~mWait.last_sample & sample & mWait.port_mask;
+	uint32_t fell = mWait.last_sample & ~sample & mWait.port_mask;
+
+	switch(mWait.condition)
+	{
+		case WAIT_CONDITION_ALL:
+			return (at_level == mWait.port_mask) ? at_level : 0;
+
+		case WAIT_CONDITION_ANY:
+			return at_level;
+
+		case WAIT_CONDITION_RISE:
+			return rose;
+
+		case WAIT_CONDITION_FALL:
+			return fell;
+
+		case WAIT_CONDITION_EDGE:
+			return rose | fell;
+
+		default:
+			ASSERT(0);
+			return 0;
+	}
+}
+
+
+static void finish(enum WAIT_STATE state, uint32_t now, uint32_t sample, uint32_t trigger)
+{
+	mWait.elapsed_us = now - mWait.start;
+	mWait.levels = RJTUSBBridgeConfig_portMask2IndexMask(sample);
+	mWait.trigger = RJTUSBBridgeConfig_portMask2IndexMask(trigger);
+	mWait.state = state;
+
+	RJTUSBBridge_setInterruptBit(RJT_USB_INTERRUPT_BIT_WAIT, true);
+}
+
+
+/**
+ * Called from the main loop.
+ */
+void RJTUSBBridgeWait_process(void)
+{
+	if(WAIT_STATE_WAITING != mWait.state) {
+		return;
+	}
+
+	// sample first, so a condition met right at the timeout still counts
+	uint32_t sample = PORTB.IN.reg;
+	uint32_t now = RJTTimer_getTimestamp();
+
+	system_interrupt_enter_critical_section();
+
+	// canceled by the host in the meantime
+	if(WAIT_STATE_WAITING == mWait.state)
+	{
+		uint32_t trigger = evaluate(sample);
+
+		if(0 != trigger) {
+			finish(WAIT_STATE_MET, now, sample, trigger);
+		}
+		else if(0 != mWait.timeout_us && (now - mWait.start) >= mWait.timeout_us) {
+			finish(WAIT_STATE_TIMEOUT, now, sample, 0);
+		}
+
+		mWait.last_sample = sample;
+	}
+
+	system_interrupt_leave_critical_section();
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeWait_start(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	RJT_USB_BRIDGE_BEGIN_CMD
+		uint32_t index_mask;
+		uint32_t level_mask;
+		uint8_t  condition;
+		uint32_t timeout_us;
+	RJT_USB_BRIDGE_END_CMD
+
+	*rsp_len = 0;
+
+	if(0 == cmd.index_mask)
+	{
+		// cancel
+		system_interrupt_enter_critical_section();
+
+		if(WAIT_STATE_WAITING == mWait.state) {
+			finish(WAIT_STATE_CANCELED, RJTTimer_getTimestamp(), PORTB.IN.reg, 0);
+		}
+
+		system_interrupt_leave_critical_section();
+
+		return RJT_USB_ERROR_NONE;
+	}
+
+	if(0 != (cmd.index_mask & ~RJTUSBBridgeConfig_getAvailableIndexMask()) ||
+	   cmd.condition >= WAIT_CONDITION_MAX ||
+	   cmd.timeout_us > WAIT_MAX_TIMEOUT_US) {
+		return RJT_USB_ERROR_PARAMETER;
+	}
+
+	if(WAIT_STATE_WAITING == mWait.state) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
+	RJTUSBBridge_clearInterruptBit(RJT_USB_INTERRUPT_BIT_WAIT, true);
+
+	// PORTB.IN reads 0 for a pin without INEN
+	RJTUSBBridgeConfig_enableInputs(cmd.index_mask);
+
+	mWait.condition = cmd.condition;
+	mWait.port_mask = RJTUSBBridgeConfig_indexMask2PortMask(cmd.index_mask);
+	mWait.port_levels = RJTUSBBridgeConfig_indexMask2PortMask(cmd.level_mask & cmd.index_mask);
+	mWait.timeout_us = cmd.timeout_us;
+
+	mWait.elapsed_us = 0;
+	mWait.levels = 0;
+	mWait.trigger = 0;
+
+	// edges are counted from the levels at the time of the command
+	mWait.last_sample = PORTB.IN.reg;
+	mWait.start = RJTTimer_getTimestamp();
+
+	// the main loop may pick it up from here
+	__DMB();
+	mWait.state = WAIT_STATE_WAITING;
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+enum RJT_USB_ERROR RJTUSBBridgeWait_getStatus(
+		const uint8_t * cmd_data, size_t cmd_len, uint8_t * rsp_data, size_t * rsp_len)
+{
+	__PACKED_STRUCT {
+		uint8_t  state;
+		uint32_t elapsed_us;
+		uint32_t levels;
+		uint32_t trigger;
+	} rsp = {0};
+
+	ASSERT(*rsp_len >= sizeof(rsp));
+
+	system_interrupt_enter_critical_section();
+
+	rsp.state = mWait.state;
+
+	if(WAIT_STATE_WAITING == mWait.state) {
+		rsp.elapsed_us = RJTTimer_getTimestamp() - mWait.start;
+	}
+	else {
+		rsp.elapsed_us = mWait.elapsed_us;
+		rsp.levels = mWait.levels;
+		rsp.trigger = mWait.trigger;
+	}
+
+	system_interrupt_leave_critical_section();
+
+	if(WAIT_STATE_WAITING != rsp.state) {
+		RJTUSBBridge_clearInterruptBit(RJT_USB_INTERRUPT_BIT_WAIT, true);
+	}
+
+	memcpy(rsp_data, &rsp, sizeof(rsp));
+	*rsp_len = sizeof(rsp);
+
+	return RJT_USB_ERROR_NONE;
+}
+
+
+/**
+ * Called on a host reset.
+ */
+void RJTUSBBridgeWait_stop(void)
+{
+	system_interrupt_enter_critical_section();
+
+	mWait.state = WAIT_STATE_IDLE;
+
+	system_interrupt_leave_critical_section();
+
+	RJTUSBBridge_clearInterruptBit(RJT_USB_INTERRUPT_BIT_WAIT, false);
+}
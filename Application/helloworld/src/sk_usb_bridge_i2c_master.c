@@ -16,6 +16,8 @@
 
 #define MAX_ATTEMPTS	1000
 
+#define I2CM_7BIT_ADDR_MAX	0x7f
+#define I2CM_10BIT_ADDR_MAX	0x3ff
 
 
 enum I2CM_CMD
@@ -24,6 +26,20 @@ enum I2CM_CMD
 	I2CM_CMD_WRITE_BYTE = 'W',
 	I2CM_CMD_READ_DATA = 'r',
 	I2CM_CMD_STOP = '.',
+	I2CM_CMD_ADDR_7BIT = 'a',
+	I2CM_CMD_ADDR_10BIT = 'A',
+};
+
+
+/**
+ * The slave currently targeted by the format string. Address ops
+ * change it in the middle of a transaction, so a single command can
+ * talk to several devices on the bus.
+ */
+struct I2CMTarget
+{
+	uint16_t address;
+	bool ten_bit_address;
 };
 
 
@@ -35,7 +51,7 @@ enum I2CM_CMD
  */
 static enum RJT_USB_ERROR write_i2c_data(
 	struct i2c_master_module * i2c_handle,
-	uint8_t slave_addr,
+	const struct I2CMTarget * target,
 	const uint8_t * data, 
 	uint8_t len, 
 	uint8_t * rsp_data, 
@@ -55,10 +71,10 @@ static enum RJT_USB_ERROR write_i2c_data(
 	}
 	
 	struct i2c_master_packet packet = {
-		.address     = slave_addr,
+		.address     = target->address,
 		.data_length = len,
-		.data        = data,
-		.ten_bit_address = false,
+		.data        = (uint8_t *) data,
+		.ten_bit_address = target->ten_bit_address,
 		.high_speed      = false,
 		.hs_master_code  = 0x00,
 	};
@@ -85,7 +101,7 @@ static enum RJT_USB_ERROR write_i2c_data(
 
 static enum RJT_USB_ERROR read_i2c_data(
 	struct i2c_master_module * i2c_handle,
-	uint8_t slave_addr,
+	const struct I2CMTarget * target,
 	uint8_t readlen,
 	uint8_t * rsp_data,
 	size_t * rsp_len)
@@ -106,10 +122,10 @@ static enum RJT_USB_ERROR read_i2c_data(
 	uint8_t * read_dst = &rsp_data[sizeof(rsp_header)];
 	
 	struct i2c_master_packet packet = {
-		.address     = slave_addr,
+		.address     = target->address,
 		.data_length = readlen,
 		.data        = read_dst,
-		.ten_bit_address = false,
+		.ten_bit_address = target->ten_bit_address,
 		.high_speed      = false,
 		.hs_master_code  = 0x00,
 	};
@@ -156,11 +172,28 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 		return RJT_USB_ERROR_STATE;
 	}
 
+	// a triggered transaction was interrupted by this command
+	if(RJTUSBBridgeTrigger_isBusy()) {
+		return RJT_USB_ERROR_RESOURCE_BUSY;
+	}
+
 
 	// Offset by the amount of data already in the command struct
 	cmd_len -= sizeof(cmd);
 	cmd_data += sizeof(cmd);
 	
+	// A write leaves the bus held for a repeated start, so returning
+	// early after one has to send the stop itself
+	bool bus_held = false;
+	
+	#define RELEASE_BUS_AND_RETURN(error) \
+	do { \
+		if(bus_held) { \
+			i2c_master_send_stop(i2c_handle); \
+		} \
+		return error; \
+	} while(0)
+	
 	
 	// Define 2 macros that help us:
 	// - consume an arrays worth of data from the command data
@@ -169,7 +202,7 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 	do { \
 		if(cmd_len < arr_len) { \
 			RJTLogger_print("I2CM: not enough data to read array. cmd_len %d, arr_len %d", cmd_len, arr_len); \
-			return RJT_USB_ERROR_MALFORMED_PACKET; \
+			RELEASE_BUS_AND_RETURN(RJT_USB_ERROR_MALFORMED_PACKET); \
 		} \
 		arr_ptr = cmd_data; \
 		cmd_data += arr_len; \
@@ -181,6 +214,7 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 	do { \
 		if(cmd_len == 0) { \
 			RJTLogger_print("I2CM: not enough data to read byte"); \
+			RELEASE_BUS_AND_RETURN(RJT_USB_ERROR_MALFORMED_PACKET); \
 		} \
 		dst = *cmd_data++; \
 		cmd_len -= 1; \
@@ -200,6 +234,12 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 	const uint8_t * fmt_str;
 	CONSUME_ARRAY(fmt_str, cmd.fmt_str_len);
 	
+	// The header address is the initial target, address ops may change it
+	struct I2CMTarget target = {
+		.address = cmd.slave_addr,
+		.ten_bit_address = false,
+	};
+	
 	
 	// parse the format string
 	for(size_t k = 0; k < cmd.fmt_str_len; k++)
@@ -217,7 +257,7 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 				GET_RESPONSE_ARRAY(rsp_arr, rsp_arrlen);
 				
 				enum RJT_USB_ERROR error =
-					write_i2c_data(i2c_handle, cmd.slave_addr, 
+					write_i2c_data(i2c_handle, &target, 
 						&writebyte, 1, 
 						rsp_arr, &rsp_arrlen);
 				
@@ -228,6 +268,8 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 					i2c_master_send_stop(i2c_handle);
 					return error;
 				}
+				
+				bus_held = true;
 				// else, continue processing the format string...
 			} break;
 			
@@ -246,7 +288,7 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 				GET_RESPONSE_ARRAY(rsp_arr, rsp_arrlen);
 				
 				enum RJT_USB_ERROR error =
-					write_i2c_data(i2c_handle, cmd.slave_addr, 
+					write_i2c_data(i2c_handle, &target, 
 						writedata, writelen, 
 						rsp_arr, &rsp_arrlen);
 				
@@ -257,6 +299,8 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 					i2c_master_send_stop(i2c_handle);
 					return error;
 				}
+				
+				bus_held = true;
 				// else, continue processing the format string...
 			} break;
 			
@@ -272,7 +316,7 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 				GET_RESPONSE_ARRAY(rsp_arr, rsp_arrlen);
 			
 				enum RJT_USB_ERROR error =
-					read_i2c_data(i2c_handle, cmd.slave_addr,
+					read_i2c_data(i2c_handle, &target,
 					readlen,
 					rsp_arr, &rsp_arrlen);
 			
@@ -281,19 +325,57 @@ enum RJT_USB_ERROR SKUSBBridgeI2CM_transaction(const uint8_t * cmd_data, size_t
 				
 				if(RJT_USB_ERROR_NONE != error) {
 					RJTLogger_print("I2CM: error while reading array");
-					return error;
+					RELEASE_BUS_AND_RETURN(error);
 				}
+				
+				// the read ends with a stop
+				bus_held = false;
 				// else, continue processing the format string...
 			} break;
 			
 			
 			case I2CM_CMD_STOP: {
 				i2c_master_send_stop(i2c_handle);
+				bus_held = false;
+			} break;
+			
+			
+			case I2CM_CMD_ADDR_7BIT: {
+				uint8_t addr;
+				CONSUME_BYTE(addr);
+				
+				if(addr > I2CM_7BIT_ADDR_MAX) {
+					RJTLogger_print("I2CM: bad 7 bit address: %x", addr);
+					RELEASE_BUS_AND_RETURN(RJT_USB_ERROR_PARAMETER);
+				}
+				
+				// The next read or write is sent with a (repeated) start
+				// to the new address. Use '.' first to release the bus.
+				target.address = addr;
+				target.ten_bit_address = false;
+			} break;
+			
+			
+			case I2CM_CMD_ADDR_10BIT: {
+				uint8_t addr_lo;
+				uint8_t addr_hi;
+				CONSUME_BYTE(addr_lo);
+				CONSUME_BYTE(addr_hi);
+				
+				uint16_t addr = ((uint16_t) addr_hi << 8) | addr_lo;
+				
+				if(addr > I2CM_10BIT_ADDR_MAX) {
+					RJTLogger_print("I2CM: bad 10 bit address: %x", addr);
+					RELEASE_BUS_AND_RETURN(RJT_USB_ERROR_PARAMETER);
+				}
+				
+				target.address = addr;
+				target.ten_bit_address = true;
 			} break;
 			
 			
 			default:
-				return RJT_USB_ERROR_PARAMETER;
+				RELEASE_BUS_AND_RETURN(RJT_USB_ERROR_PARAMETER);
 		}
 	}
 
@@ -0,0 +1,365 @@
+/*
+ * rjt_frame.c
+ */ 
+
+#include <string.h>
+
+#include "rjt_frame.h"
+
+#define SLIP_END		0xc0
+#define SLIP_ESC		0xdb
+#define SLIP_ESC_END	0xdc
+#define SLIP_ESC_ESC	0xdd
+
+#define COBS_DELIMITER	0x00
+#define COBS_MAX_CODE	0xff
+
+
+void RJTFrame_initDecoder(RJTFrameDecoder * self, enum RJT_FRAME_MODE mode, uint8_t * buf, size_t max_len)
+{
+	memset(self, 0, sizeof(*self));
+
+	self->mode = mode;
+	self->buf = buf;
+	self->max_len = max_len;
+}
+
+
+static void restart(RJTFrameDecoder * self)
+{
+	self->len = 0;
+	self->done = false;
+	self->discard = false;
+	self->escape = false;
+	self->code = 0;
+	self->remaining = 0;
+	self->pending_zero = false;
+	self->header_num = 0;
+	self->expected = 0;
+}
+
+
+/**
+ * Appends a decoded byte. Returns false once the frame outgrows the
+ * buffer.
+ */
+static bool append(RJTFrameDecoder * self, uint8_t byte)
+{
+	if(self->len >= self->max_len) {
+		return false;
+	}
+
+	self->buf[self->len++] = byte;
+	return true;
+}
+
+
+static enum RJT_FRAME_STATUS decode_slip(RJTFrameDecoder * self, uint8_t byte)
+{
+	if(SLIP_END == byte)
+	{
+		bool is_frame = (false == self->discard) && (0 < self->len);
+
+		if(false == is_frame) {
+			// back to back ENDs, or the end of a dropped frame
+			restart(self);
+			return RJT_FRAME_STATUS_PENDING;
+		}
+
+		return RJT_FRAME_STATUS_DONE;
+	}
+
+	if(self->discard) {
+		return RJT_FRAME_STATUS_PENDING;
+	}
+
+	if(self->escape)
+	{
+		self->escape = false;
+
+		if(SLIP_ESC_END == byte) {
+			byte = SLIP_END;
+		}
+		else if(SLIP_ESC_ESC == byte) {
+			byte = SLIP_ESC;
+		}
+		else {
+			self->discard = true;
+			return RJT_FRAME_STATUS_DECODE_ERROR;
+		}
+	}
+	else if(SLIP_ESC == byte)
+	{
+		self->escape = true;
+		return RJT_FRAME_STATUS_PENDING;
+	}
+
+	if(false == append(self, byte)) {
+		self->discard = true;
+		return RJT_FRAME_STATUS_OVERSIZE;
+	}
+
+	return RJT_FRAME_STATUS_PENDING;
+}
+
+
+/**
+ * Decodes COBS a byte at a time. The zero a block stands for is only
+ * added once the next block starts, so the delimiter drops the one
+ * after the last block.
+ */
+static enum RJT_FRAME_STATUS decode_cobs(RJTFrameDecoder * self, uint8_t byte)
+{
+	if(COBS_DELIMITER == byte)
+	{
+		bool is_frame = (false == self->discard) && (0 == self->remaining) &&
+			(0 < self->len || self->pending_zero);
+
+		if(false == is_frame)
+		{
+			bool truncated = (false == self->discard) && (0 != self->remaining);
+
+			restart(self);
+
+			return truncated ? RJT_FRAME_STATUS_DECODE_ERROR : RJT_FRAME_STATUS_PENDING;
+		}
+
+		return RJT_FRAME_STATUS_DONE;
+	}
+
+	if(self->discard) {
+		return RJT_FRAME_STATUS_PENDING;
+	}
+
+	if(0 == self->remaining)
+	{
+		// a code byte
+		if(self->pending_zero && false == append(self, 0x00)) {
+			self->discard = true;
+			return RJT_FRAME_STATUS_OVERSIZE;
+		}
+
+		self->code = byte;
+		self->remaining = byte - 1;
+
+		// a full block has no zero after it
+		self->pending_zero = (0 == self->remaining) && (COBS_MAX_CODE != byte);
+
+		return RJT_FRAME_STATUS_PENDING;
+	}
+
+	if(false == append(self, byte)) {
+		self->discard = true;
+		return RJT_FRAME_STATUS_OVERSIZE;
+	}
+
+	self->remaining -= 1;
+
+	if(0 == self->remaining) {
+		self->pending_zero = (COBS_MAX_CODE != self->code);
+	}
+
+	return RJT_FRAME_STATUS_PENDING;
+}
+
+
+/**
+ * There is no delimiter to find the next header by after a bad one, so
+ * a header is dropped a byte at a time until one makes sense.
+ */
+static enum RJT_FRAME_STATUS decode_length(RJTFrameDecoder * self, uint8_t byte)
+{
+	if(self->header_num < 2)
+	{
+		self->expected |= (uint16_t) byte << (8 * self->header_num);
+		self->header_num += 1;
+
+		if(self->header_num < 2) {
+			return RJT_FRAME_STATUS_PENDING;
+		}
+
+		if(0 == self->expected) {
+			restart(self);
+			return RJT_FRAME_STATUS_PENDING;
+		}
+
+		if(self->expected > self->max_len) {
+			// the high byte may be the low byte of the real header
+			self->expected >>= 8;
+			self->header_num = 1;
+			return RJT_FRAME_STATUS_OVERSIZE;
+		}
+
+		return RJT_FRAME_STATUS_PENDING;
+	}
+
+	append(self, byte);
+
+	return (self->len == self->expected) ? RJT_FRAME_STATUS_DONE : RJT_FRAME_STATUS_PENDING;
+}
+
+
+/**
+ * Feeds data to the decoder, up to and including the byte that ends a
+ * frame or shows an error. Returns the number of bytes used. On
+ * RJT_FRAME_STATUS_DONE the frame is in buf, len bytes, until the next
+ * call.
+ */
+size_t RJTFrame_decode(RJTFrameDecoder * self, const uint8_t * data, size_t len, enum RJT_FRAME_STATUS * status)
+{
+	if(self->done) {
+		restart(self);
+	}
+
+	*status = RJT_FRAME_STATUS_PENDING;
+
+	for(size_t k = 0; k < len; k++)
+	{
+		switch(self->mode)
+		{
+			case RJT_FRAME_MODE_SLIP:
+				*status = decode_slip(self, data[k]);
+				break;
+			case RJT_FRAME_MODE_COBS:
+				*status = decode_cobs(self, data[k]);
+				break;
+			case RJT_FRAME_MODE_LENGTH:
+				*status = decode_length(self, data[k]);
+				break;
+			default:
+				break;
+		}
+
+		if(RJT_FRAME_STATUS_PENDING != *status)
+		{
+			self->done = (RJT_FRAME_STATUS_DONE == *status);
+			return k + 1;
+		}
+	}
+
+	return len;
+}
+
+
+/**
+ * Worst case size of len bytes once encoded, delimiters included.
+ */
+size_t RJTFrame_getMaxEncodedLen(enum RJT_FRAME_MODE mode, size_t len)
+{
+	switch(mode)
+	{
+		case RJT_FRAME_MODE_SLIP:
+			return 2 * len + 2;
+		case RJT_FRAME_MODE_COBS:
+			return len + (len / (COBS_MAX_CODE - 1)) + 2;
+		case RJT_FRAME_MODE_LENGTH:
+			return len + 2;
+		default:
+			return len;
+	}
+}
+
+
+static size_t encode_slip(const uint8_t * src, size_t len, uint8_t * dst)
+{
+	size_t n = 0;
+
+	// flushes whatever noise the receiver has seen
+	dst[n++] = SLIP_END;
+
+	for(size_t k = 0; k < len; k++)
+	{
+		if(SLIP_END == src[k]) {
+			dst[n++] = SLIP_ESC;
+			dst[n++] = SLIP_ESC_END;
+		}
+		else if(SLIP_ESC == src[k]) {
+			dst[n++] = SLIP_ESC;
+			dst[n++] = SLIP_ESC_ESC;
+		}
+		else {
+			dst[n++] = src[k];
+		}
+	}
+
+	dst[n++] = SLIP_END;
+
+	return n;
+}
+
+
+static size_t encode_cobs(const uint8_t * src, size_t len, uint8_t * dst)
+{
+	size_t code_index = 0;
+	size_t n = 1;
+	uint8_t code = 1;
+
+	for(size_t k = 0; k < len; k++)
+	{
+		if(0x00 == src[k]) {
+			dst[code_index] = code;
+			code_index = n++;
+			code = 1;
+			continue;
+		}
+
+		dst[n++] = src[k];
+		code += 1;
+
+		if(COBS_MAX_CODE == code && k + 1 < len) {
+			dst[code_index] = code;
+			code_index = n++;
+			code = 1;
+		}
+	}
+
+	dst[code_index] = code;
+	dst[n++] = COBS_DELIMITER;
+
+	return n;
+}
+
+
+/**
+ * Encodes len bytes of src into dst, which has to hold
+ * RJTFrame_getMaxEncodedLen() bytes. Returns the encoded length.
+ */
+size_t RJTFrame_encode(enum RJT_FRAME_MODE mode, const uint8_t * src, size_t len, uint8_t * dst)
+{
+	switch(mode)
+	{
+		case RJT_FRAME_MODE_SLIP:
+			return encode_slip(src, len, dst);
+
+		case RJT_FRAME_MODE_COBS:
+			return encode_cobs(src, len, dst);
+
+		case RJT_FRAME_MODE_LENGTH:
+			dst[0] = len & 0xff;
+			dst[1] = (len >> 8) & 0xff;
+			memcpy(&dst[2], src, len);
+			return len + 2;
+
+		default:
+			memcpy(dst, src, len);
+			return len;
+	}
+}
+
+
+/**
+ * CRC-16/CCITT-FALSE (poly 0x1021), start from RJT_FRAME_CRC16_INIT.
+ */
+uint16_t RJTFrame_crc16(uint16_t crc, const uint8_t * data, size_t len)
+{
+	for(size_t k = 0; k < len; k++)
+	{
+		crc ^= (uint16_t) data[k] << 8;
+
+		for(uint8_t bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		}
+	}
+
+	return crc;
+}
@@ -0,0 +1,66 @@
+/*
+ * rjt_frame.h
+ */ 
+
+
+#ifndef RJT_FRAME_H_
+#define RJT_FRAME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+enum RJT_FRAME_MODE {
+	RJT_FRAME_MODE_NONE   = 0x00,
+	RJT_FRAME_MODE_SLIP   = 0x01,	// RFC 1055, END 0xc0 around every frame
+	RJT_FRAME_MODE_COBS   = 0x02,	// 0x00 after every frame
+	RJT_FRAME_MODE_LENGTH = 0x03,	// uint16_t little endian length first
+};
+
+enum RJT_FRAME_STATUS {
+	RJT_FRAME_STATUS_PENDING,		// all data used, no frame yet
+	RJT_FRAME_STATUS_DONE,			// a frame is in the buffer
+	RJT_FRAME_STATUS_DECODE_ERROR,	// bad escape or COBS block, frame dropped
+	RJT_FRAME_STATUS_OVERSIZE,		// frame did not fit the buffer, dropped
+};
+
+#define RJT_FRAME_CRC16_INIT		0xffff
+
+struct RJTFrameDecoder
+{
+	enum RJT_FRAME_MODE mode;
+
+	uint8_t * buf;
+	size_t max_len;
+	size_t len;
+
+	bool done;
+	bool discard;			// dropping data up to the next delimiter
+
+	// SLIP
+	bool escape;
+
+	// COBS
+	uint8_t code;
+	uint8_t remaining;		// data bytes left in the block
+	bool pending_zero;		// the block ended short of 254 bytes
+
+	// length prefixed
+	uint8_t header_num;
+	uint16_t expected;
+};
+
+typedef struct RJTFrameDecoder RJTFrameDecoder;
+
+void RJTFrame_initDecoder(RJTFrameDecoder * self, enum RJT_FRAME_MODE mode, uint8_t * buf, size_t max_len);
+
+size_t RJTFrame_decode(RJTFrameDecoder * self, const uint8_t * data, size_t len, enum RJT_FRAME_STATUS * status);
+
+size_t RJTFrame_getMaxEncodedLen(enum RJT_FRAME_MODE mode, size_t len);
+
+size_t RJTFrame_encode(enum RJT_FRAME_MODE mode, const uint8_t * src, size_t len, uint8_t * dst);
+
+uint16_t RJTFrame_crc16(uint16_t crc, const uint8_t * data, size_t len);
+
+
+#endif /* RJT_FRAME_H_ */
@@ -43,29 +43,51 @@ void RJTLogger_process(void)
 		mDroppedMsg = false;
 	}
 
-	uint8_t buf[64];
-
 	while(true)
 	{
-		system_interrupt_enter_critical_section();
-
-		size_t num2read = MIN(sizeof(buf), RJTQueue_getNumEnqueued(&mLogQueue));
+		// sent straight out of the queue, which keeps the space until
+		// consumed; interrupts stay off for at most 64 bytes at a time
+		const uint8_t * span;
+		size_t num2send = MIN(64, RJTQueue_peekContiguous(&mLogQueue, &span));
 
-		if(0 < num2read) {
-			bool success = RJTQueue_dequeue(&mLogQueue, buf, num2read);
-			ASSERT(true == success);
+		if(0 == num2send) {
+			break;
 		}
 
-		system_interrupt_leave_critical_section();
+		send_bytes(span, num2send);
 
-		if(0 == num2read) {
-			break;
+		bool success = RJTQueue_consume(&mLogQueue, num2send);
+		ASSERT(true == success);
+	}
+}
+#pragma GCC pop_options
+
+
+/**
+ * Moves queued bytes into the UART for as long as it has room for them,
+ * a byte or two, and returns. For the main loop, which RJTLogger_process()
+ * would hold up for the whole time it takes to send the queue.
+ */
+void RJTLogger_service(void)
+{
+	SercomUsart * const hw = &usart_instance.hw->USART;
+
+	if(true == mDroppedMsg)
+	{
+		// goes out after what was queued before the drop
+		const char msg[] = "***DROPPED LOG MSG***\n";
+
+		if(RJTQueue_enqueue(&mLogQueue, (const uint8_t *) msg, strlen(msg))) {
+			mDroppedMsg = false;
 		}
+	}
+
+	uint8_t byte;
 
-		send_bytes(buf, num2read);
+	while(hw->INTFLAG.bit.DRE && RJTQueue_pop(&mLogQueue, &byte)) {
+		hw->DATA.reg = byte;
 	}
 }
-#pragma GCC pop_options
 
 
 void RJTLogger_print(const char fmt[], ...)
@@ -80,8 +102,6 @@ void RJTLogger_print(const char fmt[], ...)
 	va_start(argp, fmt);
 
 	uint8_t buf[128];
-	memset(buf, 0, sizeof(buf));
-
 	size_t bufsize = sizeof(buf) - 1;
 
 	uint8_t buf_offset = RJTSprintf_fromArgList(buf, bufsize, fmt, argp);
@@ -90,14 +110,67 @@ void RJTLogger_print(const char fmt[], ...)
 
 	buf[buf_offset++] = '\n';
 
-	if(RJTQueue_getSpaceAvailable(&mLogQueue) < buf_offset) {
+	// the flag is read again here, a trace from an interrupt may have
+	// dropped one since; nothing may follow a drop until its notice
+	system_interrupt_enter_critical_section();
+
+	if(true == mDroppedMsg || false == RJTQueue_enqueue(&mLogQueue, buf, buf_offset)) {
 		mDroppedMsg = true;
 	}
-	else {
-		RJTQueue_enqueue(&mLogQueue, buf, buf_offset);
+
+	system_interrupt_leave_critical_section();
+}
+
+/**
+ * Called by RJTLogger_trace(), with the ID in record[0] and the args after
+ * it. The record is queued whole or, without the room, not at all.
+ */
+void RJTLogger_traceRecord(const uint32_t record[], uint32_t len)
+{
+	uint32_t num_args = len - 1;
+
+	ASSERT(num_args <= RJT_LOGGER_TRACE_MAX_ARGS);
+
+	uint8_t bytes[3 + 4 * RJT_LOGGER_TRACE_MAX_ARGS];
+	size_t num_bytes = 0;
+
+	bytes[num_bytes++] = RJT_LOGGER_TRACE_MARKER | num_args;
+	bytes[num_bytes++] = record[0] & 0xff;
+	bytes[num_bytes++] = (record[0] >> 8) & 0xff;
+
+	// little endian, as the CPU
+	memcpy(&bytes[num_bytes], &record[1], 4 * num_args);
+	num_bytes += 4 * num_args;
+
+	system_interrupt_enter_critical_section();
+
+	if(true == mDroppedMsg || RJTQueue_getSpaceAvailable(&mLogQueue) < num_bytes) {
+		// as in RJTLogger_print()
+		mDroppedMsg = true;
 	}
+	else
+	{
+		// in place, in two spans when the record wraps around the end
+		size_t done = 0;
+
+		while(done < num_bytes)
+		{
+			uint8_t * span;
+			size_t span_len = MIN(num_bytes - done, RJTQueue_reserveContiguous(&mLogQueue, &span));
+
+			memcpy(span, &bytes[done], span_len);
+
+			bool success = RJTQueue_commit(&mLogQueue, span_len);
+			ASSERT(true == success);
+
+			done += span_len;
+		}
+	}
+
+	system_interrupt_leave_critical_section();
 }
 
+
 void RJTLogger_deinit(void)
 {
 	usart_disable(&usart_instance);
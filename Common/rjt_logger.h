@@ -9,10 +9,49 @@
 #ifndef RJT_LOGGER_H_
 #define RJT_LOGGER_H_
 
+#include <stdint.h>
+
+/**
+ * Binary trace, for paths that cannot afford RJTLogger_print. Nothing is
+ * formatted on the device: a record of the format string's ID and the
+ * raw 32 bit args goes into the log queue, in order with the text, and
+ * Tools/rjt_log_decode.py formats it against the ELF.
+ *
+ * The format strings live in .rjt_log_fmt, which the linker script keeps
+ * out of flash and places at 0, so a string's address is its ID. Args are
+ * taken as uint32_t; %s cannot be traced.
+ *
+ * On the wire a record is RJT_LOGGER_TRACE_MARKER | num_args, the uint16_t
+ * ID and then the args, all little endian. Text is ASCII, so the marker
+ * byte tells the two apart.
+ *
+ * Only builds that define RJT_LOGGER_TRACE, whose linker script has the
+ * section, emit records; elsewhere (the bootloader) the calls compile to
+ * nothing.
+ */
+#define RJT_LOGGER_TRACE_MARKER			0xf0
+#define RJT_LOGGER_TRACE_MAX_ARGS		8
+
+#ifdef RJT_LOGGER_TRACE
+#define RJTLogger_trace(fmt, ...)																	\
+	do {																															\
+		static const char _rjt_fmt[] __attribute__((section(".rjt_log_fmt"), used)) = fmt;	\
+		const uint32_t _rjt_record[] = { (uint32_t) (uintptr_t) _rjt_fmt, ##__VA_ARGS__ };	\
+		RJTLogger_traceRecord(_rjt_record,																\
+			sizeof(_rjt_record) / sizeof(_rjt_record[0]));								\
+	} while(0)
+#else
+#define RJTLogger_trace(fmt, ...)	do { } while(0)
+#endif
+
 void RJTLogger_process(void);
 
+void RJTLogger_service(void);
+
 void RJTLogger_print(const char fmt[], ...);
 
+void RJTLogger_traceRecord(const uint32_t record[], uint32_t len);
+
 void RJTLogger_init(void);
 
 void RJTLogger_deinit(void);
@@ -0,0 +1,419 @@
+/*
+ * rjt_msg_queue.c
+ */ 
+
+#include <string.h>
+#include <asf.h>
+
+#include "rjt_logger.h"
+#include "rjt_msg_queue.h"
+#include "utils.h"
+
+#define CRITICAL_REGION_ENTER()		system_interrupt_enter_critical_section()
+#define CRITICAL_REGION_EXIT()		system_interrupt_leave_critical_section()
+
+#define HEADER_LEN					2
+#define PAD_MARKER					0xffff
+
+
+/**
+ * Records take an even number of bytes in an even sized buffer, so the
+ * room left before the end of the buffer always holds a pad header.
+ */
+static size_t record_len(size_t msg_len)
+{
+	return HEADER_LEN + msg_len + (msg_len & 1);
+}
+
+
+static void write_header(uint8_t * record, uint16_t value)
+{
+	record[0] = value & 0xff;
+	record[1] = (value >> 8) & 0xff;
+}
+
+
+static uint16_t read_header(const uint8_t * record)
+{
+	return record[0] | ((uint16_t) record[1] << 8);
+}
+
+
+/**
+ * Drops the pad at the head, if there is one. A pad always runs to the
+ * end of the buffer.
+ */
+static void skip_pad(RJTMsgQueue * self)
+{
+	const uint8_t * span;
+	size_t span_len = RJTQueue_peekContiguous(&self->queue, &span);
+
+	if(HEADER_LEN <= span_len && PAD_MARKER == read_header(span)) {
+		bool success = RJTQueue_consume(&self->queue, span_len);
+		ASSERT(true == success);
+	}
+}
+
+
+static bool drop_oldest(RJTMsgQueue * self)
+{
+	skip_pad(self);
+
+	if(0 == self->num_msgs || self->peeked) {
+		return false;
+	}
+
+	const uint8_t * span;
+	RJTQueue_peekContiguous(&self->queue, &span);
+
+	bool success = RJTQueue_consume(&self->queue, record_len(read_header(span)));
+	ASSERT(true == success);
+
+	self->num_msgs -= 1;
+	self->dropped_oldest += 1;
+
+	return true;
+}
+
+
+/**
+ * Finds need contiguous bytes at the tail, padding out the end of the
+ * buffer and, by policy, dropping old messages on the way. Returns where
+ * the record goes, NULL if it cannot.
+ */
+static uint8_t * make_room(RJTMsgQueue * self, size_t need)
+{
+	if(need > self->queue.max_len) {
+		return NULL;
+	}
+
+	while(true)
+	{
+		// an empty queue starts over at the front, no pad needed
+		if(0 == RJTQueue_getNumEnqueued(&self->queue)) {
+			RJTQueue_reset(&self->queue);
+		}
+
+		uint8_t * span;
+		size_t span_len = RJTQueue_reserveContiguous(&self->queue, &span);
+
+		if(span_len >= need) {
+			return span;
+		}
+
+		bool is_to_end = (span + span_len == self->queue.data + self->queue.max_len);
+		size_t space_avail = RJTQueue_getSpaceAvailable(&self->queue);
+
+		if(is_to_end && 0 < span_len && space_avail - span_len >= need)
+		{
+			write_header(span, PAD_MARKER);
+
+			bool success = RJTQueue_commit(&self->queue, span_len);
+			ASSERT(true == success);
+			continue;
+		}
+
+		if(RJT_MSG_QUEUE_DROP_OLDEST == self->policy && drop_oldest(self)) {
+			continue;
+		}
+
+		return NULL;
+	}
+}
+
+
+void RJTMsgQueue_init(RJTMsgQueue * self, uint8_t * buffer, size_t len, enum RJT_MSG_QUEUE_POLICY policy)
+{
+	ASSERT(self != NULL);
+
+	// see record_len()
+	ASSERT(0 == (len & 1) && HEADER_LEN < len);
+
+	memset(self, 0, sizeof(*self));
+
+	RJTQueue_init(&self->queue, buffer, len);
+	self->policy = policy;
+}
+
+
+/**
+ * Empties the queue; the drop counters are kept.
+ */
+void RJTMsgQueue_reset(RJTMsgQueue * self)
+{
+	CRITICAL_REGION_ENTER();
+
+	RJTQueue_reset(&self->queue);
+	self->num_msgs = 0;
+	self->reserved = NULL;
+	self->peeked = false;
+
+	CRITICAL_REGION_EXIT();
+}
+
+
+/**
+ * Queues a copy of msg, whole or not at all.
+ */
+bool RJTMsgQueue_enqueue(RJTMsgQueue * self, const uint8_t * msg, size_t len)
+{
+	bool success = false;
+
+	CRITICAL_REGION_ENTER();
+
+	// an open reservation owns the tail
+	uint8_t * record = NULL;
+
+	if(len <= RJT_MSG_QUEUE_MAX_MSG_LEN && NULL == self->reserved) {
+		record = make_room(self, record_len(len));
+	}
+
+	if(NULL != record)
+	{
+		write_header(record, len);
+		memcpy(&record[HEADER_LEN], msg, len);
+
+		success = RJTQueue_commit(&self->queue, record_len(len));
+		ASSERT(true == success);
+
+		self->num_msgs += 1;
+	}
+	else {
+		self->dropped_newest += 1;
+	}
+
+	CRITICAL_REGION_EXIT();
+
+	return success;
+}
+
+
+/**
+ * Sets aside room for a message of up to len bytes and returns where to
+ * write it, NULL without room. Nothing is queued until committed.
+ */
+uint8_t * RJTMsgQueue_reserve(RJTMsgQueue * self, size_t len)
+{
+	uint8_t * record = NULL;
+
+	CRITICAL_REGION_ENTER();
+
+	if(len <= RJT_MSG_QUEUE_MAX_MSG_LEN && NULL == self->reserved) {
+		record = make_room(self, record_len(len));
+	}
+
+	if(NULL != record) {
+		self->reserved = &record[HEADER_LEN];
+		self->reserved_len = len;
+	}
+	else {
+		self->dropped_newest += 1;
+	}
+
+	CRITICAL_REGION_EXIT();
+
+	// not self->reserved, which is someone else's when already set
+	return (NULL != record) ? &record[HEADER_LEN] : NULL;
+}
+
+
+/**
+ * Queues the reserved message, len bytes of it (no more than reserved).
+ */
+bool RJTMsgQueue_commit(RJTMsgQueue * self, size_t len)
+{
+	bool success = false;
+
+	CRITICAL_REGION_ENTER();
+
+	if(NULL != self->reserved && len <= self->reserved_len)
+	{
+		uint8_t * record = self->reserved - HEADER_LEN;
+
+		write_header(record, len);
+
+		success = RJTQueue_commit(&self->queue, record_len(len));
+		ASSERT(true == success);
+
+		self->num_msgs += 1;
+		self->reserved = NULL;
+	}
+
+	CRITICAL_REGION_EXIT();
+
+	return success;
+}
+
+
+/**
+ * Points msg at the oldest message, which stays queued, and safe from
+ * being dropped, until released.
+ */
+bool RJTMsgQueue_peek(RJTMsgQueue * self, const uint8_t ** msg, size_t * len)
+{
+	bool success = false;
+
+	CRITICAL_REGION_ENTER();
+
+	skip_pad(self);
+
+	if(0 < self->num_msgs)
+	{
+		const uint8_t * span;
+		RJTQueue_peekContiguous(&self->queue, &span);
+
+		*len = read_header(span);
+		*msg = &span[HEADER_LEN];
+
+		self->peeked = true;
+		success = true;
+	}
+
+	CRITICAL_REGION_EXIT();
+
+	return success;
+}
+
+
+void RJTMsgQueue_release(RJTMsgQueue * self)
+{
+	CRITICAL_REGION_ENTER();
+
+	ASSERT(true == self->peeked);
+
+	const uint8_t * span;
+	RJTQueue_peekContiguous(&self->queue, &span);
+
+	bool success = RJTQueue_consume(&self->queue, record_len(read_header(span)));
+	ASSERT(true == success);
+
+	self->num_msgs -= 1;
+	self->peeked = false;
+
+	CRITICAL_REGION_EXIT();
+}
+
+
+/**
+ * Copies out the oldest message. One longer than max_len stays queued.
+ */
+bool RJTMsgQueue_dequeue(RJTMsgQueue * self, uint8_t * dst, size_t max_len, size_t * len)
+{
+	const uint8_t * msg;
+
+	if(false == RJTMsgQueue_peek(self, &msg, len)) {
+		return false;
+	}
+
+	if(*len > max_len) {
+		// leaves it for a bigger buffer
+		CRITICAL_REGION_ENTER();
+		self->peeked = false;
+		CRITICAL_REGION_EXIT();
+
+		return false;
+	}
+
+	memcpy(dst, msg, *len);
+
+	RJTMsgQueue_release(self);
+
+	return true;
+}
+
+
+uint32_t RJTMsgQueue_getNumMsgs(RJTMsgQueue * self)
+{
+	return self->num_msgs;
+}
+
+
+void RJTMsgQueue_test(void)
+{
+	bool success;
+	RJTMsgQueue test_queue;
+
+	uint8_t buffer[128];
+	uint8_t msg[64];
+	uint8_t out[64];
+	size_t len;
+
+	RJTMsgQueue_init(&test_queue, buffer, sizeof(buffer), RJT_MSG_QUEUE_DROP_NEWEST);
+
+	// messages of every length from 0, so the pads land everywhere
+	uint8_t next_in = 0;
+	uint8_t next_out = 0;
+
+	for(uint32_t round = 0; round < 500; round++)
+	{
+		size_t msg_len = round % sizeof(msg);
+
+		for(size_t k = 0; k < msg_len; k++) {
+			msg[k] = next_in++;
+		}
+
+		success = RJTMsgQueue_enqueue(&test_queue, msg, msg_len);
+		ASSERT(true == success);
+
+		success = RJTMsgQueue_dequeue(&test_queue, out, sizeof(out), &len);
+		ASSERT(true == success);
+		ASSERT(msg_len == len);
+
+		for(size_t k = 0; k < len; k++) {
+			ASSERT(out[k] == next_out++);
+		}
+	}
+
+	ASSERT(0 == RJTMsgQueue_getNumMsgs(&test_queue));
+
+	// drop newest: 3 records of 42 bytes fit in 128
+	memset(msg, 0x11, sizeof(msg));
+
+	for(uint32_t k = 0; k < 4; k++) {
+		success = RJTMsgQueue_enqueue(&test_queue, msg, 40);
+		ASSERT((k < 3) == success);
+	}
+
+	ASSERT(3 == RJTMsgQueue_getNumMsgs(&test_queue));
+	ASSERT(1 == test_queue.dropped_newest);
+
+	// drop oldest keeps the latest, but never a peeked one
+	test_queue.policy = RJT_MSG_QUEUE_DROP_OLDEST;
+
+	const uint8_t * peeked;
+	success = RJTMsgQueue_peek(&test_queue, &peeked, &len);
+	ASSERT(true == success);
+
+	msg[0] = 0x22;
+	success = RJTMsgQueue_enqueue(&test_queue, msg, 40);
+	ASSERT(false == success);
+
+	RJTMsgQueue_release(&test_queue);
+
+	success = RJTMsgQueue_enqueue(&test_queue, msg, 40);
+	ASSERT(true == success);
+	ASSERT(0 == test_queue.dropped_oldest);
+
+	// in place, full again so it drops
+	uint8_t * reserved = RJTMsgQueue_reserve(&test_queue, 60);
+	ASSERT(NULL != reserved);
+
+	memset(reserved, 0x33, 10);
+
+	success = RJTMsgQueue_commit(&test_queue, 10);
+	ASSERT(true == success);
+	ASSERT(0 < test_queue.dropped_oldest);
+
+	// the newest two are left
+	while(2 < RJTMsgQueue_getNumMsgs(&test_queue)) {
+		RJTMsgQueue_dequeue(&test_queue, out, sizeof(out), &len);
+	}
+
+	success = RJTMsgQueue_dequeue(&test_queue, out, sizeof(out), &len);
+	ASSERT(true == success && 40 == len && 0x22 == out[0]);
+
+	success = RJTMsgQueue_dequeue(&test_queue, out, sizeof(out), &len);
+	ASSERT(true == success && 10 == len && 0x33 == out[9]);
+
+	RJTLogger_print("Msg queue test success!");
+}
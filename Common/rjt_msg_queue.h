@@ -0,0 +1,61 @@
+/*
+ * rjt_msg_queue.h
+ */ 
+
+
+#ifndef RJT_MSG_QUEUE_H_
+#define RJT_MSG_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "rjt_queue.h"
+
+/**
+ * Queue of variable length messages, each stored whole and contiguous
+ * behind a uint16_t length, on top of an RJTQueue. A message that does
+ * not fit before the end of the buffer starts over at the front, behind
+ * a pad record, so both sides can use messages in place.
+ *
+ * Enqueue is all or nothing and safe from any context. Reserve / commit
+ * is for a single producer. Peek / release and dequeue are for a single
+ * consumer; a peeked message is never dropped.
+ */
+enum RJT_MSG_QUEUE_POLICY {
+	RJT_MSG_QUEUE_DROP_NEWEST,		// a message that does not fit is refused
+	RJT_MSG_QUEUE_DROP_OLDEST,		// old messages make room for it
+};
+
+// the length of a message is kept in a uint16_t, and 0xffff marks a pad
+#define RJT_MSG_QUEUE_MAX_MSG_LEN	0xfffe
+
+struct RJTMsgQueue
+{
+	RJTQueue queue;
+	enum RJT_MSG_QUEUE_POLICY policy;
+
+	uint32_t num_msgs;
+	uint32_t dropped_newest;
+	uint32_t dropped_oldest;
+
+	uint8_t * reserved;			// payload of the message being written
+	size_t reserved_len;
+	bool peeked;
+};
+
+typedef struct RJTMsgQueue RJTMsgQueue;
+
+void RJTMsgQueue_init(RJTMsgQueue * self, uint8_t * buffer, size_t len, enum RJT_MSG_QUEUE_POLICY policy);
+void RJTMsgQueue_reset(RJTMsgQueue * self);
+bool RJTMsgQueue_enqueue(RJTMsgQueue * self, const uint8_t * msg, size_t len);
+uint8_t * RJTMsgQueue_reserve(RJTMsgQueue * self, size_t len);
+bool RJTMsgQueue_commit(RJTMsgQueue * self, size_t len);
+bool RJTMsgQueue_peek(RJTMsgQueue * self, const uint8_t ** msg, size_t * len);
+void RJTMsgQueue_release(RJTMsgQueue * self);
+bool RJTMsgQueue_dequeue(RJTMsgQueue * self, uint8_t * dst, size_t max_len, size_t * len);
+uint32_t RJTMsgQueue_getNumMsgs(RJTMsgQueue * self);
+void RJTMsgQueue_test(void);
+
+
+#endif /* RJT_MSG_QUEUE_H_ */
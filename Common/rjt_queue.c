@@ -110,6 +110,109 @@
  }
 
 
+ /**
+  * Copies out up to max_len of the oldest bytes, as many as there are,
+  * and returns how many that was.
+  */
+ size_t RJTQueue_dequeueUpTo(RJTQueue * self, uint8_t * dst, size_t max_len)
+ {
+	 CRITICAL_REGION_ENTER();
+
+	 size_t len = MIN(max_len, self->size);
+	 size_t upper_len = MIN(len, self->max_len - self->head);
+
+	 memcpy(dst, &self->data[self->head], upper_len);
+	 memcpy(&dst[upper_len], &self->data[0], len - upper_len);
+
+	 self->head = (self->head + len) % self->max_len;
+	 self->size -= len;
+
+	 CRITICAL_REGION_EXIT();
+
+	 return len;
+ }
+
+
+ /**
+  * Points span at the oldest bytes and returns how many of them are
+  * contiguous in the buffer. The bytes stay queued until consumed.
+  */
+ size_t RJTQueue_peekContiguous(RJTQueue * self, const uint8_t ** span)
+ {
+	 CRITICAL_REGION_ENTER();
+
+	 size_t len = MIN(self->size, self->max_len - self->head);
+	 *span = &self->data[self->head];
+
+	 CRITICAL_REGION_EXIT();
+
+	 return len;
+ }
+
+
+ /**
+  * Drops len bytes from the head, for a reader that used them in place
+  * (e.g. a DMA transfer out of the queue buffer).
+  */
+ bool RJTQueue_consume(RJTQueue * self, size_t len)
+ {
+	 bool success = false;
+
+	 CRITICAL_REGION_ENTER();
+
+	 if(len <= self->size)
+	 {
+		 self->head = (self->head + len) % self->max_len;
+		 self->size -= len;
+		 success = true;
+	 }
+
+	 CRITICAL_REGION_EXIT();
+
+	 return success;
+ }
+
+
+ /**
+  * Points span at the free space after the tail and returns how much
+  * of it is contiguous. Nothing is queued until committed; the one
+  * writer has to commit before reserving again.
+  */
+ size_t RJTQueue_reserveContiguous(RJTQueue * self, uint8_t ** span)
+ {
+	 CRITICAL_REGION_ENTER();
+
+	 size_t len = MIN(self->max_len - self->size, self->max_len - self->tail);
+	 *span = &self->data[self->tail];
+
+	 CRITICAL_REGION_EXIT();
+
+	 return len;
+ }
+
+
+ /**
+  * Queues len bytes written in place after RJTQueue_reserveContiguous().
+  */
+ bool RJTQueue_commit(RJTQueue * self, size_t len)
+ {
+	 bool success = false;
+
+	 CRITICAL_REGION_ENTER();
+
+	 if(len <= self->max_len - self->size)
+	 {
+		 self->tail = (self->tail + len) % self->max_len;
+		 self->size += len;
+		 success = true;
+	 }
+
+	 CRITICAL_REGION_EXIT();
+
+	 return success;
+ }
+
+
  size_t RJTQueue_getSpaceAvailable(RJTQueue * self)
  {
 	 return self->max_len - self->size;
@@ -249,6 +352,23 @@
 
 	 ASSERT(0 == RJTQueue_getNumEnqueued(&test_queue));
 
+	 // Partial dequeue, across the wrap
+	 success = RJTQueue_enqueue(&test_queue, test_data, sizeof(test_data) - 8);
+	 ASSERT(true == success);
+
+	 size_t num_read = RJTQueue_dequeueUpTo(&test_queue, test_data, sizeof(test_data) - 16);
+	 ASSERT(sizeof(test_data) - 16 == num_read);
+
+	 success = RJTQueue_enqueue(&test_queue, test_data, 32);
+	 ASSERT(true == success);
+
+	 num_read = RJTQueue_dequeueUpTo(&test_queue, test_data, sizeof(test_data));
+	 ASSERT(8 + 32 == num_read);
+	 ASSERT(0 == RJTQueue_getNumEnqueued(&test_queue));
+
+	 num_read = RJTQueue_dequeueUpTo(&test_queue, test_data, sizeof(test_data));
+	 ASSERT(0 == num_read);
+
 	 // Test push and pop
 	 for(uint32_t k = 0; k < sizeof(test_data); k++) {
 		 success = RJTQueue_push(&test_queue, (k&0xff));
@@ -27,6 +27,11 @@ typedef struct RJTQueue RJTQueue;
 bool RJTQueue_pop(RJTQueue * self, uint8_t * val);
 bool RJTQueue_push(RJTQueue * self, uint8_t val);
 bool RJTQueue_dequeue(RJTQueue * self, uint8_t * dst, size_t len);
+size_t RJTQueue_dequeueUpTo(RJTQueue * self, uint8_t * dst, size_t max_len);
+size_t RJTQueue_peekContiguous(RJTQueue * self, const uint8_t ** span);
+bool RJTQueue_consume(RJTQueue * self, size_t len);
+size_t RJTQueue_reserveContiguous(RJTQueue * self, uint8_t ** span);
+bool RJTQueue_commit(RJTQueue * self, size_t len);
 size_t RJTQueue_getSpaceAvailable(RJTQueue * self);
 size_t RJTQueue_getNumEnqueued(RJTQueue * self);
 bool RJTQueue_enqueue(RJTQueue * self, uint8_t const * buffer, size_t len);
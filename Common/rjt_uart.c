@@ -14,104 +14,454 @@
 #include "rjt_queue.h"
 #include "utils.h"
 #include "rjt_uart.h"
+#include "rjt_timer.h"
 #include "udi_vendor.h"
+#include "rjt_usb_bridge.h"
 
 /**
- * PB00 - SERCOM5/PAD[2]
- * PB01 - SERCOM5/PAD[3]
- * PB02 - SERCOM5/PAD[0]
- * PB03 - SERCOM5/PAD[1]
- * PB04
- * PB05
- * PB06
- * PB07
- * PB08 - SERCOM4/PAD[0]
- * PB09 - SERCOM4/PAD[1]
- * PB10 - SERCOM4/PAD[2]
- * PB11 - SERCOM4/PAD[3]
+ * Ports, one per CDC port:
+ *
+ * 0 - SERCOM4  PA12 TX (PAD[0])  PA13 RX (PAD[1])  PA14 RTS  PA15 CTS (PAD[3])
+ * 1 - SERCOM0  PA04 TX (PAD[0])  PA05 RX (PAD[1])
+ * 2 - SERCOM1  PA16 TX (PAD[0])  PA17 RX (PAD[1])
+ *
+ * SERCOM5 belongs to the SPI / I2C bridge on PB00 - PB03 and SERCOM3 to
+ * the logger. Every port has its own rx ring, tx queue and pair of DMA
+ * channels. The rx channels re-trigger themselves through the event
+ * system, which only DMAC channels 0 - 3 are wired to, so RJTUart_init()
+ * allocates them before anything else takes a channel.
+ *
+ * How many of the ports are in use is down to UDI_CDC_PORT_NB, see
+ * conf_usb.h for the endpoints that limit it.
+ */
+#define NUM_PORTS					UDI_CDC_PORT_NB
+
+#if NUM_PORTS > RJT_UART_MAX_PORTS
+#error "more CDC ports than UART ports"
+#endif
+
+/**
+ * Every SERCOM runs from the 48 MHz DFLL generator, so 16x fractional
+ * sampling reaches 3 Mbaud with an exact divider and 8x fractional
+ * takes it to 6 Mbaud. The 3 bit fraction keeps the error of the odd
+ * rates in between low; the actual rate and its error are kept in the
+ * port's line_info.
+ */
+#define UART_GCLK_GENERATOR			GCLK_GENERATOR_1
+#define UART_GCLK_HZ				48000000UL
+#define UART_MAX_BAUD_16X			(UART_GCLK_HZ / 16)
+#define UART_MAX_BAUD				(UART_GCLK_HZ / 8)
+#define UART_MIN_BAUD				1200
+
+
+/**
+ * Flow control (port 0 only):
+ *
+ * PA14 - RTS, gpio output, low while we can take more data
+ * PA15 - CTS, SERCOM4/PAD[3], the SERCOM holds back the next character
+ *        while it is high
+ *
+ * The SERCOM's own RTS only looks at its two character receive buffer,
+ * which the RX DMA keeps empty, so RTS is driven from the fill level
+ * of the rx ring instead. It is checked every USB frame and whenever the
+ * ring is read, so the high watermark has to leave room for about a
+ * millisecond of traffic.
+ *
+ * PA15 is also the button of the xplained board, which the bridge
+ * gives up while flow control is on.
+ *
+ * The CDC DTR and RTS control lines of any port can be put on gpios,
+ * driven low while asserted.
+ */
+#define UART_NO_PIN					0xff
+
+struct UartHardware
+{
+	Sercom * sercom;
+	IRQn_Type irq;
+	uint8_t dmac_id_rx;
+	uint8_t dmac_id_tx;
+
+	uint32_t pinmux_tx;			// PAD[0]
+	uint32_t pinmux_rx;			// PAD[1]
+
+	// UART_NO_PIN / PINMUX_UNUSED without flow control
+	uint8_t  rts_pin;
+	uint32_t pinmux_cts;		// PAD[3]
+};
+
+static const struct UartHardware mHardware[RJT_UART_MAX_PORTS] = {
+	{
+		.sercom = SERCOM4,
+		.irq = SERCOM4_IRQn,
+		.dmac_id_rx = SERCOM4_DMAC_ID_RX,
+		.dmac_id_tx = SERCOM4_DMAC_ID_TX,
+		//.pinmux_tx = PINMUX_PB08D_SERCOM4_PAD0,
+		.pinmux_tx = PINMUX_PA12D_SERCOM4_PAD0,
+		//.pinmux_rx = PINMUX_PB09D_SERCOM4_PAD1,
+		.pinmux_rx = PINMUX_PA13D_SERCOM4_PAD1,
+		.rts_pin = PIN_PA14,
+		.pinmux_cts = PINMUX_PA15D_SERCOM4_PAD3,
+	},
+	{
+		.sercom = SERCOM0,
+		.irq = SERCOM0_IRQn,
+		.dmac_id_rx = SERCOM0_DMAC_ID_RX,
+		.dmac_id_tx = SERCOM0_DMAC_ID_TX,
+		.pinmux_tx = PINMUX_PA04D_SERCOM0_PAD0,
+		.pinmux_rx = PINMUX_PA05D_SERCOM0_PAD1,
+		.rts_pin = UART_NO_PIN,
+		.pinmux_cts = PINMUX_UNUSED,
+	},
+	{
+		.sercom = SERCOM1,
+		.irq = SERCOM1_IRQn,
+		.dmac_id_rx = SERCOM1_DMAC_ID_RX,
+		.dmac_id_tx = SERCOM1_DMAC_ID_TX,
+		.pinmux_tx = PINMUX_PA16C_SERCOM1_PAD0,
+		.pinmux_rx = PINMUX_PA17C_SERCOM1_PAD1,
+		.rts_pin = UART_NO_PIN,
+		.pinmux_cts = PINMUX_UNUSED,
+	},
+};
+
+
+/**
+ * The TX DMA channel reads straight out of the tx queue, one beat per
+ * data register empty trigger. A queue that wraps is sent with two
+ * chained descriptors. The bytes stay in the queue while the DMA reads
+ * them and are only consumed from the completion interrupt, which then
+ * re-arms the channel with whatever was queued meanwhile.
+ */
+
+// sized for a few ms of traffic at 3 Mbaud
+#define TX_QUEUE_LEN				512
+
+// The way this is coded, the rx ring size has to be a power of 2
+#define RX_RING_BUF_LOG2_OF_SIZE	11
+#define RX_RING_BUF_SIZE			(1 << RX_RING_BUF_LOG2_OF_SIZE)
+#define RX_RING_BUF_MASK			(RX_RING_BUF_SIZE - 1)
+
+/**
+ * Overrun detection:
+ *
+ * The RX DMA never stops, so a ring position alone cannot tell a full
+ * ring from an empty one, nor notice it being lapped. The DMA position
+ * is sampled every USB frame and every pass of the main loop, and the
+ * distance moved is added to a running count of bytes received. 2048
+ * bytes take over 3 ms even at 6 Mbaud, so no lap is missed between
+ * samples.
+ *
+ * Once the received count is more than a ring ahead of the consumed
+ * count, unread data has been overwritten. The unread bytes are then
+ * dropped and reading picks up again at the DMA position.
+ */
+
+/**
+ * RX aggregation:
+ *
+ * Received data is held in the ring until threshold bytes are there
+ * (one full speed packet by default) or the oldest of it has waited
+ * timeout_us. The check runs from the main loop and from the USB start
+ * of frame callback, so a main loop held up by the logger does not
+ * hold the data up past the timeout; both sides send from within a
+ * critical section. A timeout of 0 sends data as soon as it is seen.
+ */
+#define RX_AGGREGATE_DEFAULT_THRESHOLD	64
+#define RX_AGGREGATE_DEFAULT_TIMEOUT_US	1000
+
+
+/**
+ * Streaming, see RJTUart_setStream():
+ *
+ * A streamed port leaves CDC and sends its received data to the vendor
+ * stream endpoint as timestamped records. The data still goes through
+ * the DMA ring; only the timestamps come from an interrupt. With start
+ * of frame detection on, the SERCOM flags every start bit (RXS), and
+ * the handler reads the timer there. A start bit that follows a line
+ * gap, or every STREAM_MARK_INTERVAL characters of a burst, leaves a
+ * mark: the ring count of the character and the time of its start bit.
+ * The time of any other byte is worked out from the last mark before it
+ * at one character time per byte.
+ *
+ * An interrupt per character limits streamed rates to a few hundred
+ * kbaud at 8 MHz; faster lines lose marks, not data, and their records
+ * come out flagged lost.
+ *
+ * Records are built in the start of frame callback, straight out of
+ * the rings of all streamed ports, oldest first. A port whose next
+ * character has started but not landed yet holds back the others, so
+ * two ports (the two sides of a line, or the bridge's own TX looped
+ * back into a second port) merge in time order. Records go into one of
+ * two buffers while the other is on the endpoint.
  */
+#define STREAM_MARK_RING_LOG2_OF_SIZE	5
+#define STREAM_MARK_RING_LEN		(1 << STREAM_MARK_RING_LOG2_OF_SIZE)
+#define STREAM_MARK_RING_MASK		(STREAM_MARK_RING_LEN - 1)
+
+#define STREAM_MARK_INTERVAL		RJT_UART_STREAM_MAX_DATA
+#define STREAM_BUFFER_LEN			512
+
+/**
+ * Framing, see RJTUart_setFraming():
+ *
+ * A framed port decodes what it receives into whole frames and hands
+ * each to CDC as {uint16_t length, payload}. A frame is only written to
+ * an empty CDC buffer, which the next start of frame sends as a
+ * transfer of its own, so a host that reads the endpoint gets one frame
+ * per read; that also caps a port at a frame per millisecond.
+ *
+ * The host writes frames the same way, {uint16_t length, payload}, and
+ * the port encodes each onto the uart. With CRC on, a CRC-16/CCITT of
+ * the payload goes after it on the line, little endian, and frames
+ * received with a bad one are dropped.
+ */
+#define FRAME_CRC_LEN				2
+#define FRAME_BUFFER_LEN			(RJT_UART_FRAME_MAX_LEN + FRAME_CRC_LEN)
+
+// bytes decoded per call, bounds the time spent in the USB interrupt on
+// a line that never delimits
+#define FRAME_DECODE_BUDGET			256
+
+typedef struct
+{
+	uint32_t index;				// rx ring count of the character
+	uint32_t time;				// its start bit, us
+} StreamMark_t;
+
+
+typedef struct
+{
+	uint8_t port;
+	const struct UartHardware * hw;
+
+	struct usart_module uart;
+
+	usb_cdc_line_coding_t line_coding;
+	struct RJTUartLineInfo line_info;
+
+	struct {
+		bool enabled;
+		bool paused;
+		uint16_t high_watermark;
+		uint16_t low_watermark;
+
+		uint8_t dtr_gpio;		// UART_NO_PIN for none
+		uint8_t rts_gpio;
+	} flow;
 
-static struct usart_module mUart;
+	struct {
+		uint16_t threshold;
+		uint32_t timeout_us;
 
-static uint8_t mTxInProgressBuffer[32];
-static bool	mTxInProgress;
+		bool pending;
+		uint32_t pending_since;
+	} aggregate;
 
-static uint8_t  mTxQueueBuffer[256];
-static RJTQueue mTxQueue;
+	volatile bool cdc_enabled;
 
-// The way this is coded, mRxRingBuf size has to be a power of 2
-#define RX_RING_BUF_LOG2_OF_SIZE	10
-#define RX_RING_BUF_MASK					((1 << RX_RING_BUF_LOG2_OF_SIZE) - 1)
-static uint8_t  mRxRingBuf[(1 << RX_RING_BUF_LOG2_OF_SIZE)];
-static size_t   mRxRingBufIndex = 0;
+	bool tx_in_progress;
+	size_t tx_in_flight;
 
+	uint8_t  tx_queue_buffer[TX_QUEUE_LEN];
+	RJTQueue tx_queue;
+
+	uint8_t  rx_ring[RX_RING_BUF_SIZE];
+	size_t   rx_ring_index;
+
+	// overrun detection, see above
+	size_t   rx_dma_pos;
+	uint32_t rx_produced;
+	uint32_t rx_consumed;
+
+	struct RJTUartStats stats;
+
+	struct {
+		enum RJT_FRAME_MODE mode;
+		bool crc;
+
+		// uart to host
+		RJTFrameDecoder decoder;
+		uint8_t rx_buffer[FRAME_BUFFER_LEN];
+		bool rx_ready;				// a good frame waits for CDC
+		uint16_t rx_len;
+		uint16_t rx_sent;			// of the length header and the frame
+
+		// host to uart
+		uint8_t tx_header[2];
+		uint8_t tx_header_num;
+		uint16_t tx_expected;
+		uint16_t tx_len;
+		uint8_t tx_buffer[FRAME_BUFFER_LEN];
+	} frame;
+
+	struct {
+		bool enabled;
+		uint8_t sercom_index;
+		uint32_t bits_per_char;
+		uint32_t char_time_us;		// rounded up
+		uint32_t mark_gap_us;		// start to start, for a new mark
+
+		// the start bit interrupt's side of the mark ring
+		bool started;
+		uint32_t last_start;
+		uint16_t since_mark;
+		volatile uint8_t mark_head;
+
+		StreamMark_t marks[STREAM_MARK_RING_LEN];
+
+		// the record builder's side
+		volatile uint8_t mark_tail;
+		bool has_current;
+		StreamMark_t current;
+
+		// marks or data went missing since the last record
+		volatile bool lost;
+	} stream;
+
+	// The rx DMA channel, and the event channel that re-triggers it;
+	// its event output is routed back to its input
+	struct dma_resource rx_dma;
+	struct events_resource rx_dma_event;
+
+	struct dma_resource tx_dma;
+} UartPort_t;
+
+
+static UartPort_t mPorts[NUM_PORTS];
+
+// frames are encoded here on their way to a tx queue, main loop only
+static uint8_t mFrameEncodeBuffer[2 * FRAME_BUFFER_LEN + 2];
+
+#if (2 * FRAME_BUFFER_LEN + 2) > TX_QUEUE_LEN
+#error "an encoded frame has to fit the tx queue"
+#endif
+
+static struct {
+	uint8_t port_mask;
+	uint16_t gap_us;
+
+	uint8_t buffers[2][STREAM_BUFFER_LEN];
+	uint8_t active;
+	size_t fill;
+} mStream;
 
-static volatile bool mCDCEnabled = false;
 static uint32_t mCurrentTicks;
 static uint32_t mLastTicks;
 
 
-// The DMA channel object
-static struct dma_resource mDMA;
+// The DMA memory descriptors of the rx rings
+static COMPILER_ALIGNED(16)
+DmacDescriptor mRxDMADescriptors[NUM_PORTS] SECTION_DMAC_DESCRIPTOR;
 
-// The DMA memory descriptor the UART rx buffer
-static COMPILER_ALIGNED(16) 
-DmacDescriptor mDMADescriptor SECTION_DMAC_DESCRIPTOR;
-
-// The Event channel for re-triggering the DMAC
-// it's event output is re-routed back to it's input
-static struct events_resource mDMAEventChannel;
+static COMPILER_ALIGNED(16)
+DmacDescriptor mTxDMADescriptors[NUM_PORTS][2] SECTION_DMAC_DESCRIPTOR;
 
 extern DmacDescriptor _write_back_section[CONF_MAX_USED_CHANNEL_NUM];
 
 
+static UartPort_t * get_port(uint8_t port)
+{
+	return (port < NUM_PORTS) ? &mPorts[port] : NULL;
+}
+
+
 /************************************************************************
- * UART Callbacks
+ * UART TX DMA
  ************************************************************************/
 
-static void dequeue_and_transmit(void)
+static void create_tx_descriptor(UartPort_t * self, DmacDescriptor * desc,
+		const uint8_t * src, size_t len, DmacDescriptor * next)
+{
+	struct dma_descriptor_config desc_config;
+	dma_descriptor_get_config_defaults(&desc_config);
+
+	// only the last block of the chain interrupts
+	desc_config.block_action = (NULL == next) ? DMA_BLOCK_ACTION_INT : DMA_BLOCK_ACTION_NOACT;
+
+	// the DMAC wants the end address of an incrementing buffer
+	desc_config.src_increment_enable = true;
+	desc_config.source_address = (uint32_t) src + len;
+
+	desc_config.dst_increment_enable = false;
+	desc_config.destination_address = (uint32_t) &self->hw->sercom->USART.DATA.reg;
+
+	desc_config.block_transfer_count = len;
+	desc_config.next_descriptor_address = (uint32_t) next;
+
+	dma_descriptor_create(desc, &desc_config);
+}
+
+
+static void dequeue_and_transmit(UartPort_t * self)
 {
 	system_interrupt_enter_critical_section();
 
-	if(0 < RJTQueue_getNumEnqueued(&mTxQueue))
+	RJTQueue * queue = &self->tx_queue;
+	DmacDescriptor * descriptors = mTxDMADescriptors[self->port];
+
+	size_t num_enqueued = RJTQueue_getNumEnqueued(queue);
+
+	if(false == self->tx_in_progress && 0 < num_enqueued)
 	{
-		// Start transmission
-			
-		// Dequeue data
-		size_t num2dequeue = 
-			MIN(RJTQueue_getNumEnqueued(&mTxQueue), sizeof(mTxInProgressBuffer));
-		
-		RJTQueue_dequeue(
-			&mTxQueue, 
-			mTxInProgressBuffer, 
-			num2dequeue);
-
-		// Start transmit job
-		enum status_code res =
-		usart_write_buffer_job(
-			&mUart, 
-			mTxInProgressBuffer, 
-			num2dequeue);
-			
+		// Send everything queued, in place. A wrapped queue needs a
+		// second block from the start of the buffer.
+		size_t upper_len = MIN(num_enqueued, queue->max_len - queue->head);
+		size_t lower_len = num_enqueued - upper_len;
+
+		if(0 < lower_len) {
+			create_tx_descriptor(self, &descriptors[0], &queue->data[queue->head],
+				upper_len, &descriptors[1]);
+			create_tx_descriptor(self, &descriptors[1], &queue->data[0],
+				lower_len, NULL);
+		}
+		else {
+			create_tx_descriptor(self, &descriptors[0], &queue->data[queue->head],
+				upper_len, NULL);
+		}
+
+		dma_reset_descriptor(&self->tx_dma);
+		dma_add_descriptor(&self->tx_dma, &descriptors[0]);
+
+		enum status_code res = dma_start_transfer_job(&self->tx_dma);
 		ASSERT(STATUS_OK == res);
 
-		//RJTLogger_print("UART: sending %d bytes", num2dequeue);
+		RJTLogger_trace("UART: sending %d bytes", num_enqueued);
 
-		mTxInProgress = true;
-	}
-	else {
-		mTxInProgress = false;
+		self->tx_in_flight = num_enqueued;
+		self->tx_in_progress = true;
 	}
 
 	system_interrupt_leave_critical_section();
 }
 
 
-static void callback_transmitted(struct usart_module * module)
+static void callback_tx_dma_done(struct dma_resource * const resource)
 {
-	//RJTLogger_print("UART: transmitted");
+	UartPort_t * self = NULL;
+
+	for(uint8_t k = 0; k < NUM_PORTS; k++) {
+		if(resource == &mPorts[k].tx_dma) {
+			self = &mPorts[k];
+		}
+	}
 
-	dequeue_and_transmit();
+	ASSERT(NULL != self);
+
+	system_interrupt_enter_critical_section();
+
+	// the DMA is done reading, hand the space back to the queue
+	bool success = RJTQueue_consume(&self->tx_queue, self->tx_in_flight);
+	ASSERT(true == success);
+
+	self->stats.tx_bytes += self->tx_in_flight;
+
+	self->tx_in_flight = 0;
+	self->tx_in_progress = false;
+
+	dequeue_and_transmit(self);
+
+	system_interrupt_leave_critical_section();
 }
 
 
@@ -120,45 +470,156 @@ static void callback_transmitted(struct usart_module * module)
  ************************************************************************/
 
 
-static void init_and_enable_uart(uint32_t baudrate)
+/**
+ * Rate the SERCOM actually runs at, from the fractional BAUD register.
+ */
+static uint32_t get_actual_baudrate(UartPort_t * self, uint8_t sample_num)
+{
+	uint16_t baud = self->hw->sercom->USART.BAUD.reg;
+	uint32_t eighths = 8 * (baud & SERCOM_USART_BAUD_FRAC_BAUD_Msk) +
+		((baud & SERCOM_USART_BAUD_FRAC_FP_Msk) >> SERCOM_USART_BAUD_FRAC_FP_Pos);
+
+	if(0 == eighths) {
+		return 0;
+	}
+
+	return (uint32_t) ((8ULL * UART_GCLK_HZ) / ((uint64_t) sample_num * eighths));
+}
+
+
+static void stream_rxs_handler(uint8_t instance);
+
+
+static void init_and_enable_uart(UartPort_t * self, const usb_cdc_line_coding_t * coding)
 {
-	// Initialize UART, use SERCOM4
 	struct usart_config config;
 	usart_get_config_defaults(&config);
 
+	uint32_t baudrate = le32_to_cpu(coding->dwDTERate);
+
+	// usart_init() below retries until it succeeds, so never hand it
+	// a rate it cannot make
+	baudrate = MAX(baudrate, UART_MIN_BAUD);
+	baudrate = MIN(baudrate, UART_MAX_BAUD);
+
+	config.generator_source = UART_GCLK_GENERATOR;
 	config.baudrate = baudrate;
-	config.mux_setting = USART_RX_1_TX_0_XCK_1;
-	//config.pinmux_pad0 = PINMUX_PB08D_SERCOM4_PAD0;
-	config.pinmux_pad0 = PINMUX_PA12D_SERCOM4_PAD0;
-	
-	//config.pinmux_pad1 = PINMUX_PB09D_SERCOM4_PAD1;
-	config.pinmux_pad1 = PINMUX_PA13D_SERCOM4_PAD1;
 
+	uint8_t sample_num;
+
+	if(baudrate <= UART_MAX_BAUD_16X) {
+		config.sample_rate = USART_SAMPLE_RATE_16X_FRACTIONAL;
+		sample_num = 16;
+	}
+	else {
+		config.sample_rate = USART_SAMPLE_RATE_8X_FRACTIONAL;
+		config.sample_adjustment = USART_SAMPLE_ADJUSTMENT_7_8_9;
+		sample_num = 8;
+	}
+
+	// the DMA moves bytes, so 9 bit characters are not offered
+	const enum usart_character_size databits2size[] = {
+		[5] = USART_CHARACTER_SIZE_5BIT,
+		[6] = USART_CHARACTER_SIZE_6BIT,
+		[7] = USART_CHARACTER_SIZE_7BIT,
+		[8] = USART_CHARACTER_SIZE_8BIT,
+	};
+
+	uint8_t data_bits = coding->bDataBits;
+
+	if(data_bits < 5 || data_bits > 8) {
+		data_bits = 8;
+	}
+
+	config.character_size = databits2size[data_bits];
+
+	// mark and space parity have no SERCOM mode
+	switch(coding->bParityType)
+	{
+		case CDC_PAR_ODD:
+			config.parity = USART_PARITY_ODD;
+			break;
+		case CDC_PAR_EVEN:
+			config.parity = USART_PARITY_EVEN;
+			break;
+		default:
+			config.parity = USART_PARITY_NONE;
+			break;
+	}
+
+	// 1.5 stop bits is taken as 2
+	config.stopbits = (CDC_STOP_BITS_1 == coding->bCharFormat) ?
+		USART_STOPBITS_1 : USART_STOPBITS_2;
+
+	config.mux_setting = USART_RX_1_TX_0_XCK_1;
+	config.pinmux_pad0 = self->hw->pinmux_tx;
+	config.pinmux_pad1 = self->hw->pinmux_rx;
 	config.pinmux_pad2 = PINMUX_UNUSED;
 	config.pinmux_pad3 = PINMUX_UNUSED;
-	
-	NVIC_SetPriority(SERCOM4_IRQn, APP_LOW_PRIORITY);
 
-	while(usart_init(&mUart, SERCOM4, &config) != STATUS_OK);
+	if(self->flow.enabled) {
+		// PAD[2] is left to the gpio RTS, see above
+		config.mux_setting = USART_RX_1_TX_0_RTS_2_CTS_3;
+		config.pinmux_pad3 = self->hw->pinmux_cts;
+	}
+
+	// start bits are timestamped while streaming, see above
+	config.start_frame_detection_enable = self->stream.enabled;
+
+	NVIC_SetPriority(self->hw->irq, APP_LOW_PRIORITY);
+
+	self->hw->sercom->USART.INTENCLR.reg = SERCOM_USART_INTENCLR_RXS;
+
+	while(usart_init(&self->uart, self->hw->sercom, &config) != STATUS_OK);
+
+	self->line_coding = *coding;
+
+	struct RJTUartLineInfo * info = &self->line_info;
+
+	info->baudrate = baudrate;
+	info->actual_baudrate = get_actual_baudrate(self, sample_num);
+	info->error_ppm = (int32_t)
+		((((int64_t) info->actual_baudrate - baudrate) * 1000000) / baudrate);
+	info->data_bits = data_bits;
+	info->parity = (USART_PARITY_NONE == config.parity) ? CDC_PAR_NONE : coding->bParityType;
+	info->stop_bits = (USART_STOPBITS_1 == config.stopbits) ? 1 : 2;
+	info->oversampling = sample_num;
+
+	uint32_t actual_baudrate = MAX(info->actual_baudrate, 1);
+
+	self->stream.bits_per_char = 1 + data_bits +
+		((USART_PARITY_NONE == config.parity) ? 0 : 1) + info->stop_bits;
+	self->stream.char_time_us =
+		(self->stream.bits_per_char * 1000000UL + actual_baudrate - 1) / actual_baudrate;
+	self->stream.mark_gap_us = self->stream.char_time_us + mStream.gap_us;
 
-	// Register Callbacks
+	// Transmit is done by the TX DMA channel, no transmit callbacks.
+	// Receive errors are polled, see poll_line_errors()
 
-	usart_register_callback(&mUart,
-	callback_transmitted, USART_CALLBACK_BUFFER_TRANSMITTED);
-	
-	usart_enable_callback(&mUart, USART_CALLBACK_BUFFER_TRANSMITTED);
+	if(self->stream.enabled) {
+		// usart_init() put the ASF handler back
+		self->stream.sercom_index = _sercom_get_sercom_inst_index(self->hw->sercom);
+		_sercom_set_handler(self->stream.sercom_index, stream_rxs_handler);
 
-	usart_enable_callback(&mUart, USART_CALLBACK_ERROR);
+		self->hw->sercom->USART.INTFLAG.reg = SERCOM_USART_INTFLAG_RXS;
+		self->hw->sercom->USART.INTENSET.reg = SERCOM_USART_INTENSET_RXS;
+	}
 
-	usart_enable(&mUart);
+	usart_enable(&self->uart);
 }
 
 
-bool user_callback_cdc_enable(void)
+bool user_callback_cdc_enable(uint8_t port)
 {
-	RJTLogger_print("cdc enabled");
-	 
-	mCDCEnabled = true;
+	RJTLogger_print("cdc %d enabled", port);
+
+	UartPort_t * self = get_port(port);
+
+	if(NULL == self) {
+		return false;
+	}
+
+	self->cdc_enabled = true;
 
 	mCurrentTicks = 0;
 	mLastTicks = 0;
@@ -168,19 +629,58 @@ bool user_callback_cdc_enable(void)
 
 void user_callback_cdc_disable(uint8_t port)
 {
-	(void) port;
-	mCDCEnabled = false;
+	UartPort_t * self = get_port(port);
+
+	if(NULL != self) {
+		self->cdc_enabled = false;
+	}
 }
 
 
 void user_callback_cdc_set_line_coding(uint8_t port, usb_cdc_line_coding_t * cfg)
 {
+	UartPort_t * self = get_port(port);
+
+	if(NULL == self) {
+		return;
+	}
+
 	RJTLogger_print("setting line encoding...");
-	RJTLogger_print("baud: %d", cfg->dwDTERate);
 
-	usart_disable(&mUart);
+	usart_disable(&self->uart);
+
+	init_and_enable_uart(self, cfg);
+
+	RJTLogger_print("port %d baud: %d actual: %d (%d ppm)", port,
+		self->line_info.baudrate, self->line_info.actual_baudrate, self->line_info.error_ppm);
+}
+
+
+static void set_control_line(uint8_t gpio, bool asserted)
+{
+	if(UART_NO_PIN != gpio) {
+		port_pin_set_output_level(gpio, !asserted);
+	}
+}
+
+
+void user_callback_cdc_set_dtr(uint8_t port, bool b_enable)
+{
+	UartPort_t * self = get_port(port);
+
+	if(NULL != self) {
+		set_control_line(self->flow.dtr_gpio, b_enable);
+	}
+}
+
+
+void user_callback_cdc_set_rts(uint8_t port, bool b_enable)
+{
+	UartPort_t * self = get_port(port);
 
-	init_and_enable_uart(cfg->dwDTERate);
+	if(NULL != self) {
+		set_control_line(self->flow.rts_gpio, b_enable);
+	}
 }
 
 
@@ -189,226 +689,853 @@ void user_callback_cdc_set_line_coding(uint8_t port, usb_cdc_line_coding_t * cfg
  */
 void user_callback_cdc_rx_notify(uint8_t port)
 {
-	//RJTLogger_print("rx notify!");
+	RJTLogger_trace("rx notify!");
 }
 
 /************************************************************************
  * Private
  ************************************************************************/
 
+/**
+ * Keeps the tx queue high water mark, call with the queue just grown.
+ */
+static void note_tx_queue_level(UartPort_t * self)
+{
+	size_t num_enqueued = RJTQueue_getNumEnqueued(&self->tx_queue);
+
+	if(num_enqueued > self->stats.tx_queue_high_water) {
+		self->stats.tx_queue_high_water = num_enqueued;
+	}
+}
+
+
 /**
  * Return the available space in the uart tx queue (data we send out)
  */
-static size_t get_write_queue_available_space(void)
+static size_t get_write_queue_available_space(UartPort_t * self)
 {
-	return RJTQueue_getSpaceAvailable(&mTxQueue);
+	return RJTQueue_getSpaceAvailable(&self->tx_queue);
 }
 
 
 /**
  * Enqueue data in the write queue (data we send out)
  */
-static void enqueue_into_write_queue(const uint8_t * indata, size_t len)
+static void enqueue_into_write_queue(UartPort_t * self, const uint8_t * indata, size_t len)
 {
 	// Enter critical section, we don't want the queue growing unexpectedly in this code
 	system_interrupt_enter_critical_section();
 
-	size_t space_avail = RJTQueue_getSpaceAvailable(&mTxQueue);
+	size_t space_avail = RJTQueue_getSpaceAvailable(&self->tx_queue);
 	ASSERT(space_avail >= len);
 
-	bool success = RJTQueue_enqueue(&mTxQueue, indata, len);
-	ASSERT(true == success);
+	bool success = RJTQueue_enqueue(&self->tx_queue, indata, len);
+	ASSERT(true == success);
+
+	note_tx_queue_level(self);
+
+	// nothing happens while a transfer is running, its completion
+	// picks up the new data
+	dequeue_and_transmit(self);
+
+	system_interrupt_leave_critical_section();
+
+	RJTLogger_trace("uart tx %d bytes", len);
+}
+
+
+/**
+ * Returns the index where the DMAC will write to next
+ */
+static size_t get_rx_ringbuf_pos(UartPort_t * self)
+{
+	/*
+		RJTLogger_print(
+			"[%d] num trans: %d",
+			DMAC->ACTIVE.bit.ID,
+			DMAC->ACTIVE.bit.BTCNT);
+	*/
+	// BTCNT represents number of bytes to send until the ring buffer is
+	// depleted.
+	// BTCNT starts off at zero, but after the DMAC transfers 1 byte, BTCNT
+	// becomes buffer size - 1. After transferring 2 bytes, it
+	// reads buffer size - 2
+	//
+	// DMAC->ACTIVE only holds the channel that ran last. Once the TX
+	// channel (or any other) has run, the RX count is in the write back
+	// descriptor, stored there when the arbiter switched channels.
+	uint8_t channel_id = self->rx_dma.channel_id;
+	uint32_t active = DMAC->ACTIVE.reg;
+	uint16_t btcnt;
+
+	if(((active & DMAC_ACTIVE_ID_Msk) >> DMAC_ACTIVE_ID_Pos) == channel_id) {
+		btcnt = (active & DMAC_ACTIVE_BTCNT_Msk) >> DMAC_ACTIVE_BTCNT_Pos;
+	}
+	else {
+		btcnt = _write_back_section[channel_id].BTCNT.reg;
+	}
+
+	return (RX_RING_BUF_SIZE - btcnt) % RX_RING_BUF_SIZE;
+}
+
+
+/**
+ * Brings the received count up to the DMA position and checks the ring
+ * for an overrun, see above. Returns the number of unread bytes.
+ */
+static size_t sample_rx_ring(UartPort_t * self)
+{
+	system_interrupt_enter_critical_section();
+
+	size_t pos = get_rx_ringbuf_pos(self);
+	uint32_t num_received = (pos - self->rx_dma_pos) & RX_RING_BUF_MASK;
+
+	self->rx_dma_pos = pos;
+	self->rx_produced += num_received;
+	self->stats.rx_bytes += num_received;
+
+	uint32_t num_unread = self->rx_produced - self->rx_consumed;
+
+	if(num_unread > RX_RING_BUF_SIZE)
+	{
+		self->stats.rx_overruns += 1;
+		self->stats.rx_dropped += num_unread;
+
+		self->rx_consumed = self->rx_produced;
+		self->rx_ring_index = pos;
+		num_unread = 0;
+
+		self->stream.lost = true;
+	}
+
+	if(num_unread > self->stats.rx_ring_high_water) {
+		self->stats.rx_ring_high_water = num_unread;
+	}
+
+	system_interrupt_leave_critical_section();
+
+	return num_unread;
+}
+
+
+/**
+ * Get the number of bytes available for reading (data received by the uart)
+ */
+static size_t get_num_readable(UartPort_t * self)
+{
+	return sample_rx_ring(self);
+}
+
+
+/**
+ * Points span at the oldest unread bytes of the rx ring and returns
+ * how many of them are contiguous. They stay in the ring until
+ * consumed with consume_rx_ring().
+ */
+static size_t peek_rx_ring(UartPort_t * self, const uint8_t ** span)
+{
+	size_t num_readable = get_num_readable(self);
+
+	*span = &self->rx_ring[self->rx_ring_index];
+
+	return MIN(num_readable, RX_RING_BUF_SIZE - self->rx_ring_index);
+}
+
+
+/**
+ * Drives RTS from the fill level of the rx ring, with hysteresis.
+ */
+static void update_rts(UartPort_t * self)
+{
+	if(false == self->flow.enabled) {
+		return;
+	}
+
+	system_interrupt_enter_critical_section();
+
+	size_t num_readable = get_num_readable(self);
+
+	if(false == self->flow.paused && num_readable >= self->flow.high_watermark) {
+		port_pin_set_output_level(self->hw->rts_pin, true);
+		self->flow.paused = true;
+	}
+	else if(true == self->flow.paused && num_readable <= self->flow.low_watermark) {
+		port_pin_set_output_level(self->hw->rts_pin, false);
+		self->flow.paused = false;
+	}
+
+	system_interrupt_leave_critical_section();
+}
+
+
+/**
+ * Hands num peeked bytes back to the ring. Any overwrite of them while
+ * they were being read laps the read index first and shows up as an
+ * overrun here, in which case the ring has already moved on.
+ */
+static void consume_rx_ring(UartPort_t * self, size_t num)
+{
+	system_interrupt_enter_critical_section();
+
+	if(num <= sample_rx_ring(self)) {
+		self->rx_consumed += num;
+		self->rx_ring_index = (self->rx_ring_index + num) & RX_RING_BUF_MASK;
+	}
+
+	system_interrupt_leave_critical_section();
+
+	update_rts(self);
+}
+
+
+/**
+ * Counts the receive errors the SERCOM flagged since the last poll.
+ * Each flag is sticky until cleared, so errors of one kind within the
+ * same millisecond count once; polling keeps a stream of garbage (a
+ * wrong baudrate) from becoming an interrupt per character.
+ */
+static void poll_line_errors(UartPort_t * self)
+{
+	const uint16_t error_mask = SERCOM_USART_STATUS_FERR |
+		SERCOM_USART_STATUS_PERR | SERCOM_USART_STATUS_BUFOVF;
+
+	SercomUsart * const hw = &self->hw->sercom->USART;
+
+	uint16_t status = hw->STATUS.reg & error_mask;
+
+	if(0 == status) {
+		return;
+	}
+
+	if(status & SERCOM_USART_STATUS_FERR) {
+		self->stats.frame_errors += 1;
+	}
+
+	if(status & SERCOM_USART_STATUS_PERR) {
+		self->stats.parity_errors += 1;
+	}
+
+	if(status & SERCOM_USART_STATUS_BUFOVF) {
+		self->stats.buffer_overflows += 1;
+	}
+
+	hw->STATUS.reg = status;
+	hw->INTFLAG.reg = SERCOM_USART_INTFLAG_ERROR;
+}
+
+
+/**
+ * True once the data in the rx ring is due for the host, see above.
+ */
+static bool is_rx_aggregate_due(UartPort_t * self, size_t num_readable)
+{
+	if(0 == num_readable) {
+		self->aggregate.pending = false;
+		return false;
+	}
+
+	uint32_t now = RJTTimer_getTimestamp();
+
+	if(false == self->aggregate.pending) {
+		self->aggregate.pending = true;
+		self->aggregate.pending_since = now;
+	}
+
+	return (num_readable >= self->aggregate.threshold) ||
+	       ((now - self->aggregate.pending_since) >= self->aggregate.timeout_us);
+}
+
+
+/**
+ * Send data to host, straight out of the rx ring. Called from the main
+ * loop and the start of frame callback, in a critical section.
+ */
+static void process_cdc_tx(UartPort_t * self)
+{
+	// Send the UART RX Data (to the host)
+	if(false == udi_cdc_multi_is_tx_ready(self->port)) {
+		return;
+	}
+
+	if(false == is_rx_aggregate_due(self, get_num_readable(self))) {
+		return;
+	}
+
+	const uint8_t * span;
+	size_t span_len = peek_rx_ring(self, &span);
+
+	if(0 == span_len) {
+		return;
+	}
+
+	iram_size_t num_written = 0;
+
+	enum UDI_CDC_STATUS status =
+	udi_cdc_multi_write_buf_no_block(
+		self->port,
+		span,
+		span_len,
+		&num_written);
+
+	if(UDI_CDC_STATUS_OK == status) {
+		// whatever did not fit goes with the next call, which
+		// finds it already due
+		consume_rx_ring(self, num_written);
+
+		if(0 == get_num_readable(self)) {
+			self->aggregate.pending = false;
+		}
+	}
+	else {
+		// An error occurred, try again later
+	}
+}
+
+
+/************************************************************************
+ * Streaming
+ ************************************************************************/
+
+/**
+ * Start bit interrupt of the streamed ports, in place of the ASF usart
+ * handler. Leaves a mark on a gap, see above.
+ */
+static void stream_rxs_handler(uint8_t instance)
+{
+	UartPort_t * self = NULL;
+
+	for(uint8_t k = 0; k < NUM_PORTS; k++) {
+		if(mPorts[k].stream.enabled && instance == mPorts[k].stream.sercom_index) {
+			self = &mPorts[k];
+		}
+	}
+
+	if(NULL == self) {
+		return;
+	}
+
+	SercomUsart * const hw = &self->hw->sercom->USART;
+
+	if(0 == (hw->INTFLAG.reg & SERCOM_USART_INTFLAG_RXS)) {
+		return;
+	}
+
+	hw->INTFLAG.reg = SERCOM_USART_INTFLAG_RXS;
+
+	uint32_t now = RJTTimer_getTimestamp();
+
+	bool is_mark = (false == self->stream.started) ||
+		((now - self->stream.last_start) > self->stream.mark_gap_us) ||
+		(self->stream.since_mark >= STREAM_MARK_INTERVAL);
+
+	self->stream.started = true;
+	self->stream.last_start = now;
+
+	if(false == is_mark) {
+		self->stream.since_mark += 1;
+		return;
+	}
+
+	self->stream.since_mark = 1;
+
+	uint8_t head = self->stream.mark_head;
+	uint8_t next = (head + 1) & STREAM_MARK_RING_MASK;
+
+	if(next == self->stream.mark_tail) {
+		self->stream.lost = true;
+		return;
+	}
+
+	// the character lands at the DMA position, which may not have been
+	// sampled into rx_produced yet
+	system_interrupt_enter_critical_section();
+
+	StreamMark_t * mark = &self->stream.marks[head];
+	mark->index = self->rx_produced +
+		((get_rx_ringbuf_pos(self) - self->rx_dma_pos) & RX_RING_BUF_MASK);
+	mark->time = now;
+
+	system_interrupt_leave_critical_section();
+
+	self->stream.mark_head = next;
+}
+
+
+/**
+ * Moves marks at or before the read position (strictly before, unless
+ * inclusive) into the current mark.
+ */
+static void stream_retire_marks(UartPort_t * self, bool inclusive)
+{
+	while(self->stream.mark_tail != self->stream.mark_head)
+	{
+		StreamMark_t * mark = &self->stream.marks[self->stream.mark_tail];
+		int32_t ahead = (int32_t) (mark->index - self->rx_consumed);
+
+		if(ahead > 0 || (0 == ahead && false == inclusive)) {
+			break;
+		}
+
+		self->stream.current = *mark;
+		self->stream.has_current = true;
+
+		self->stream.mark_tail = (self->stream.mark_tail + 1) & STREAM_MARK_RING_MASK;
+	}
+}
+
+
+enum STREAM_STATE {
+	STREAM_STATE_IDLE,
+	STREAM_STATE_WAITING,		// a character has started, none landed
+	STREAM_STATE_READY,
+};
+
+/**
+ * Where a streamed port stands, with the timestamp of its next byte
+ * when there is one.
+ */
+static enum STREAM_STATE stream_get_state(UartPort_t * self, size_t num_readable, uint32_t * time)
+{
+	if(0 == num_readable)
+	{
+		// marks left behind by an overrun
+		stream_retire_marks(self, false);
+
+		if(self->stream.mark_tail == self->stream.mark_head) {
+			return STREAM_STATE_IDLE;
+		}
+
+		StreamMark_t * mark = &self->stream.marks[self->stream.mark_tail];
+
+		// a start bit without a character (a glitch) must not hold
+		// the other ports back for good
+		if((RJTTimer_getTimestamp() - mark->time) > 2 * self->stream.char_time_us + 1000)
+		{
+			self->stream.mark_tail = (self->stream.mark_tail + 1) & STREAM_MARK_RING_MASK;
+			self->stream.lost = true;
+			return STREAM_STATE_IDLE;
+		}
+
+		*time = mark->time;
+		return STREAM_STATE_WAITING;
+	}
+
+	stream_retire_marks(self, true);
+
+	if(false == self->stream.has_current)
+	{
+		// its mark is lost, all there is to go by is now
+		*time = RJTTimer_getTimestamp();
+		return STREAM_STATE_READY;
+	}
+
+	uint32_t num_chars = self->rx_consumed - self->stream.current.index;
+
+	*time = self->stream.current.time + (uint32_t)
+		(((uint64_t) num_chars * self->stream.bits_per_char * 1000000) /
+		 MAX(self->line_info.actual_baudrate, 1));
+
+	return STREAM_STATE_READY;
+}
+
+
+/**
+ * Moves the next record of a port into the stream buffer. Returns false
+ * once the buffer is too full for it.
+ */
+static bool stream_write_record(UartPort_t * self, uint32_t time)
+{
+	size_t space = STREAM_BUFFER_LEN - mStream.fill;
+
+	if(space <= sizeof(struct RJTUartStreamRecord)) {
+		return false;
+	}
+
+	const uint8_t * span;
+	size_t len = peek_rx_ring(self, &span);
+
+	len = MIN(len, RJT_UART_STREAM_MAX_DATA);
+	len = MIN(len, space - sizeof(struct RJTUartStreamRecord));
+
+	// a record ends at the next mark, which brings its own time
+	if(self->stream.mark_tail != self->stream.mark_head) {
+		uint32_t to_mark = self->stream.marks[self->stream.mark_tail].index - self->rx_consumed;
+		len = MIN(len, to_mark);
+	}
+
+	struct RJTUartStreamRecord record = {
+		.flags = self->port,
+		.len = len,
+		.timestamp_us = time,
+	};
+
+	if(false == self->stream.has_current || self->stream.current.index != self->rx_consumed) {
+		record.flags |= RJT_UART_STREAM_FLAG_CONTINUED;
+	}
+
+	if(self->stream.lost) {
+		self->stream.lost = false;
+		record.flags |= RJT_UART_STREAM_FLAG_LOST;
+	}
+
+	uint8_t * dst = &mStream.buffers[mStream.active][mStream.fill];
+
+	memcpy(dst, &record, sizeof(record));
+	memcpy(dst + sizeof(record), span, len);
+
+	mStream.fill += sizeof(record) + len;
+
+	consume_rx_ring(self, len);
+
+	return true;
+}
+
+
+/**
+ * Fills the stream buffer from the streamed ports, oldest byte first,
+ * until nothing is ready, a port is waiting or the buffer is full.
+ */
+static void stream_build_records(void)
+{
+	for(;;)
+	{
+		UartPort_t * oldest = NULL;
+		enum STREAM_STATE oldest_state = STREAM_STATE_IDLE;
+		uint32_t oldest_time = 0;
+
+		for(uint8_t k = 0; k < NUM_PORTS; k++)
+		{
+			UartPort_t * self = &mPorts[k];
+
+			if(false == self->stream.enabled) {
+				continue;
+			}
+
+			uint32_t time;
+			enum STREAM_STATE state = stream_get_state(self, get_num_readable(self), &time);
+
+			if(STREAM_STATE_IDLE == state) {
+				continue;
+			}
+
+			if(NULL == oldest || (int32_t) (time - oldest_time) < 0) {
+				oldest = self;
+				oldest_state = state;
+				oldest_time = time;
+			}
+		}
+
+		if(STREAM_STATE_READY != oldest_state) {
+			return;
+		}
+
+		if(false == stream_write_record(oldest, oldest_time)) {
+			return;
+		}
+	}
+}
+
+
+static void process_stream(void)
+{
+	if(0 == mStream.port_mask) {
+		return;
+	}
+
+	stream_build_records();
+
+	if(0 < mStream.fill &&
+	   RJTUSBBridge_streamWrite(mStream.buffers[mStream.active], mStream.fill))
+	{
+		mStream.active ^= 1;
+		mStream.fill = 0;
+
+		// anything left behind by a full buffer
+		stream_build_records();
+	}
+}
+
+
+/************************************************************************
+ * Framing
+ ************************************************************************/
+
+/**
+ * Decodes the rx ring up to the next good frame, then sends it to the
+ * host once the CDC buffer is empty. Called from the main loop and the
+ * start of frame callback, in a critical section.
+ */
+static void process_frame_tx(UartPort_t * self)
+{
+	size_t budget = FRAME_DECODE_BUDGET;
+
+	while(false == self->frame.rx_ready && 0 < budget)
+	{
+		const uint8_t * span;
+		size_t span_len = MIN(peek_rx_ring(self, &span), budget);
+
+		if(0 == span_len) {
+			break;
+		}
+
+		enum RJT_FRAME_STATUS status;
+		size_t num_used = RJTFrame_decode(&self->frame.decoder, span, span_len, &status);
+
+		consume_rx_ring(self, num_used);
+		budget -= num_used;
+
+		if(RJT_FRAME_STATUS_DECODE_ERROR == status || RJT_FRAME_STATUS_OVERSIZE == status) {
+			self->stats.decode_errors += 1;
+			continue;
+		}
+
+		if(RJT_FRAME_STATUS_DONE != status) {
+			continue;
+		}
+
+		size_t len = self->frame.decoder.len;
+
+		if(self->frame.crc)
+		{
+			if(len < FRAME_CRC_LEN) {
+				self->stats.crc_errors += 1;
+				continue;
+			}
+
+			len -= FRAME_CRC_LEN;
+
+			uint16_t crc = self->frame.rx_buffer[len] |
+				((uint16_t) self->frame.rx_buffer[len + 1] << 8);
+
+			if(crc != RJTFrame_crc16(RJT_FRAME_CRC16_INIT, self->frame.rx_buffer, len)) {
+				self->stats.crc_errors += 1;
+				continue;
+			}
+		}
+
+		if(len > RJT_UART_FRAME_MAX_LEN) {
+			self->stats.decode_errors += 1;
+			continue;
+		}
+
+		if(0 < len) {
+			self->frame.rx_len = len;
+			self->frame.rx_sent = 0;
+			self->frame.rx_ready = true;
+		}
+	}
+
+	if(false == self->frame.rx_ready) {
+		return;
+	}
+
+	uint8_t header[2] = {
+		self->frame.rx_len & 0xff,
+		(self->frame.rx_len >> 8) & 0xff,
+	};
+
+	uint16_t total = sizeof(header) + self->frame.rx_len;
+
+	// a frame is started only in an empty buffer, see above, and only
+	// when it fits whole, so the host never waits on half of one
+	if(0 == self->frame.rx_sent &&
+	   (false == udi_cdc_multi_is_tx_empty(self->port) ||
+	    udi_cdc_multi_get_free_tx_buffer(self->port) < total)) {
+		return;
+	}
+
+	// picks up where a short write left off
+	while(self->frame.rx_sent < total)
+	{
+		const uint8_t * src;
+		iram_size_t src_len;
+
+		if(self->frame.rx_sent < sizeof(header)) {
+			src = &header[self->frame.rx_sent];
+			src_len = sizeof(header) - self->frame.rx_sent;
+		}
+		else {
+			src = &self->frame.rx_buffer[self->frame.rx_sent - sizeof(header)];
+			src_len = total - self->frame.rx_sent;
+		}
+
+		iram_size_t num_written = 0;
+
+		enum UDI_CDC_STATUS status =
+			udi_cdc_multi_write_buf_no_block(self->port, src, src_len, &num_written);
+
+		if(UDI_CDC_STATUS_OK != status || 0 == num_written) {
+			// try again later
+			return;
+		}
 
-	if(false == mTxInProgress)
-	{
-		dequeue_and_transmit();
+		self->frame.rx_sent += num_written;
 	}
 
-	system_interrupt_leave_critical_section();
-
-	//RJTLogger_print("uart tx %d bytes", len);
+	self->frame.rx_ready = false;
+	self->stats.rx_frames += 1;
 }
 
 
-/**
- * Returns the index where the DMAC will write to next
- */
-static size_t get_rx_ringbuf_pos(void)
+static void uart_sof_callback(void)
 {
-	/*
-		RJTLogger_print(
-			"[%d] num trans: %d", 
-			DMAC->ACTIVE.bit.ID, 
-			DMAC->ACTIVE.bit.BTCNT);
-	*/
-	// BTCNT represents number of bytes to send until the ring buffer is 
-	// depleted.
-	// BTCNT starts off at zero, but after the DMAC transfers 1 byte, BTCNT
-	// becomes buffer size - 1. After transferring 2 bytes, it 
-	// reads buffer size - 2
-	return (sizeof(mRxRingBuf) - DMAC->ACTIVE.bit.BTCNT) % sizeof(mRxRingBuf);
-}
+	for(uint8_t k = 0; k < NUM_PORTS; k++)
+	{
+		UartPort_t * self = &mPorts[k];
 
+		update_rts(self);
 
-/**
- * Get the number of bytes available for reading (data received by the uart)
- */
-static size_t get_num_readable(void)
-{
-	size_t ringbuf_pos = get_rx_ringbuf_pos();
-	size_t num_avail = (ringbuf_pos - mRxRingBufIndex) & RX_RING_BUF_MASK;
+		poll_line_errors(self);
+
+		// bounds the rx latency while the main loop is busy elsewhere
+		if(self->cdc_enabled && false == self->stream.enabled) {
+			if(RJT_FRAME_MODE_NONE != self->frame.mode) {
+				process_frame_tx(self);
+			}
+			else {
+				process_cdc_tx(self);
+			}
+		}
+	}
 
-	return num_avail;
+	process_stream();
 }
 
+SOF_REGISTER_CALLBACK(uart_sof_callback);
+
 
 /**
- * Dequeue data from the read queue (data received by the uart)
+ * Retrieve data written to us from the host, straight into the tx
+ * queue.
  */
-static void dequeue_from_read_queue(uint8_t * outdata, size_t num)
+static void process_cdc_rx(UartPort_t * self)
 {
-	ASSERT(num <= get_num_readable());
+	// Read the data the host sent us, so we can send it (via UART tx)
 
-	for(size_t k = 0; k < num; k++) {
-		outdata[k] = mRxRingBuf[mRxRingBufIndex];
-		mRxRingBufIndex = (mRxRingBufIndex + 1) & RX_RING_BUF_MASK;
+	if(false == udi_cdc_multi_is_rx_ready(self->port)) {
+		return;
 	}
-}
 
+	uint8_t * span;
+	size_t span_len = RJTQueue_reserveContiguous(&self->tx_queue, &span);
 
-struct CachedBuffer {
-	uint8_t  buf[64];
-	 size_t  buf_pos;
-	 size_t  buf_size;
-	   bool  dirty;
-};
+	if(0 == span_len) {
+		// tx queue full, the data waits in the CDC buffer
+		return;
+	}
+
+	iram_size_t num_read = 0;
+	enum UDI_CDC_STATUS status =
+		udi_cdc_multi_read_no_block(self->port, span, span_len, &num_read);
+
+	if(UDI_CDC_STATUS_OK == status && 0 < num_read)
+	{
+		bool success = RJTQueue_commit(&self->tx_queue, num_read);
+		ASSERT(true == success);
+
+		note_tx_queue_level(self);
+
+		dequeue_and_transmit(self);
+	}
+	else {
+		// an error occurred, or nothing to read
+	}
+}
 
 
 /**
- * Send data to host.
+ * Encodes the frame the host finished writing into the tx queue.
+ * Returns false while the queue has no room for it.
  */
-static void process_cdc_tx(void)
+static bool send_frame(UartPort_t * self)
 {
-	static struct CachedBuffer write_buf = {0};
-
-	// Send the UART RX Data (to the host)
-	if(false == udi_cdc_is_tx_ready()) {
-		return;
-	}
+	size_t len = self->frame.tx_len;
 
-	if(false == write_buf.dirty)
-	{
-		// load data into write buffer
-		size_t num_readable = get_num_readable();
-				
-		if(0 < num_readable) {
-			size_t num2read;
+	if(self->frame.crc) {
+		uint16_t crc = RJTFrame_crc16(RJT_FRAME_CRC16_INIT, self->frame.tx_buffer, len);
 
-			num2read = MIN(sizeof(write_buf.buf), num_readable);
+		self->frame.tx_buffer[len++] = crc & 0xff;
+		self->frame.tx_buffer[len++] = (crc >> 8) & 0xff;
+	}
 
-			// read from the uart rx buffer
-			dequeue_from_read_queue(write_buf.buf, num2read);
-			
-			// reset buffer to beginning
-			write_buf.buf_size = num2read;
-			write_buf.buf_pos = 0;
-			write_buf.dirty = true;
-		}
+	// only the main loop adds to the queue, so the room found here
+	// can only grow
+	if(RJTQueue_getSpaceAvailable(&self->tx_queue) <
+	   RJTFrame_getMaxEncodedLen(self->frame.mode, len)) {
+		return false;
 	}
-	
-	if(true == write_buf.dirty)
-	{
-		iram_size_t num_written = 0;
 
-		uint8_t * buf_ptr = &write_buf.buf[write_buf.buf_pos];
-		size_t buf_len = write_buf.buf_size - write_buf.buf_pos;
-				
-		enum UDI_CDC_STATUS status =
-		udi_cdc_multi_write_buf_no_block(
-			0,
-			buf_ptr,
-			buf_len,
-			&num_written);
+	size_t encoded_len =
+		RJTFrame_encode(self->frame.mode, self->frame.tx_buffer, len, mFrameEncodeBuffer);
 
-		if(UDI_CDC_STATUS_OK == status) {
-			// advance buffer pointer using num_written variable
-			write_buf.buf_pos += num_written;
+	enqueue_into_write_queue(self, mFrameEncodeBuffer, encoded_len);
 
-			ASSERT(write_buf.buf_pos <= write_buf.buf_size);
+	self->stats.tx_frames += 1;
 
-			if(write_buf.buf_pos == write_buf.buf_size) {
-				// we've consumed all the data
-				write_buf.dirty = false;
-			}
-		}
-		else {
-			// An error occurred, try again later
-		}
-	}
+	self->frame.tx_header_num = 0;
+	self->frame.tx_len = 0;
+
+	return true;
 }
 
 
 /**
- * Retrieve data written to us from the host.
+ * Reads {uint16_t length, payload} frames the host wrote and sends each
+ * out encoded once complete. A length of 0 or over
+ * RJT_UART_FRAME_MAX_LEN is dropped, and the data after it taken as the
+ * next header.
  */
-static void process_cdc_rx(void)
+static void process_frame_rx(UartPort_t * self)
 {
-	static struct CachedBuffer read_buf = {0};
+	bool is_complete = (2 == self->frame.tx_header_num) &&
+		(self->frame.tx_len == self->frame.tx_expected);
 
-	// Read the data the host sent us, so we can send it (via UART tx)
-	
-	if(false == udi_cdc_is_rx_ready()) {
+	// a frame held up by a full tx queue goes first
+	if(is_complete && false == send_frame(self)) {
+		return;
+	}
+
+	if(false == udi_cdc_multi_is_rx_ready(self->port)) {
 		return;
 	}
-	
 
-	if(false == read_buf.dirty)
+	iram_size_t num_read = 0;
+
+	if(self->frame.tx_header_num < 2)
 	{
-		iram_size_t num_avail = udi_cdc_get_nb_received_data();
+		udi_cdc_multi_read_no_block(self->port,
+			&self->frame.tx_header[self->frame.tx_header_num],
+			2 - self->frame.tx_header_num, &num_read);
 
-		if(0 < num_avail)
-		{
-			size_t num2read;
+		self->frame.tx_header_num += num_read;
 
-			// read the received data
-			num2read = MIN(num_avail, sizeof(read_buf.buf));
+		if(self->frame.tx_header_num < 2) {
+			return;
+		}
 
-			iram_size_t num_read = 0;
-			enum UDI_CDC_STATUS status = 
-				udi_cdc_multi_read_no_block(0, read_buf.buf, num2read, &num_read);
-	
-			if(UDI_CDC_STATUS_OK == status) {
-				ASSERT(0 < num_read);
+		self->frame.tx_expected = self->frame.tx_header[0] |
+			((uint16_t) self->frame.tx_header[1] << 8);
+		self->frame.tx_len = 0;
 
-				read_buf.buf_pos = 0;
-				read_buf.buf_size = num_read;
-				read_buf.dirty = true;
-			}
-			else {
-				// an error occurred
-			}
+		if(0 == self->frame.tx_expected || self->frame.tx_expected > RJT_UART_FRAME_MAX_LEN) {
+			self->stats.decode_errors += 1;
+			self->frame.tx_header_num = 0;
+			return;
 		}
-	}
 
-	if(true == read_buf.dirty)
-	{
-		size_t write_queue_space = get_write_queue_available_space();
-		
-		size_t buf_len = read_buf.buf_size - read_buf.buf_pos;
-		uint8_t * buf_ptr = &read_buf.buf[read_buf.buf_pos];
+		if(false == udi_cdc_multi_is_rx_ready(self->port)) {
+			return;
+		}
+	}
 
-		size_t num2enqueue = MIN(buf_len, write_queue_space);
-		
-		enqueue_into_write_queue(buf_ptr, num2enqueue);
-		
-		read_buf.buf_pos += num2enqueue;
+	udi_cdc_multi_read_no_block(self->port,
+		&self->frame.tx_buffer[self->frame.tx_len],
+		self->frame.tx_expected - self->frame.tx_len, &num_read);
 
-		ASSERT(read_buf.buf_pos <= read_buf.buf_size);
+	self->frame.tx_len += num_read;
 
-		if(read_buf.buf_pos == read_buf.buf_size) {
-			// consumed all the data
-			read_buf.dirty = false;
-		}
+	if(self->frame.tx_len == self->frame.tx_expected) {
+		send_frame(self);
 	}
 }
 
@@ -427,13 +1554,39 @@ static void process_cdc_rx(void)
 
 void RJTUart_processCDC(void)
 {
-	if(false == mCDCEnabled) {
-		return;
-	}
+	for(uint8_t k = 0; k < NUM_PORTS; k++)
+	{
+		UartPort_t * self = &mPorts[k];
+
+		// keeps the overrun check going while no host reads
+		sample_rx_ring(self);
 
-	process_cdc_tx();
+		if(false == self->cdc_enabled) {
+			continue;
+		}
+
+		// shared with the start of frame callback; a streamed port's
+		// data goes to the vendor interface instead
+		if(false == self->stream.enabled) {
+			system_interrupt_enter_critical_section();
+
+			if(RJT_FRAME_MODE_NONE != self->frame.mode) {
+				process_frame_tx(self);
+			}
+			else {
+				process_cdc_tx(self);
+			}
+
+			system_interrupt_leave_critical_section();
+		}
 
-	process_cdc_rx();
+		if(RJT_FRAME_MODE_NONE != self->frame.mode) {
+			process_frame_rx(self);
+		}
+		else {
+			process_cdc_rx(self);
+		}
+	}
 
 	//system_interrupt_leave_critical_section();
 
@@ -477,7 +1630,7 @@ static void dma_sof_callback(void)
 	if(count >= 1000) {
 		count = 0;
 
-		RJTLogger_print("dma ptr [%d / %d]", mRxRingBufIndex, get_rx_ringbuf_pos());
+		RJTLogger_print("dma ptr [%d / %d]", mPorts[0].rx_ring_index, get_rx_ringbuf_pos(&mPorts[0]));
 	}
 }
 
@@ -490,101 +1643,399 @@ SOF_REGISTER_CALLBACK(dma_sof_callback);
  * DMA event beat transfer -> DMA trigger
  * This way, the DMA re-arms itself everytime it transfers a byte
  */
-static void init_beat_event(void)
+static void init_beat_event(UartPort_t * self)
 {
+	uint8_t channel_id = self->rx_dma.channel_id;
+
+	// only DMAC channels 0 - 3 have event lines
+	ASSERT(channel_id < 4);
+
 	struct events_config config;
 
 	events_get_config_defaults(&config);
 
-	// the event generator comes from DMAC channel 0
-	config.generator    = EVSYS_ID_GEN_DMAC_CH_0;
+	// the event generator comes from the rx DMAC channel
+	config.generator    = EVSYS_ID_GEN_DMAC_CH_0 + channel_id;
 	config.edge_detect  = EVENTS_EDGE_DETECT_RISING;
 	config.path         = EVENTS_PATH_RESYNCHRONIZED;
 	config.clock_source = GCLK_GENERATOR_0;
-	
-	events_allocate(&mDMAEventChannel, &config);
 
-	events_attach_user(&mDMAEventChannel, EVSYS_ID_USER_DMAC_CH_0);
+	events_allocate(&self->rx_dma_event, &config);
+
+	events_attach_user(&self->rx_dma_event, EVSYS_ID_USER_DMAC_CH_0 + channel_id);
 
 	#if 0
 	events_create_hook(&mDMAEventHook, event_callback);
 
-	events_add_hook(&mDMAEventChannel, &mDMAEventHook);
+	events_add_hook(&self->rx_dma_event, &mDMAEventHook);
 
-	events_enable_interrupt_source(&mDMAEventChannel, EVENTS_INTERRUPT_DETECT);
+	events_enable_interrupt_source(&self->rx_dma_event, EVENTS_INTERRUPT_DETECT);
 
 	#endif
 
-	while(events_is_busy(&mDMAEventChannel)) {
+	while(events_is_busy(&self->rx_dma_event)) {
 		__NOP();
 	}
 }
 
 
-static void init_dmac(void)
+static void init_dmac(UartPort_t * self)
 {
 	// configure dma resource
 	struct dma_resource_config config;
 	dma_get_config_defaults(&config);
 
 	config.event_config.input_action = DMA_EVENT_INPUT_CTRIG;
-	config.peripheral_trigger = SERCOM4_DMAC_ID_RX;
+	config.peripheral_trigger = self->hw->dmac_id_rx;
 
 	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
 	config.event_config.event_output_enable = true;
-	
-	dma_allocate(&mDMA, &config);
 
-	
+	dma_allocate(&self->rx_dma, &config);
+
+	DmacDescriptor * descriptor = &mRxDMADescriptors[self->port];
+
 	// configure dma descriptor
 	struct dma_descriptor_config desc_config;
 	dma_descriptor_get_config_defaults(&desc_config);
 
 	desc_config.event_output_selection = DMA_EVENT_OUTPUT_BEAT;
-	
+
 	// After a block has been transferred, do nothing...
 	// here is where we configure whether or not it should interrupt
 	desc_config.block_action = DMA_BLOCK_ACTION_NOACT;
-	
+
 	// do not increment source address
 	desc_config.src_increment_enable = false;
-	desc_config.source_address = (uint32_t) &SERCOM4->USART.DATA.reg;
+	desc_config.source_address = (uint32_t) &self->hw->sercom->USART.DATA.reg;
+
 
-	
-	desc_config.block_transfer_count = sizeof(mRxRingBuf);
+	desc_config.block_transfer_count = RX_RING_BUF_SIZE;
 
 	// Still have no idea why we add by the size of the destination buffer
 	// just following the example
-	desc_config.destination_address = ((uint32_t)mRxRingBuf) + sizeof(mRxRingBuf);
-	
+	desc_config.destination_address = ((uint32_t) self->rx_ring) + RX_RING_BUF_SIZE;
+
 	// increment destination address automatically
 	desc_config.dst_increment_enable = true;
 
 	// point to ourselves so that the DMA keeps repeating this descriptor transfer
-	desc_config.next_descriptor_address = (uint32_t) &mDMADescriptor;
+	desc_config.next_descriptor_address = (uint32_t) descriptor;
+
+	dma_descriptor_create(descriptor, &desc_config);
+
+	dma_add_descriptor(&self->rx_dma, descriptor);
+
+	dma_start_transfer_job(&self->rx_dma);
+}
+
+
+
+
+static void init_tx_dmac(UartPort_t * self)
+{
+	struct dma_resource_config config;
+	dma_get_config_defaults(&config);
 
-	dma_descriptor_create(&mDMADescriptor, &desc_config);
+	config.peripheral_trigger = self->hw->dmac_id_tx;
+	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
 
-	dma_add_descriptor(&mDMA, &mDMADescriptor);
+	enum status_code ret = dma_allocate(&self->tx_dma, &config);
+	ASSERT(STATUS_OK == ret);
 
-	dma_start_transfer_job(&mDMA);
+	dma_register_callback(&self->tx_dma, callback_tx_dma_done, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&self->tx_dma, DMA_CALLBACK_TRANSFER_DONE);
 }
 
 
+static void init_port(UartPort_t * self, uint8_t port)
+{
+	self->port = port;
+	self->hw = &mHardware[port];
+
+	self->flow.dtr_gpio = UART_NO_PIN;
+	self->flow.rts_gpio = UART_NO_PIN;
+
+	self->aggregate.threshold = RX_AGGREGATE_DEFAULT_THRESHOLD;
+	self->aggregate.timeout_us = RX_AGGREGATE_DEFAULT_TIMEOUT_US;
+
+	// Initialize Tx Queue
+	RJTQueue_init(&self->tx_queue, self->tx_queue_buffer, sizeof(self->tx_queue_buffer));
+
+	const usb_cdc_line_coding_t coding = {
+		.dwDTERate   = CPU_TO_LE32(UDI_CDC_DEFAULT_RATE),
+		.bCharFormat = UDI_CDC_DEFAULT_STOPBITS,
+		.bParityType = UDI_CDC_DEFAULT_PARITY,
+		.bDataBits   = UDI_CDC_DEFAULT_DATABITS,
+	};
+
+	init_and_enable_uart(self, &coding);
+}
 
 
 void RJTUart_init(void)
 {
-	// Initialize Tx and Rx Queues
-	RJTQueue_init(&mTxQueue, mTxQueueBuffer, sizeof(mTxQueueBuffer));
+	// the rx channels first, they need an event line each
+	for(uint8_t k = 0; k < NUM_PORTS; k++) {
+		init_port(&mPorts[k], k);
+
+		init_dmac(&mPorts[k]);
+	}
+
+	for(uint8_t k = 0; k < NUM_PORTS; k++) {
+		init_beat_event(&mPorts[k]);
+
+		init_tx_dmac(&mPorts[k]);
+
+		events_trigger(&mPorts[k].rx_dma_event);
+	}
+}
+
+
+uint8_t RJTUart_getNumPorts(void)
+{
+	return NUM_PORTS;
+}
+
+
+/**
+ * Turns RTS/CTS on or off, with the RTS watermarks in bytes of the rx
+ * ring. Returns false for a port without flow control pins or
+ * watermarks that do not fit the ring.
+ */
+bool RJTUart_setFlowControl(uint8_t port, bool enable, uint16_t high_watermark, uint16_t low_watermark)
+{
+	UartPort_t * self = get_port(port);
+
+	if(NULL == self || UART_NO_PIN == self->hw->rts_pin) {
+		return false;
+	}
+
+	if(enable && (high_watermark > RX_RING_BUF_SIZE ||
+	              low_watermark >= high_watermark)) {
+		return false;
+	}
+
+	struct port_config pin_config;
+	port_get_config_defaults(&pin_config);
+
+	if(enable) {
+		// start out asserted
+		pin_config.direction = PORT_PIN_DIR_OUTPUT;
+		port_pin_set_output_level(self->hw->rts_pin, false);
+	}
+	else {
+		pin_config.direction = PORT_PIN_DIR_INPUT;
+		pin_config.input_pull = PORT_PIN_PULL_NONE;
+	}
+
+	port_pin_set_config(self->hw->rts_pin, &pin_config);
+
+	usart_disable(&self->uart);
+
+	system_interrupt_enter_critical_section();
+
+	self->flow.enabled = enable;
+	self->flow.paused = false;
+	self->flow.high_watermark = high_watermark;
+	self->flow.low_watermark = low_watermark;
+
+	system_interrupt_leave_critical_section();
+
+	init_and_enable_uart(self, &self->line_coding);
+
+	update_rts(self);
+
+	return true;
+}
+
+
+/**
+ * Puts the CDC DTR / RTS control lines on port pins, 0xff for none.
+ * The pins start out deasserted (high).
+ */
+bool RJTUart_setControlLinePins(uint8_t port, uint8_t dtr_gpio, uint8_t rts_gpio)
+{
+	UartPort_t * self = get_port(port);
+
+	if(NULL == self) {
+		return false;
+	}
+
+	struct port_config pin_config;
+	port_get_config_defaults(&pin_config);
+	pin_config.direction = PORT_PIN_DIR_OUTPUT;
+
+	if(UART_NO_PIN != dtr_gpio) {
+		port_pin_set_output_level(dtr_gpio, true);
+		port_pin_set_config(dtr_gpio, &pin_config);
+	}
+
+	if(UART_NO_PIN != rts_gpio) {
+		port_pin_set_output_level(rts_gpio, true);
+		port_pin_set_config(rts_gpio, &pin_config);
+	}
+
+	system_interrupt_enter_critical_section();
+	self->flow.dtr_gpio = dtr_gpio;
+	self->flow.rts_gpio = rts_gpio;
+	system_interrupt_leave_critical_section();
+
+	return true;
+}
+
+
+bool RJTUart_getLineInfo(uint8_t port, struct RJTUartLineInfo * info)
+{
+	UartPort_t * self = get_port(port);
+
+	if(NULL == self) {
+		return false;
+	}
+
+	system_interrupt_enter_critical_section();
+	*info = self->line_info;
+	system_interrupt_leave_critical_section();
+
+	return true;
+}
+
+
+/**
+ * Sets when received data goes to the host: once threshold bytes are
+ * waiting (1 .. ring size) or the oldest has waited timeout_us.
+ * Returns false for a bad port or a threshold out of range.
+ */
+bool RJTUart_setRxAggregation(uint8_t port, uint16_t threshold, uint32_t timeout_us)
+{
+	UartPort_t * self = get_port(port);
+
+	if(NULL == self || 0 == threshold || threshold > RX_RING_BUF_SIZE) {
+		return false;
+	}
+
+	system_interrupt_enter_critical_section();
+
+	self->aggregate.threshold = threshold;
+	self->aggregate.timeout_us = timeout_us;
+
+	system_interrupt_leave_critical_section();
+
+	return true;
+}
+
+
+/**
+ * Copies the line statistics, then zeroes them when clear is set.
+ */
+bool RJTUart_getStats(uint8_t port, struct RJTUartStats * stats, bool clear)
+{
+	UartPort_t * self = get_port(port);
+
+	if(NULL == self) {
+		return false;
+	}
+
+	system_interrupt_enter_critical_section();
+
+	// bring the receive side up to date first
+	sample_rx_ring(self);
+
+	*stats = self->stats;
+
+	if(clear) {
+		memset(&self->stats, 0, sizeof(self->stats));
+	}
+
+	system_interrupt_leave_critical_section();
+
+	return true;
+}
+
+
+/**
+ * Streams the ports in port_mask to the vendor stream endpoint, see
+ * above; 0 puts every port back on CDC. A new mark, and with it a new
+ * timestamp, is taken for a character that starts more than gap_us
+ * after the end of the one before it. Data waiting in a port's ring is
+ * dropped on the switch. Returns false for ports that do not exist.
+ */
+bool RJTUart_setStream(uint8_t port_mask, uint16_t gap_us)
+{
+	if(port_mask >= (1 << NUM_PORTS)) {
+		return false;
+	}
+
+	system_interrupt_enter_critical_section();
+	mStream.port_mask = port_mask;
+	mStream.gap_us = gap_us;
+	mStream.fill = 0;
+	system_interrupt_leave_critical_section();
+
+	for(uint8_t k = 0; k < NUM_PORTS; k++)
+	{
+		UartPort_t * self = &mPorts[k];
+		bool enable = 0 != (port_mask & (1 << k));
+
+		if(false == enable && false == self->stream.enabled) {
+			continue;
+		}
+
+		usart_disable(&self->uart);
+
+		system_interrupt_enter_critical_section();
+
+		memset(&self->stream, 0, sizeof(self->stream));
+		self->stream.enabled = enable;
+
+		sample_rx_ring(self);
+		self->rx_consumed = self->rx_produced;
+		self->rx_ring_index = self->rx_dma_pos;
+		self->aggregate.pending = false;
+
+		system_interrupt_leave_critical_section();
+
+		init_and_enable_uart(self, &self->line_coding);
+	}
+
+	return true;
+}
+
+
+/**
+ * Puts a port in a framing mode, RJT_FRAME_MODE_NONE for the plain
+ * byte stream, see above. Received data not yet sent to the host is
+ * dropped, as is a partly written host frame; bytes already in the tx
+ * queue are on their way to the DMA and still go out on the uart.
+ * Returns false for a bad port or mode.
+ */
+bool RJTUart_setFraming(uint8_t port, enum RJT_FRAME_MODE mode, bool crc)
+{
+	UartPort_t * self = get_port(port);
+
+	if(NULL == self || mode > RJT_FRAME_MODE_LENGTH) {
+		return false;
+	}
+
+	system_interrupt_enter_critical_section();
+
+	memset(&self->frame, 0, sizeof(self->frame));
 
-	init_and_enable_uart(115200);
+	self->frame.mode = mode;
+	self->frame.crc = crc;
 
-	init_dmac();
+	RJTFrame_initDecoder(&self->frame.decoder, mode,
+		self->frame.rx_buffer, sizeof(self->frame.rx_buffer));
 
-	init_beat_event();
+	// start in step with the line
+	sample_rx_ring(self);
+	self->rx_consumed = self->rx_produced;
+	self->rx_ring_index = self->rx_dma_pos;
+	self->aggregate.pending = false;
 
-	events_trigger(&mDMAEventChannel);
+	system_interrupt_leave_critical_section();
+
+	return true;
 }
 
 
@@ -593,6 +2044,8 @@ void RJTUart_testTransmit(void)
 	// Test to see what happens when we try to enqueue more data
 	// than the tx queue can hold
 
+	UartPort_t * self = &mPorts[0];
+
 	uint8_t tx_data[32];
 
 	for(size_t k = 0; k < sizeof(tx_data); k++) {
@@ -613,11 +2066,11 @@ void RJTUart_testTransmit(void)
 	}
 
 	system_interrupt_enter_critical_section();
-	while(0 < get_write_queue_available_space())
+	while(0 < get_write_queue_available_space(self))
 	{
-		size_t avail_space = get_write_queue_available_space();
+		size_t avail_space = get_write_queue_available_space(self);
 		size_t num2enqueue = MIN(avail_space, sizeof(tx_data));
-		enqueue_into_write_queue(tx_data, num2enqueue);
+		enqueue_into_write_queue(self, tx_data, num2enqueue);
 	}
 	system_interrupt_leave_critical_section();
 }
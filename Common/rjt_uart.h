@@ -5,9 +5,93 @@
  *  Author: robbytong
  */ 
 
+
+#ifndef RJT_UART_H_
+#define RJT_UART_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <cmsis_compiler.h>
+
+#include "rjt_frame.h"
+
+// SERCOMs set aside for the bridge, UDI_CDC_PORT_NB of them are used
+#define RJT_UART_MAX_PORTS		3
+
+// the port with RTS / CTS pins, its CTS is the button pin
+#define RJT_UART_FLOW_CONTROL_PORT	0
+
+struct RJTUartLineInfo
+{
+	uint32_t baudrate;			// as set, after clamping
+	uint32_t actual_baudrate;	// what the SERCOM divider makes of it
+	 int32_t error_ppm;
+	uint8_t  data_bits;
+	uint8_t  parity;			// CDC_PAR_x
+	uint8_t  stop_bits;
+	uint8_t  oversampling;
+};
+
+struct RJTUartStats
+{
+	uint32_t rx_bytes;				// received by the uart
+	uint32_t rx_dropped;			// received, but lost to overruns
+	uint32_t rx_overruns;			// rx ring overwritten before being read
+	uint32_t tx_bytes;				// sent by the uart
+	uint32_t frame_errors;
+	uint32_t parity_errors;
+	uint32_t buffer_overflows;		// SERCOM receive buffer, DMA too late
+	uint16_t rx_ring_high_water;	// bytes
+	uint16_t tx_queue_high_water;
+
+	// framing, see RJTUart_setFraming()
+	uint32_t rx_frames;				// decoded and sent to the host
+	uint32_t tx_frames;				// encoded and queued for the uart
+	uint32_t crc_errors;
+	uint32_t decode_errors;			// bad escapes, blocks, lengths, oversize
+};
+
+// payload of a frame, without its CRC
+#define RJT_UART_FRAME_MAX_LEN		240
+
+/**
+ * Record of the vendor stream, followed by len data bytes. timestamp_us
+ * is the start bit of the first byte on the RJTTimer clock.
+ */
+#define RJT_UART_STREAM_MAX_DATA		64
+
+#define RJT_UART_STREAM_FLAG_PORT_Msk	0x03
+#define RJT_UART_STREAM_FLAG_CONTINUED	0x40	// timestamp worked out, no gap before it
+#define RJT_UART_STREAM_FLAG_LOST		0x80	// data or timestamps missing before it
+
+__PACKED_STRUCT RJTUartStreamRecord
+{
+	uint8_t  flags;
+	uint8_t  len;
+	uint32_t timestamp_us;
+};
+
 void RJTUart_init(void);
 
 void RJTUart_testTransmit(void);
 
 void RJTUart_processCDC(void);
 
+uint8_t RJTUart_getNumPorts(void);
+
+bool RJTUart_getLineInfo(uint8_t port, struct RJTUartLineInfo * info);
+
+bool RJTUart_setFlowControl(uint8_t port, bool enable, uint16_t high_watermark, uint16_t low_watermark);
+
+bool RJTUart_setControlLinePins(uint8_t port, uint8_t dtr_gpio, uint8_t rts_gpio);
+
+bool RJTUart_setRxAggregation(uint8_t port, uint16_t threshold, uint32_t timeout_us);
+
+bool RJTUart_getStats(uint8_t port, struct RJTUartStats * stats, bool clear);
+
+bool RJTUart_setStream(uint8_t port_mask, uint16_t gap_us);
+
+bool RJTUart_setFraming(uint8_t port, enum RJT_FRAME_MODE mode, bool crc);
+
+
+#endif /* RJT_UART_H_ */
@@ -24,6 +24,8 @@ void RJTUSBBridge_processCmd(const uint8_t * cmd_data, size_t cmd_len,
 
 void RJTUSBBridge_rspSent(void);
 
+void RJTUSBBridge_process(void);
+
 bool RJTUSBBridge_processControlRequestWrite(
 		uint8_t bmRequest,
 		uint8_t bRequest,
@@ -65,12 +67,17 @@ enum SK_USB_CONFIG {
 	SK_USB_CONFIG_SPI_MASTER = 0x03,
 	SK_USB_CONFIG_SPI_SLAVE  = 0x04,
 	SK_USB_CONFIG_UART       = 0x05,
+	SK_USB_CONFIG_PWM        = 0x06,
 	SK_USB_CONFIG_MAX,
 };
 
 
 void RJTUSBBridge_setInterruptStatus(uint32_t interrupt_status);
 
+bool RJTUSBBridge_streamWrite(const uint8_t * buf, size_t len);
+
+bool RJTUSBBridge_isStreamReady(void);
+
 
 
 enum SK_I2CM_CLK_SEL {
@@ -101,10 +108,27 @@ enum USBCmd
 		Error Codes:
 		------------
 		- RJT_USB_ERROR_PARAMETER invalid gpio index
+		- RJT_USB_ERROR_RESOURCE_BUSY the logic analyzer, a trigger or
+		  the frequency counter uses the index
 		- RJT_USB_ERROR_NONE success
 	*/
 	
 	USB_CMD_GPIO_PARALLEL_WRITE = 0x09,
+	/**
+		Writes several gpio indices at once. Only indices set in mask
+		are changed, each one is driven to its bit in value.
+
+		Parameters:
+		-----------
+		uint32_t value  bit n is the level for gpio index n
+		uint32_t mask   bit n selects gpio index n
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER mask contains an index that is in use or invalid
+		- RJT_USB_ERROR_NONE success
+	*/
+
 	USB_CMD_GPIO_DISABLE_PIN_INTERRUPT   = 0x0A,
 	USB_CMD_SPIM_TRANSFER_DATA  = 0x0B,
 	
@@ -192,11 +216,23 @@ enum USBCmd
 		
 		Parameters:
 		-----------
-		uint8_t slave_addr
+		uint8_t slave_addr initial 7 bit target address
 		uint8_t fmt_str_len format string length
 		uint8_t[] fmt_str
 		uint8_t[] data
 		
+		Format string ops (arguments are consumed from data):
+		- 'W' <byte>           write one byte
+		- 'w' <len> <bytes>    write len bytes
+		- 'r' <len>            read len bytes
+		- '.'                  send stop
+		- 'a' <addr>           switch to 7 bit address addr
+		- 'A' <lo> <hi>        switch to 10 bit address (hi << 8 | lo)
+		
+		Address ops produce no response record. The next read or
+		write to the new address starts with a repeated start, so
+		send '.' first if the previous slave needs a stop.
+		
 		Error Codes:
 		- RJT_USB_ERROR_NONE if success
 		- RJT_USB_ERROR_OPERATION_FAILED if error occurred. ASF error returned in the response.
@@ -213,6 +249,841 @@ enum USBCmd
 		Error Codes:
 		always returns RJT_USB_ERROR_NONE
 	*/
+
+	USB_CMD_GPIO_PARALLEL_TOGGLE = 0x14,
+	/**
+		Toggles the outputs of several gpio indices at once.
+
+		Parameters:
+		-----------
+		uint32_t mask   bit n selects gpio index n
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER mask contains an index that is in use or invalid
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_GPIO_PARALLEL_READ = 0x15,
+	/**
+		Reads the input level of every gpio index. Turns on the input
+		buffer of every index not in use by a peripheral, the default
+		gpio configuration leaves it off.
+
+		No parameters.
+
+		Response:
+		---------
+		uint32_t levels bit n is the level of gpio index n. Indices
+		                in use by a peripheral read as 0.
+	*/
+
+	USB_CMD_PATTERN_CONFIGURE = 0x16,
+	/**
+		Configures the pattern generator. The selected indices become
+		outputs. Clears any samples previously written. While the
+		pattern plays only the selected pins are written, the other
+		indices can still be changed. Changing the configuration stops
+		the pattern.
+
+		Parameters:
+		-----------
+		uint32_t rate_hz     sample rate (max 2 MHz)
+		uint32_t index_mask  gpio indices driven by the pattern
+		uint8_t  mode        0 one shot, 1 loop, 2 stream
+
+		Response:
+		---------
+		uint32_t actual_rate_hz
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_RESOURCE_BUSY generator is running
+		- RJT_USB_ERROR_PARAMETER bad mode, rate or index mask
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_PATTERN_WRITE = 0x17,
+	/**
+		Appends samples to the pattern buffer (512 samples). In stream
+		mode samples fill the two 256 sample halves in turn, and are
+		only accepted into a half that has finished playing.
+
+		Parameters:
+		-----------
+		uint16_t[] samples  bit n is the level of gpio index n
+
+		Response:
+		---------
+		uint16_t num_accepted
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_STATE not configured
+		- RJT_USB_ERROR_RESOURCE_BUSY one shot or loop pattern is running
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_PATTERN_CONTROL = 0x18,
+	/**
+		Starts or stops the pattern generator. Stream mode needs both
+		halves filled before starting.
+
+		Parameters:
+		-----------
+		uint8_t action  0 stop, 1 start
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_STATE not configured or no samples
+		- RJT_USB_ERROR_RESOURCE_BUSY already running
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_PATTERN_GET_STATUS = 0x19,
+	/**
+		Returns the generator status and clears the pattern interrupt
+		bit. The bit is set when a one shot pattern finishes, a stream
+		half can be refilled, or the stream ran dry.
+
+		Response:
+		---------
+		uint8_t  state          0 idle, 1 running, 2 done, 3 underrun
+		uint8_t  mode
+		uint16_t free_samples   samples that USB_CMD_PATTERN_WRITE would accept
+		uint32_t blocks_played
+		uint32_t underruns
+	*/
+
+	USB_CMD_LOGIC_CONFIGURE = 0x1A,
+	/**
+		Configures the logic analyzer. Shares its sample clock with the
+		pattern generator, only one of them can run at a time.
+
+		A trigger index cannot have a pin interrupt, a triggered
+		transaction or a frequency measurement on it, neither when
+		configuring nor when arming. The recorded indices get their input buffer turned
+		on when armed.
+
+		Parameters:
+		-----------
+		uint32_t rate_hz        sample rate (max 2 MHz, 250 kHz with RLE)
+		uint32_t index_mask     gpio indices to record, others read as 0
+		uint32_t pre_samples    samples kept from before the trigger
+		uint32_t post_samples   samples taken from the trigger on
+		uint8_t  trigger_index  gpio index, 0xff starts capturing when armed
+		uint8_t  trigger_edge   0 falling, 1 rising, 2 both
+		uint8_t  flags          bit 0 run length encode
+
+		Without RLE pre_samples + post_samples is limited to 3072. With
+		RLE the limit depends on how often the inputs change. Runs from
+		before the pre trigger part of the window are dropped as needed,
+		once the window alone fills the runs the capture ends early and
+		the post trigger part is cut short.
+
+		Response:
+		---------
+		uint32_t actual_rate_hz
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_RESOURCE_BUSY capture in progress, or another
+		  feature uses the trigger index
+		- RJT_USB_ERROR_NO_MEMORY window does not fit
+		- RJT_USB_ERROR_PARAMETER bad rate, index mask or trigger
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_LOGIC_CONTROL = 0x1B,
+	/**
+		Controls the logic analyzer.
+
+		Parameters:
+		-----------
+		uint8_t action  0 stop, 1 arm, 2 force trigger
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_STATE not configured, or trigger while not armed
+		- RJT_USB_ERROR_RESOURCE_BUSY already capturing, the pattern
+		  generator is running, or another feature uses the trigger
+		  index
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_LOGIC_GET_STATUS = 0x1C,
+	/**
+		Returns the capture status and clears the logic interrupt bit.
+		The bit is set when a capture completes or overruns.
+
+		Response:
+		---------
+		uint8_t  state           0 idle, 1 armed, 2 triggered, 3 done,
+		                         4 overrun (RLE could not keep up)
+		uint8_t  flags           bit 0 run length encoded
+		uint32_t num_items       samples (or runs) to read, 0 until done
+		uint32_t num_samples     samples in the capture window
+		uint32_t trigger_offset  sample number of the trigger in the window
+	*/
+
+	USB_CMD_LOGIC_READ = 0x1D,
+	/**
+		Reads captured items, starting at item offset. Returns as many
+		as fit in one packet, nothing past the last one.
+
+		Parameters:
+		-----------
+		uint32_t offset
+
+		Response:
+		---------
+		uint16_t[] samples  bit n is the level of gpio index n
+		or, for an RLE capture:
+		{uint16_t sample; uint16_t count}[] runs
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_STATE no completed capture
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_GPIO_READ_EVENTS = 0x1E,
+	/**
+		Reads timestamped pin interrupt events, oldest first. Every
+		interrupt enabled with USB_CMD_GPIO_ENABLE_PIN_INTERRUPT queues
+		one event (128 deep). Read until no events are returned.
+
+		No parameters.
+
+		Response:
+		---------
+		uint16_t num_dropped  events lost to a full queue since the last read
+		{
+			uint32_t timestamp_us  see USB_CMD_GET_TIMESTAMP
+			uint8_t  index         gpio index (31 for the board button)
+			uint8_t  level         pin level when the interrupt ran
+		}[] events  (up to 10)
+	*/
+
+	USB_CMD_GET_TIMESTAMP = 0x1F,
+	/**
+		Reads the free running microsecond counter used to timestamp
+		events. Wraps every 2^32 us (~71 minutes).
+
+		No parameters.
+
+		Response:
+		---------
+		uint32_t timestamp_us
+	*/
+
+	USB_CMD_GPIO_ENABLE_PIN_INTERRUPTS = 0x20,
+	/**
+		Enables pin interrupts on several indices at once, all with the
+		same detection. Cheaper than one USB_CMD_GPIO_ENABLE_PIN_INTERRUPT
+		per index.
+
+		Parameters:
+		-----------
+		uint32_t index_mask  bit n selects gpio index n
+		uint8_t  detection   0 falling, 1 rising, 2 both
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER mask contains an index that is in use or invalid,
+		  or bad detection
+		- RJT_USB_ERROR_RESOURCE_BUSY the logic analyzer, a trigger or
+		  the frequency counter uses an index
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_GPIO_SET_LATENCY_PROBE = 0x21,
+	/**
+		Selects the index whose interrupt latency is measured, from the
+		edge at the pin to its event being dispatched. The edge is time
+		stamped in hardware, so the index needs its pin interrupt enabled
+		as well.
+
+		Parameters:
+		-----------
+		uint8_t index  gpio index, 0xff turns the probe off
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER index is in use or invalid
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_GPIO_GET_EIC_STATS = 0x22,
+	/**
+		Reads the external interrupt statistics.
+
+		Parameters:
+		-----------
+		uint8_t reset  non zero clears the statistics after reading
+
+		Response:
+		---------
+		uint32_t interrupts      EIC interrupt entries
+		uint32_t events          pin events dispatched
+		uint32_t latency_count   probe edges measured
+		uint32_t latency_min_ns
+		uint32_t latency_max_ns
+		uint32_t latency_avg_ns
+	*/
+
+	USB_CMD_FREQ_CONFIGURE = 0x23,
+	/**
+		Starts (or stops) measuring frequency and duty cycle on one gpio
+		index. Measurement runs continuously in hardware, results are
+		refreshed at the end of every gate. The index must not have a
+		pin interrupt, logic trigger or triggered transaction on it. A
+		gate that spans a USB suspend is started over.
+
+		Parameters:
+		-----------
+		uint8_t  index    gpio index, 0xff stops the measurement
+		uint16_t gate_ms  gate time, 1 to 10000
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER index in use or invalid, bad gate time
+		- RJT_USB_ERROR_RESOURCE_BUSY no timer or event channel left, or
+		  the index is used by another feature
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_FREQ_READ = 0x24,
+	/**
+		Reads the results of the last complete gate. Period and high
+		time come from the last full period captured during the gate,
+		and are 0 if none was. The first gates may be spent finding the
+		right capture range.
+
+		No parameters.
+
+		Response:
+		---------
+		uint32_t gate_no    increments with every gate, 0 until the first
+		uint32_t edges      rising edges counted during the gate
+		uint32_t freq_millihz edges / measured gate time, in millihertz
+		uint32_t period_ns
+		uint32_t high_ns
+		uint16_t duty       high / period, in 0.01 %
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_STATE not measuring
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_PWM_SET_FREQUENCY = 0x25,
+	/**
+		Changes the PWM frequency. Only valid in SK_USB_CONFIG_PWM, which
+		takes the starting frequency as its parameter:
+
+			uint32_t frequency_hz
+
+		and drives gpio indices 10 to 13 from one timer. The channels
+		share the frequency, each keeps its duty cycle across a change.
+		The new period starts at the end of the current one.
+
+		Parameters:
+		-----------
+		uint32_t frequency_hz  1 to 24000000
+
+		Response:
+		---------
+		uint32_t frequency_hz  frequency actually generated
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_STATE not in the PWM configuration
+		- RJT_USB_ERROR_PARAMETER frequency out of range
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_PWM_SET_DUTY = 0x26,
+	/**
+		Sets the duty cycle of one PWM output. It takes effect at the
+		start of the next period, never in the middle of one.
+
+		Parameters:
+		-----------
+		uint8_t  index  gpio index, 10 to 13
+		uint16_t duty   high time in 0.01 %, 0 to 10000
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_STATE not in the PWM configuration
+		- RJT_USB_ERROR_PARAMETER not a PWM index, duty out of range
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_BITBANG_SERIAL_CONFIGURE = 0x27,
+	/**
+		Defines a custom single wire protocol for the bit-bang engine as
+		two symbols, one played for each 0 bit and one for each 1 bit.
+		A symbol is up to 4 steps, each step is an action followed by a
+		hold time:
+
+			uint8_t  action   0 drive low, 1 drive high,
+			                  2 release (input, pulled up), 3 sample
+			uint16_t hold_us  0 to 10000
+
+		A sample step records the pin, the bit returned for a symbol is
+		its last sample (0 without one). Steps are precise to a few us
+		and cannot be shorter than ~5 us at the current core clock.
+
+		Parameters:
+		-----------
+		uint8_t index        gpio index
+		uint8_t lsb_first    bit order of the bytes sent
+		uint8_t num_steps0   1 to 4
+		uint8_t num_steps1   1 to 4
+		steps of the 0 symbol, then of the 1 symbol
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_RESOURCE_BUSY the engine is running
+		- RJT_USB_ERROR_PARAMETER bad index, step count, action or hold
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_BITBANG_SERIAL_WRITE = 0x28,
+	/**
+		Sends bytes with the symbols of USB_CMD_BITBANG_SERIAL_CONFIGURE.
+		Returns immediately, RJT_USB_INTERRUPT_BIT_BITBANG is set when
+		done and USB_CMD_BITBANG_READ returns the sampled bits.
+
+		Parameters:
+		-----------
+		uint8_t data[]  1 to 56 bytes
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_STATE no serial configuration
+		- RJT_USB_ERROR_RESOURCE_BUSY the engine or its timer is in use
+		- RJT_USB_ERROR_PARAMETER too much data, index no longer a gpio
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_ONEWIRE_TRANSFER = 0x29,
+	/**
+		1-Wire master: optionally resets the bus, then writes bytes
+		LSB first. Every slot samples the bus, so bytes written as 0xff
+		read back what the slave sent. Completes like
+		USB_CMD_BITBANG_SERIAL_WRITE. Nothing is sent after a reset that
+		got no presence pulse.
+
+		Parameters:
+		-----------
+		uint8_t index   gpio index
+		uint8_t flags   bit 0: reset first
+		uint8_t data[]  0 to 56 bytes
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_RESOURCE_BUSY the engine or its timer is in use
+		- RJT_USB_ERROR_PARAMETER bad index, too much data, nothing to do
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_ONEWIRE_SEARCH = 0x2A,
+	/**
+		Runs one pass of the 1-Wire ROM search, finding the next device.
+		Repeat until USB_CMD_BITBANG_READ reports the last device; the
+		search starts over after that or when no device answered.
+		Completes like USB_CMD_BITBANG_SERIAL_WRITE.
+
+		Parameters:
+		-----------
+		uint8_t index  gpio index
+		uint8_t flags  bit 0: restart from the first device
+		               bit 1: alarm search (0xEC) instead of 0xF0
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_RESOURCE_BUSY the engine or its timer is in use
+		- RJT_USB_ERROR_PARAMETER bad index
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_WS2812_WRITE = 0x2B,
+	/**
+		Stores LED data for USB_CMD_WS2812_SHOW, in wire order (GRB for
+		most parts), starting at a byte offset. Up to 64 LEDs.
+
+		Parameters:
+		-----------
+		uint16_t offset  byte offset, 0 to 191
+		uint8_t  data[]
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_RESOURCE_BUSY a WS2812 transfer is running
+		- RJT_USB_ERROR_PARAMETER data past the 192 byte buffer
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_WS2812_SHOW = 0x2C,
+	/**
+		Sends the stored LED data on one of gpio indices 10 to 13, timed
+		by hardware. The pin is left driven low, which latches the data.
+		Completes like USB_CMD_BITBANG_SERIAL_WRITE. Not available in
+		SK_USB_CONFIG_PWM.
+
+		Parameters:
+		-----------
+		uint8_t  index      gpio index, 10 to 13
+		uint16_t num_bytes  bytes to send, 1 to 192
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_RESOURCE_BUSY the engine is running
+		- RJT_USB_ERROR_PARAMETER bad index or length
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_BITBANG_READ = 0x2D,
+	/**
+		Reads the result of the last bit-bang job and clears
+		RJT_USB_INTERRUPT_BIT_BITBANG.
+
+		No parameters.
+
+		Response:
+		---------
+		uint8_t state     0 idle, 1 running, 2 done
+		uint8_t job       1 serial, 2 1-Wire transfer, 3 1-Wire search,
+		                  4 WS2812
+		uint8_t presence  1-Wire: a device answered the reset
+		uint8_t search    bit 0: device found, bit 1: last device,
+		                  bit 2: ROM CRC error
+		uint8_t len
+		uint8_t data[len] bits sampled, or the ROM found by a search
+	*/
+
+	USB_CMD_GPIO_SET_DEBOUNCE = 0x2E,
+	/**
+		Sets how long the pins of the given gpio indices have to stay at
+		a new level before the change is reported. Every edge of a burst
+		restarts the wait, the settled change then gives one event,
+		timestamped with the first edge. Resolution is 250 us. A stable
+		time of 0 reports every edge again. Applies to interrupts already
+		enabled and to those enabled later, until CNTRL_REQ_RESET.
+
+		Parameters:
+		-----------
+		uint32_t index_mask  bit n selects gpio index n
+		uint32_t stable_us   0 to 1000000
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER an index is not available as gpio or
+		  the time is too long
+		- RJT_USB_ERROR_RESOURCE_BUSY the logic analyzer, a trigger or
+		  the frequency counter uses an index
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_GPIO_WAIT = 0x2F,
+	/**
+		Waits on the device for a condition on a set of gpio indices.
+		The command returns right away; the pins are then polled from
+		the main loop, so USB and the UART keep running. When the wait
+		ends RJT_USB_INTERRUPT_BIT_WAIT is set, read the result with
+		USB_CMD_GPIO_WAIT_STATUS. Edges are counted from the levels at
+		the time of the command. An index_mask of 0 cancels a running
+		wait. The input buffers of the indices are enabled.
+		The pins are sampled once per pass of the main loop, which can
+		take hundreds of microseconds when the UARTs are busy; shorter
+		pulses can be missed.
+
+		Parameters:
+		-----------
+		uint32_t index_mask  bit n selects gpio index n
+		uint32_t level_mask  level per index, for conditions 0 and 1
+		uint8_t  condition   0 all at their level, 1 any at its level,
+		                     2 rising edge, 3 falling edge, 4 either edge
+		uint32_t timeout_us  0 waits forever, up to 0x7fffffff
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_RESOURCE_BUSY a wait is running
+		- RJT_USB_ERROR_PARAMETER an index is not available as gpio, or
+		  a bad condition or timeout
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_GPIO_WAIT_STATUS = 0x30,
+	/**
+		Reads the state of the last wait. Once the wait has ended this
+		clears RJT_USB_INTERRUPT_BIT_WAIT.
+
+		No parameters.
+
+		Response:
+		---------
+		uint8_t  state       0 idle, 1 waiting, 2 met, 3 timed out,
+		                     4 canceled
+		uint32_t elapsed_us  measured on the device, so far while waiting
+		uint32_t levels      index mask, pin levels when the wait ended
+		uint32_t trigger     index mask, the pins that met the condition
+	*/
+
+	USB_CMD_TRIGGER_CONFIGURE = 0x31,
+	/**
+		Binds a stored SPI or I2C transaction to an edge on a gpio
+		index. The transaction runs from the pin interrupt, without the
+		host, on the bus of the current configuration; each run queues a
+		timestamped result and sets RJT_USB_INTERRUPT_BIT_TRIGGER. The
+		index must not have a pin interrupt, logic trigger or frequency
+		measurement on it. The binding is dropped by a configuration
+		change. An index of 0xff unbinds.
+
+		SPI: the tx bytes are followed by zeros up to rx_len, and the
+		rx_len bytes clocked in are the result.
+		I2C: tx bytes are written (a register address usually), then
+		rx_len bytes are read after a repeated start.
+
+		Parameters:
+		-----------
+		uint8_t index      gpio index of the trigger line, 0xff unbinds
+		uint8_t detection  0 falling, 1 rising, 2 both edges
+		uint8_t bus        0 SPI, 1 I2C
+		uint8_t ss_index   SPI: chip select gpio index, 0xff for none
+		                   I2C: 7 bit slave address
+		uint8_t tx_len     0 to 16
+		uint8_t rx_len     0 to 24, SPI: 1 to 24 and at least tx_len
+		uint8_t tx[tx_len]
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_RESOURCE_BUSY a transaction is running, or the
+		  index is used by another feature
+		- RJT_USB_ERROR_PARAMETER bad index, bus or length
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_TRIGGER_READ = 0x32,
+	/**
+		Reads queued results of triggered transactions, oldest first, as
+		many as fit in the response. Clears
+		RJT_USB_INTERRUPT_BIT_TRIGGER once the queue is empty. Up to 16
+		results are held; a trigger that finds the queue full is skipped
+		and counted as dropped.
+
+		No parameters.
+
+		Response:
+		---------
+		uint8_t  count    results that follow
+		uint16_t dropped  triggers skipped since the last read
+		count times:
+			uint32_t timestamp  us, when the edge was handled
+			uint8_t  status     0 ok, 1 bus not configured, 2 bus error
+			uint8_t  len
+			uint8_t  data[len]
+	*/
+
+	USB_CMD_UART_GET_LINE_INFO = 0x33,
+	/**
+		Reads the line coding a CDC UART bridge port runs with. Rates are
+		clamped to 1200 .. 6000000 baud; up to 3 Mbaud uses 16x
+		oversampling, above that 8x. 9 data bits, mark and space parity
+		are not supported and fall back to 8 bits / no parity.
+
+		The UART commands take the CDC port number first:
+		port 0 - SERCOM4, TX PA12, RX PA13, RTS PA14, CTS PA15
+		port 1 - SERCOM0, TX PA04, RX PA05
+
+		Parameters:
+		-----------
+		uint8_t port
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER no such port
+		- RJT_USB_ERROR_NONE success
+
+		Response:
+		---------
+		uint32_t baudrate         as set by the host, after clamping
+		uint32_t actual_baudrate  produced by the fractional divider
+		int32_t  error_ppm        actual against set rate
+		uint8_t  data_bits        5 to 8
+		uint8_t  parity           0 none, 1 odd, 2 even
+		uint8_t  stop_bits        1 or 2
+		uint8_t  oversampling     16 or 8
+	*/
+
+	USB_CMD_UART_SET_FLOW_CONTROL = 0x34,
+	/**
+		Turns RTS/CTS flow control of CDC UART bridge port 0 on or off.
+		RTS (PA14) is driven high once the 2048 byte receive ring holds
+		high_watermark bytes and low again at low_watermark; leave room
+		for about 1 ms of traffic above the high watermark. CTS (PA15)
+		high holds back transmission. PA15 is the board button, which
+		stops reporting while flow control is on.
+
+		Parameters:
+		-----------
+		uint8_t  port            0, the only port with RTS/CTS
+		uint8_t  enable          0 off, 1 on
+		uint16_t high_watermark  up to 2048
+		uint16_t low_watermark   below high_watermark
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER bad port or watermarks
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_UART_SET_CONTROL_LINES = 0x35,
+	/**
+		Puts the CDC DTR and RTS control lines, as set by the host's
+		terminal, on gpio indices. The pins become outputs, low while
+		the line is asserted, and start out high.
+
+		Parameters:
+		-----------
+		uint8_t port
+		uint8_t dtr_index  gpio index, 0xff for none
+		uint8_t rts_index  gpio index, 0xff for none
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER bad port, bad or identical indices
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_UART_GET_STATS = 0x36,
+	/**
+		Reads the line statistics of a CDC UART bridge port, counted since power
+		up or the last clear. An overrun means the 2048 byte receive
+		ring was lapped before the host read it; its unread bytes are
+		dropped and counted in rx_dropped. Receive errors of one kind
+		count at most once per millisecond.
+
+		Parameters:
+		-----------
+		uint8_t port
+		uint8_t clear  1 zeroes the statistics after reading them
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER no such port
+		- RJT_USB_ERROR_NONE success
+
+		Response:
+		---------
+		uint32_t rx_bytes             received by the uart
+		uint32_t rx_dropped           received bytes lost to overruns
+		uint32_t rx_overruns
+		uint32_t tx_bytes             sent by the uart
+		uint32_t frame_errors
+		uint32_t parity_errors
+		uint32_t buffer_overflows     SERCOM receive buffer overflows
+		uint16_t rx_ring_high_water   most unread bytes in the rx ring
+		uint16_t tx_queue_high_water  most bytes queued for sending
+		uint32_t rx_frames            frames decoded and sent to the host
+		uint32_t tx_frames            frames encoded for the uart
+		uint32_t crc_errors           received frames with a bad CRC
+		uint32_t decode_errors        bad escapes, COBS blocks, lengths
+		                              or oversized frames, either way
+	*/
+
+	USB_CMD_UART_SET_RX_AGGREGATION = 0x37,
+	/**
+		Sets when data received by a CDC UART bridge port goes to the
+		host: as soon as threshold bytes are waiting, or once the oldest
+		waiting byte is timeout_us old, checked at least every USB
+		frame. Larger values mean fewer, fuller packets at the cost of
+		latency; a timeout of 0 sends everything right away. Defaults
+		are 64 bytes and 1000 us.
+
+		Parameters:
+		-----------
+		uint8_t  port
+		uint16_t threshold   bytes, 1 to 2048
+		uint32_t timeout_us
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER bad port, threshold out of range
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_UART_SET_STREAM = 0x38,
+	/**
+		Moves the UART bridge ports in port_mask from their CDC port to
+		the vendor stream endpoint (5 IN), as timestamped records; 0
+		puts every port back on CDC. Host to UART data keeps going
+		through CDC. Data waiting in a switched port is dropped.
+
+		Each transfer on the endpoint holds whole records:
+
+		uint8_t  flags          bits 0-1 port
+		                        bit 6 continued, no gap before the first
+		                              byte, its time is worked out
+		                        bit 7 data or timestamps lost before it
+		uint8_t  len            1 to 64
+		uint32_t timestamp_us   start bit of the first byte
+		uint8_t  data[len]
+
+		A record starts at every character that follows more than
+		gap_us of idle line, and timestamps come from the start bits,
+		so a response time is the difference of two record times.
+		Streaming two ports merges them oldest first; tapping both
+		directions of a line, or looping the bridge's own TX into
+		the second port, gives a timed trace of a conversation. The
+		timestamp interrupt per character limits streamed rates to a
+		few hundred kbaud.
+
+		Parameters:
+		-----------
+		uint8_t  port_mask
+		uint16_t gap_us
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER no such port
+		- RJT_USB_ERROR_NONE success
+	*/
+
+	USB_CMD_UART_SET_FRAMING = 0x39,
+	/**
+		Puts a CDC UART bridge port in a framing mode, for DUTs that
+		talk packets. The port decodes what it receives and writes each
+		good frame to CDC as {uint16_t length, payload}, as a USB
+		transfer of its own; the host writes frames the same way and
+		the port encodes them onto the line. At most one frame per
+		millisecond goes to the host. Data waiting in either direction
+		is dropped on the switch.
+
+		mode:
+		0 - none, the plain byte stream
+		1 - SLIP (RFC 1055)
+		2 - COBS, 0x00 after each frame
+		3 - uint16_t little endian length before each frame
+
+		With crc set, a CRC-16/CCITT (poly 0x1021, init 0xffff) of the
+		payload follows it on the line, little endian; received frames
+		with a bad one are dropped and counted. Payloads are 1 to 240
+		bytes. See USB_CMD_UART_GET_STATS for the frame counts.
+
+		Parameters:
+		-----------
+		uint8_t port
+		uint8_t mode
+		uint8_t crc
+
+		Error Codes:
+		------------
+		- RJT_USB_ERROR_PARAMETER no such port or mode
+		- RJT_USB_ERROR_NONE success
+	*/
 };
 
 
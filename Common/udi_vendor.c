@@ -42,20 +42,25 @@ static bool mWriteEPEnabled = false;
 static bool mNotifyEPEnabled = false;
 static bool mNotifyEPAborting = false;
 
+#ifdef UDI_VENDOR_EP_STREAM_ADDR
+static bool mStreamEPEnabled = false;
+static volatile bool mStreamEPBusy = false;
+#endif
+
 static void read_transfer_callback(udd_ep_status_t  status,
 	iram_size_t  nb_transfered,	udd_ep_id_t  ep)
 {
-	//RJTLogger_print("read_transfer_callback");
+	RJTLogger_trace("read_transfer_callback");
 	CRITICAL_SECTION_ENTER();
 
 	switch(status)
 	{
 		case UDD_EP_TRANSFER_ABORT:
-			//RJTLogger_print("abort read success");
+			RJTLogger_trace("abort read success");
 
 			if(true == mReadEPEnabled)
 			{
-				//RJTLogger_print("starting read endpoint");
+				RJTLogger_trace("starting read endpoint");
 
 				bool short_packet = mReadBufLen < UDI_VENDOR_EP_SIZE;
 
@@ -71,7 +76,7 @@ static void read_transfer_callback(udd_ep_status_t  status,
 
 		case UDD_EP_TRANSFER_OK:
 			mReadEPEnabled = false;
-			//RJTLogger_print("read success");
+			RJTLogger_trace("read success");
 			RJTUSBBridge_rspSent();
 			break;
 	}
@@ -88,7 +93,7 @@ static void process_write(iram_size_t nb_transfered)
 {
 	CRITICAL_SECTION_ENTER();
 
-	//RJTLogger_print("write transfer: %d", nb_transfered);
+	RJTLogger_trace("write transfer: %d", nb_transfered);
 
 	uint8_t buf[sizeof(mReadBuf)];
 	size_t buflen = sizeof(buf);
@@ -104,10 +109,10 @@ static void process_write(iram_size_t nb_transfered)
 		memcpy(mReadBuf, buf, buflen);
 		mReadBufLen = buflen;
 
-		//RJTLogger_print("read transfer: %d", mReadBufLen);
+		RJTLogger_trace("read transfer: %d", mReadBufLen);
 	}
 
-	//RJTLogger_print("starting write endpoint");
+	RJTLogger_trace("starting write endpoint");
 
 	// re-initialize write transfer
 	bool success =
@@ -116,18 +121,18 @@ static void process_write(iram_size_t nb_transfered)
 
 	if(true == mReadEPEnabled)
 	{
-		//RJTLogger_print("aborting read endpoint");
+		RJTLogger_trace("aborting read endpoint");
 
 		udd_ep_abort(UDI_VENDOR_EP_READ_ADDR);
 	}
 	else
 	{
 		// prepare a read job
-		//RJTLogger_print("starting read endpoint");
+		RJTLogger_trace("starting read endpoint");
 
 		bool short_packet = mReadBufLen < UDI_VENDOR_EP_SIZE;
 
-		//RJTLogger_print("short packet: %?", short_packet);
+		RJTLogger_trace("short packet: %?", short_packet);
 
 		success =
 		udd_ep_run(UDI_VENDOR_EP_READ_ADDR, short_packet, mReadBuf, mReadBufLen, read_transfer_callback);
@@ -143,7 +148,7 @@ static void process_write(iram_size_t nb_transfered)
 static void write_transfer_callback(udd_ep_status_t  status,
 	iram_size_t  nb_transfered, udd_ep_id_t  ep)
 {
-	//RJTLogger_print("nb_transfered: %d", nb_transfered);
+	RJTLogger_trace("nb_transfered: %d", nb_transfered);
 
 	if(UDI_VENDOR_EP_WRITE_ADDR != ep) {
 		RJTLogger_print("invalid write address: %x", ep);
@@ -159,7 +164,7 @@ static void write_transfer_callback(udd_ep_status_t  status,
 		} break;
 
 		case UDD_EP_TRANSFER_ABORT: {
-			//RJTLogger_print("write abort success");
+			RJTLogger_trace("write abort success");
 			if(true == mWriteEPEnabled) 
 			{
 				RJTLogger_print("starting write endpoint");
@@ -193,7 +198,7 @@ static void interrupt_transfer_callback(udd_ep_status_t status,
 	switch(status)
 	{
 		case UDD_EP_TRANSFER_OK: {
-			//RJTLogger_print("interrupt transfer ok!");
+			RJTLogger_trace("interrupt transfer ok!");
 
 			bool success =
 				udd_ep_run(UDI_VENDOR_EP_NOTIFY_ADDR,
@@ -203,7 +208,7 @@ static void interrupt_transfer_callback(udd_ep_status_t status,
 		} break;
 
 		case UDD_EP_TRANSFER_ABORT: {
-			//RJTLogger_print("interrupt transfer aborted...");
+			RJTLogger_trace("interrupt transfer aborted...");
 			
 			mNotifyEPAborting = false;
 
@@ -221,10 +226,53 @@ static void interrupt_transfer_callback(udd_ep_status_t status,
 }
 
 
+#ifdef UDI_VENDOR_EP_STREAM_ADDR
+static void stream_transfer_callback(udd_ep_status_t status,
+		iram_size_t nb_transfered, udd_ep_id_t ep)
+{
+	// done or aborted, the buffer is the writer's again either way
+	mStreamEPBusy = false;
+}
+
+
+/**
+ * Sends buf on the stream endpoint, as one transfer ended by a short
+ * packet. buf has to stay untouched until RJTUSBBridge_isStreamReady()
+ * returns true again. Returns false while a transfer is running or the
+ * interface is not enabled.
+ */
+bool RJTUSBBridge_streamWrite(const uint8_t * buf, size_t len)
+{
+	bool success = false;
+
+	CRITICAL_SECTION_ENTER();
+
+	if(true == mStreamEPEnabled && false == mStreamEPBusy)
+	{
+		success =
+			udd_ep_run(UDI_VENDOR_EP_STREAM_ADDR,
+				true, (uint8_t *) buf, len, stream_transfer_callback);
+
+		mStreamEPBusy = success;
+	}
+
+	CRITICAL_SECTION_EXIT();
+
+	return success;
+}
+
+
+bool RJTUSBBridge_isStreamReady(void)
+{
+	return mStreamEPEnabled && !mStreamEPBusy;
+}
+#endif
+
+
 static bool udi_vendor_enable(void)
 {
-	//RJTLogger_print("vendor enable");
-	//RJTLogger_print("sof callback len: %d", SOF_CALLBACK_LEN);
+	RJTLogger_trace("vendor enable");
+	RJTLogger_trace("sof callback len: %d", SOF_CALLBACK_LEN);
 
 	CRITICAL_SECTION_ENTER();
 
@@ -255,6 +303,12 @@ static bool udi_vendor_enable(void)
 
 	mNotifyEPEnabled = true;
 
+#ifdef UDI_VENDOR_EP_STREAM_ADDR
+	// a running stream transfer was aborted by the reset before this
+	mStreamEPBusy = false;
+	mStreamEPEnabled = true;
+#endif
+
 	CRITICAL_SECTION_EXIT();
 
 	return true;
@@ -288,12 +342,16 @@ void RJTUSBBridge_setInterruptStatus(uint32_t interrupt_status)
 static void udi_vendor_disable(void)
 {
 	RJTLogger_print("vendor disable");
+
+#ifdef UDI_VENDOR_EP_STREAM_ADDR
+	mStreamEPEnabled = false;
+#endif
 }
 
 
 static bool udi_vendor_setup(void)
 {
-	//RJTLogger_print("vendor setup");
+	RJTLogger_trace("vendor setup");
 
 	bool ret_code = false;
 
@@ -311,9 +369,9 @@ static bool udi_vendor_setup(void)
 			if(USB_REQ_RECIP_INTERFACE == Udd_setup_recipient())
 			{
 				// interface recipient
-				//RJTLogger_print("bRequest: %x", udd_g_ctrlreq.req.bRequest);
-				//RJTLogger_print("  wValue: %x", udd_g_ctrlreq.req.wValue);
-				//RJTLogger_print("  wIndex: %x", udd_g_ctrlreq.req.wIndex);
+				RJTLogger_trace("bRequest: %x", udd_g_ctrlreq.req.bRequest);
+				RJTLogger_trace("  wValue: %x", udd_g_ctrlreq.req.wValue);
+				RJTLogger_trace("  wIndex: %x", udd_g_ctrlreq.req.wIndex);
 
 				ret_code = RJTUSBBridge_processControlRequestWrite(
 					udd_g_ctrlreq.req.bmRequestType,
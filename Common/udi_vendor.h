@@ -24,21 +24,39 @@ extern UDC_DESC_STORAGE udi_api_t udi_api_vendor;
  * 1 OUT endpoint for writing to the function
  * 1 IN  endpoint for reading from the function
  * 1 IN Interrupt for sending notifications from the function
+ * 1 IN  endpoint streaming data from the function, see
+ *       RJTUSBBridge_streamWrite(), when conf_usb.h defines
+ *       UDI_VENDOR_EP_STREAM_ADDR
  */
 typedef struct {
 	usb_iface_desc_t  iface;
 	   usb_ep_desc_t  ep_write;
 	   usb_ep_desc_t  ep_read;
 	   usb_ep_desc_t  ep_notify;
+#ifdef UDI_VENDOR_EP_STREAM_ADDR
+	   usb_ep_desc_t  ep_stream;
+#endif
 } udi_vendor_desc_t;
 
 #define UDI_VENDOR_EP_SIZE				64
 
+#ifdef UDI_VENDOR_EP_STREAM_ADDR
+#define UDI_VENDOR_EP_STREAM_DESC ,							\
+	.ep_stream.bLength         = sizeof(usb_ep_desc_t),		\
+	.ep_stream.bDescriptorType = USB_DT_ENDPOINT,			\
+	.ep_stream.bEndpointAddress= UDI_VENDOR_EP_STREAM_ADDR,	\
+	.ep_stream.bmAttributes    = USB_EP_TYPE_BULK,			\
+	.ep_stream.bInterval       = 0,							\
+	.ep_stream.wMaxPacketSize  = LE16(UDI_VENDOR_EP_SIZE)
+#else
+#define UDI_VENDOR_EP_STREAM_DESC
+#endif
+
 #define UDI_VENDOR_DESC {		  							\
 	.iface.bLength            = sizeof(usb_iface_desc_t),	\
 	.iface.bDescriptorType    = USB_DT_INTERFACE,			\
 	.iface.bAlternateSetting  = 0,							\
-	.iface.bNumEndpoints      = 3,							\
+	.iface.bNumEndpoints      = UDI_VENDOR_NUM_ENDPOINTS,	\
 	.iface.bInterfaceClass    = 0xff,						\
 	.iface.bInterfaceSubClass = 0xff,						\
 	.iface.bInterfaceProtocol = 0xff,						\
@@ -62,6 +80,7 @@ typedef struct {
 	.ep_notify.bmAttributes    = USB_EP_TYPE_INTERRUPT,		\
 	.ep_notify.bInterval       = 100,						\
 	.ep_notify.wMaxPacketSize  = LE16(UDI_VENDOR_EP_SIZE)	\
+	UDI_VENDOR_EP_STREAM_DESC								\
 }
 
 extern uint32_t _ssof_callbacks;
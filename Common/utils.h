@@ -9,6 +9,7 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 #include <compiler.h>
+#include <stdint.h>
 
 #define ASSERT(x)											Assert(x)
 
@@ -18,6 +19,21 @@
 
 #define ARRAY_SIZE(a)									(sizeof(a)/sizeof(a[0]))
 
+/**
+ * Index of the lowest set bit of a non zero mask. Cortex-M0+ has no
+ * CLZ/RBIT, so isolate the bit and look it up by de Bruijn
+ * multiplication instead.
+ */
+static inline uint8_t lowest_bit(uint32_t mask)
+{
+	static const uint8_t de_bruijn_bit_position[32] = {
+		 0,  1, 28,  2, 29, 14, 24,  3, 30, 22, 20, 15, 25, 17,  4,  8,
+		31, 27, 13, 23, 21, 19, 16,  7, 26, 12, 18,  6, 11,  5, 10,  9,
+	};
+
+	return de_bruijn_bit_position[((mask & (0 - mask)) * 0x077CB531UL) >> 27];
+}
+
 #define APP_HIGH_PRIORITY					4
 #define APP_MID_PRIORITY					5
 #define APP_LOW_PRIORITY					6
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+#
+# rjt_log_decode.py
+#
+# Decodes the log UART, text and RJTLogger_trace() records, against the
+# ELF the firmware was built from:
+#
+#   stty -F /dev/ttyACM0 115200 raw
+#   rjt_log_decode.py serial_bridge.elf /dev/ttyACM0
+#
+# Records are laid out as in Common/rjt_logger.h. Their format strings
+# are only in the ELF, so it has to be the exact build on the device.
+
+import argparse
+import struct
+import sys
+
+TRACE_MARKER = 0xf0
+FMT_SECTION = '.rjt_log_fmt'
+
+
+def read_section(elf_path, name):
+    """Returns (address, data) of an ELF section, 32 or 64 bit."""
+    with open(elf_path, 'rb') as f:
+        elf = f.read()
+
+    if elf[:4] != b'\x7fELF':
+        sys.exit('%s: not an ELF file' % elf_path)
+
+    is_64 = (elf[4] == 2)
+    endian = '<' if elf[5] == 1 else '>'
+
+    if is_64:
+        shoff, = struct.unpack_from(endian + 'Q', elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + 'HHH', elf, 0x3a)
+        shdr = endian + 'IIQQQQIIQQ'
+    else:
+        shoff, = struct.unpack_from(endian + 'I', elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + 'HHH', elf, 0x2e)
+        shdr = endian + 'IIIIIIIIII'
+
+    sections = [struct.unpack_from(shdr, elf, shoff + k * shentsize) for k in range(shnum)]
+    strtab = sections[shstrndx]
+
+    for sh_name, _, _, sh_addr, sh_offset, sh_size, _, _, _, _ in sections:
+        start = strtab[4] + sh_name
+        if elf[start:elf.index(b'\0', start)].decode() == name:
+            return sh_addr, elf[sh_offset:sh_offset + sh_size]
+
+    sys.exit('%s: no %s section, built without RJTLogger_trace()?' % (elf_path, name))
+
+
+def hex_word(val, leading_0x):
+    # as RJTSprintf: whole bytes, leading zero bytes dropped
+    digits = '%X' % val
+    digits = digits.zfill(len(digits) + (len(digits) & 1))
+    return ('0x' if leading_0x else '') + digits
+
+
+def format_arg(spec, val):
+    if spec == 'x':
+        return hex_word(val, True)
+    if spec == 'X':
+        return hex_word(val, False)
+    if spec == 'd':
+        return ('-%d' % ((1 << 32) - val)) if val > (1 << 31) else ('+%d' % val)
+    if spec in 'bB':
+        return format(val, '08b')
+    if spec == 'c':
+        return chr(val & 0xff)
+    if spec == '?':
+        return 'true' if val & 1 else 'false'
+    if spec == 's':
+        return '<%s>' % hex_word(val, True)
+    return ''
+
+
+def format_trace(fmt, args):
+    """Formats as RJTSprintf would; every % takes an arg."""
+    out = []
+    args = iter(args)
+    k = 0
+
+    while k < len(fmt):
+        if fmt[k] == '%' and k + 1 < len(fmt):
+            out.append(format_arg(fmt[k + 1], next(args, 0)))
+            k += 2
+        else:
+            out.append(fmt[k])
+            k += 1
+
+    return ''.join(out)
+
+
+class Decoder:
+    def __init__(self, fmt_addr, fmt_data):
+        self.fmt_addr = fmt_addr
+        self.fmt_data = fmt_data
+        self.pending = bytearray()
+        self.text = bytearray()
+
+    def lookup(self, fmt_id):
+        offset = fmt_id - (self.fmt_addr & 0xffff)
+        if offset < 0 or offset >= len(self.fmt_data):
+            return None
+        end = self.fmt_data.find(b'\0', offset)
+        return self.fmt_data[offset:end].decode('ascii', 'replace')
+
+    def feed(self, data):
+        """Returns the lines completed by data."""
+        self.pending += data
+        lines = []
+
+        while self.pending:
+            byte = self.pending[0]
+
+            if byte < TRACE_MARKER:
+                del self.pending[0]
+                if byte == ord('\n'):
+                    lines.append(self.text.decode('ascii', 'replace'))
+                    self.text = bytearray()
+                elif byte != 0:
+                    # RJTLogger_print() sends the terminator too
+                    self.text.append(byte)
+                continue
+
+            num_args = byte & 0x0f
+            record_len = 3 + 4 * num_args
+
+            if len(self.pending) < record_len:
+                break
+
+            fmt_id, = struct.unpack_from('<H', self.pending, 1)
+            args = struct.unpack_from('<%dI' % num_args, self.pending, 3)
+            del self.pending[:record_len]
+
+            fmt = self.lookup(fmt_id)
+            if fmt is None:
+                lines.append('<unknown trace %04x %s>' % (fmt_id, ' '.join('%08x' % a for a in args)))
+            else:
+                lines.append(format_trace(fmt, args))
+
+        return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the RJT log UART against the firmware ELF.')
+    parser.add_argument('elf', help='the ELF running on the device')
+    parser.add_argument('input', nargs='?', help='serial device or capture, stdin if left out')
+    args = parser.parse_args()
+
+    decoder = Decoder(*read_section(args.elf, FMT_SECTION))
+
+    stream = open(args.input, 'rb', buffering=0) if args.input else sys.stdin.buffer
+
+    while True:
+        data = stream.read1(256) if hasattr(stream, 'read1') else stream.read(256)
+        if not data:
+            break
+
+        for line in decoder.feed(data):
+            print(line, flush=True)
+
+
+if __name__ == '__main__':
+    main()